@@ -0,0 +1,30 @@
+#include "stdafx.h"
+#include "DrawList.h"
+
+#include "aperio.h"
+
+//-------------------------------------------------------------------------------------------
+void DrawList::update(aperio *a)
+{
+	items.clear();	// Keeps the buckets (same props frame to frame)
+
+	for (auto &mesh : a->meshes)
+	{
+		Item &item = items[mesh->actor.GetPointer()];
+		item.mesh = mesh.get();
+		item.prepass = mesh->selected;
+	}
+
+	for (auto &elem : a->myelems)
+	{
+		Item &item = items[elem->actor.GetPointer()];
+		item.elem = elem.get();
+		item.prepass = true;
+	}
+
+	// Tool tip isn't planted (not an elem yet), but cuts the preview like one (knives only once planted)
+	auto toolTip = a->toolTip.lock();
+
+	if (a->toolTipOn && toolTip && toolTip->toolType != KNIFE)
+		items[toolTip->actor.GetPointer()].prepass = true;
+}
@@ -0,0 +1,45 @@
+// ***********************************************************************
+// Draw List - Per frame classification of the renderer's props (mesh,
+//			   elem or other, and whether the pre-pass draws it), so the
+//			   geometry passes look props up by actor in constant time
+// ***********************************************************************
+
+#ifndef DRAW_LIST_H
+#define DRAW_LIST_H
+
+#include <unordered_map>
+
+class aperio;	// Forward declarations
+class CustomMesh;
+class MyElem;
+
+//-----------------------------------------------------------------------------------------
+/// <summary> DrawList, what each mesh/elem actor is this frame. Props not in it (outlines, widgets,
+/// etc.) are neither meshes nor elems and aren't drawn by the pre-pass
+/// </summary>
+class DrawList
+{
+public:
+	struct Item
+	{
+		CustomMesh *mesh = nullptr;		// Only valid during the frame (owned by aperio's vectors)
+		MyElem *elem = nullptr;
+		bool prepass = false;			// Selected mesh, elem or tool tip (drawn into the pre-pass targets)
+	};
+
+	//--------------------------------------------------------------------------------------------------
+	/// <summary> Once per frame, before any geometry pass (meshes, elems and the tool tip)
+	/// </summary>
+	void update(aperio *a);
+
+	/// <summary> Item of prop, null if it's neither a mesh nor an elem </summary>
+	const Item *find(vtkProp *p) const
+	{
+		auto it = items.find(p);
+		return it != items.end() ? &it->second : nullptr;
+	}
+
+private:
+	std::unordered_map<vtkProp *, Item> items;
+};
+#endif
@@ -0,0 +1,147 @@
+#include "stdafx.h"
+#include "DynamicResolution.h"
+
+#include <algorithm>
+
+//-------------------------------------------------------------------------------------------
+DynamicResolution::DynamicResolution()
+{
+	for (int i = 0; i < QUERIES; i++)
+	{
+		queries[i] = 0;
+		queryScale[i] = 1.0;
+		pending[i] = false;
+	}
+}
+//-------------------------------------------------------------------------------------------
+void DynamicResolution::setEnabled(bool enabled)
+{
+	this->enabled = enabled;
+
+	scale = enabled ? std::min(1.0, maxScale) : 1.0;
+	samples = 0;
+}
+//-------------------------------------------------------------------------------------------
+void DynamicResolution::setTargetFrameRate(double fps)
+{
+	targetTime = 1000.0 / std::max(1.0, fps);
+	samples = 0;
+}
+//-------------------------------------------------------------------------------------------
+void DynamicResolution::setBounds(double minScale, double maxScale)
+{
+	this->minScale = std::max(0.1, std::min(minScale, maxScale));
+	this->maxScale = std::max(this->minScale, maxScale);
+
+	if (enabled)
+		scale = std::min(this->maxScale, std::max(this->minScale, scale));
+	samples = 0;
+}
+//-------------------------------------------------------------------------------------------
+double DynamicResolution::update()
+{
+	if (!enabled)
+		return scale;
+
+	for (int i = 0; i < QUERIES; i++)
+	{
+		if (!pending[i])
+			continue;
+
+		GLuint available = 0;
+		glGetQueryObjectuiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+
+		if (!available)
+			continue;
+
+		GLuint64 elapsed = 0;	// ns
+		glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &elapsed);
+		pending[i] = false;
+
+		// Frames rendered before the last change say nothing about this scale
+		if (queryScale[i] != scale)
+			continue;
+
+		double ms = elapsed / 1.0e6;
+		frameTime = (samples == 0) ? ms : frameTime + 0.2 * (ms - frameTime);
+		samples++;
+	}
+
+	if (samples >= MIN_SAMPLES)
+		adapt();
+
+	return scale;
+}
+//-------------------------------------------------------------------------------------------
+void DynamicResolution::adapt()
+{
+	if (frameTime <= 0)
+		return;
+
+	double ratio = targetTime / frameTime;
+
+	// Over budget, or well under it (headroom so it doesn't go back and forth)
+	if (ratio > 0.95 && ratio < 1.25)
+		return;
+
+	// Cost is about the number of pixels (scale squared), at most 0.15 per change
+	double next = scale * sqrt(ratio);
+	next = std::min(scale + 0.15, std::max(scale - 0.15, next));
+
+	// Steps of 0.05 (every change resizes the render targets)
+	next = floor(next * 20.0 + 0.5) / 20.0;
+	next = std::min(maxScale, std::max(minScale, next));
+
+	if (next != scale)
+	{
+		scale = next;
+		samples = 0;
+	}
+}
+//-------------------------------------------------------------------------------------------
+void DynamicResolution::beginFrame()
+{
+	active = -1;
+
+	if (!enabled)
+		return;
+
+	for (int i = 0; i < QUERIES; i++)
+	{
+		if (pending[i])
+			continue;
+
+		if (queries[i] == 0)
+			glGenQueries(1, &queries[i]);
+
+		active = i;
+		queryScale[i] = scale;
+
+		glBeginQuery(GL_TIME_ELAPSED, queries[i]);
+		return;
+	}
+}
+//-------------------------------------------------------------------------------------------
+void DynamicResolution::endFrame()
+{
+	if (active < 0)
+		return;
+
+	glEndQuery(GL_TIME_ELAPSED);
+	pending[active] = true;
+	active = -1;
+}
+//-------------------------------------------------------------------------------------------
+void DynamicResolution::releaseQueries()
+{
+	for (int i = 0; i < QUERIES; i++)
+	{
+		if (queries[i] != 0)
+			glDeleteQueries(1, &queries[i]);
+
+		queries[i] = 0;
+		pending[i] = false;
+	}
+	active = -1;
+	samples = 0;
+}
@@ -0,0 +1,66 @@
+// ***********************************************************************
+// Dynamic Resolution - Internal render resolution of the post-processing
+//						pass chain, scaled to hold a target frame time
+//						(GPU timer queries, results used frames later)
+// ***********************************************************************
+
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+//-----------------------------------------------------------------------------------------
+/// <summary> DynamicResolution, scale of the render targets (1 = window size). Only timings taken at
+/// the current scale count, so a change is judged by frames rendered after it
+/// </summary>
+class DynamicResolution
+{
+public:
+	DynamicResolution();
+
+	/// <summary> Timer queries need GL 3.3 (aperio's glew_available). Disabled: scale is 1 </summary>
+	void setEnabled(bool enabled);
+	bool isEnabled() const { return enabled; }
+
+	void setTargetFrameRate(double fps);
+
+	/// <summary> Scale stays in [minScale, maxScale] (above 1 renders more pixels than the window) </summary>
+	void setBounds(double minScale, double maxScale);
+
+	//--------------------------------------------------------------------------------------------------
+	/// <summary> Once per frame, before rendering: reads finished timings and adapts the scale
+	/// </summary>
+	/// <returns> Scale of this frame </returns>
+	double update();
+
+	/// <summary> Around the frame's GPU work (skipped if all queries are still in flight) </summary>
+	void beginFrame();
+	void endFrame();
+
+	double getScale() const { return scale; }
+
+	/// <summary> Smoothed GPU frame time (ms) at the current scale </summary>
+	double getFrameTime() const { return frameTime; }
+
+	/// <summary> Deletes the queries (context current), recreated when next needed </summary>
+	void releaseQueries();
+
+private:
+	static const int QUERIES = 3;	// In flight, results are never waited on
+	static const int MIN_SAMPLES = 5;	// Timings at the current scale before it changes again
+
+	unsigned int queries[QUERIES];
+	double queryScale[QUERIES];		// Scale the query's frame was rendered at
+	bool pending[QUERIES];
+	int active = -1;
+
+	bool enabled = false;
+	double targetTime = 1000.0 / 30.0;	// ms
+	double minScale = 0.5;
+	double maxScale = 1.0;
+
+	double scale = 1.0;
+	double frameTime = 0;
+	int samples = 0;
+
+	void adapt();
+};
+#endif
@@ -0,0 +1,114 @@
+#include "stdafx.h"
+#include "ExplodeAnimation.h"
+
+#include <algorithm>
+
+//-------------------------------------------------------------------------------------------
+void ExplodeAnimation::addKeyframe(AnimationChannel channel, double time, double value, EasingType easing)
+{
+	auto &track = tracks[channel];
+
+	Keyframe key = { time, value, easing };
+
+	auto it = std::lower_bound(track.begin(), track.end(), time, [](const Keyframe &k, double t) { return k.time < t; });
+
+	if (it != track.end() && it->time == time)
+		*it = key;
+	else
+		track.insert(it, key);
+}
+//-------------------------------------------------------------------------------------------
+void ExplodeAnimation::clear()
+{
+	for (auto &track : tracks)
+		track.clear();
+
+	playing = false;
+	startTime = 0;
+}
+//-------------------------------------------------------------------------------------------
+double ExplodeAnimation::getDuration() const
+{
+	double duration = 0;
+
+	for (auto &track : tracks)
+	{
+		if (!track.empty())
+			duration = std::max(duration, track.back().time);
+	}
+	return duration;
+}
+//-------------------------------------------------------------------------------------------
+double ExplodeAnimation::ease(EasingType easing, double t)
+{
+	t = std::min(1.0, std::max(0.0, t));
+
+	switch (easing)
+	{
+	case EASE_IN:
+		return t * t * t;
+	case EASE_OUT:
+		return 1.0 - (1.0 - t) * (1.0 - t) * (1.0 - t);
+	case EASE_IN_OUT:
+		return t * t * (3.0 - 2.0 * t);		// Smoothstep
+	default:
+		return t;
+	}
+}
+//-------------------------------------------------------------------------------------------
+double ExplodeAnimation::evaluate(AnimationChannel channel, double time) const
+{
+	auto &track = tracks[channel];
+
+	if (track.empty())
+		return 0;
+	if (time <= track.front().time)
+		return track.front().value;
+	if (time >= track.back().time)
+		return track.back().value;
+
+	// First key after time (segment is [it - 1, it])
+	auto it = std::upper_bound(track.begin(), track.end(), time, [](double t, const Keyframe &k) { return t < k.time; });
+	auto &k0 = *(it - 1);
+	auto &k1 = *it;
+
+	double span = k1.time - k0.time;
+	double t = span > 0 ? (time - k0.time) / span : 1.0;
+
+	return k0.value + ease(k1.easing, t) * (k1.value - k0.value);
+}
+//-------------------------------------------------------------------------------------------
+void ExplodeAnimation::play()
+{
+	if (startTime >= getDuration())	// Finished, restart
+		startTime = 0;
+
+	playStart = std::chrono::high_resolution_clock::now();
+	playing = true;
+}
+//-------------------------------------------------------------------------------------------
+bool ExplodeAnimation::update(double values[ANIM_CHANNELS], bool active[ANIM_CHANNELS])
+{
+	if (!playing)
+		return false;
+
+	double duration = getDuration();
+	double time = startTime + std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - playStart).count();
+
+	if (time >= duration)
+	{
+		// Last frame is exactly the last keyframe
+		time = duration;
+		startTime = duration;
+		playing = false;
+	}
+
+	for (int i = 0; i < ANIM_CHANNELS; i++)
+	{
+		active[i] = hasKeys((AnimationChannel)i);
+		values[i] = evaluate((AnimationChannel)i, time);
+	}
+
+	// Update returns the final frame too (so it is applied before stopping)
+	return true;
+}
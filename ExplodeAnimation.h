@@ -0,0 +1,67 @@
+// ***********************************************************************
+// Explode Animation - Keyframed, time-based explode/leaf/hinge parameters
+//					   (evaluated once per frame by aperio's frame timer)
+// ***********************************************************************
+
+#ifndef EXPLODE_ANIMATION_H
+#define EXPLODE_ANIMATION_H
+
+/// <summary> Animated parameters (same units as their sliders, 0..100) </summary>
+enum AnimationChannel { ANIM_EXPLODE, ANIM_LEAF, ANIM_HINGE, ANIM_CHANNELS };
+
+/// <summary> Easing of the segment leading into a keyframe </summary>
+enum EasingType { EASE_LINEAR, EASE_IN, EASE_OUT, EASE_IN_OUT };
+
+//-----------------------------------------------------------------------------------------
+/// <summary> ExplodeAnimation, one keyframe track per channel. Values are a function of time only
+/// (play), so the same keyframes always give the same animation
+/// </summary>
+class ExplodeAnimation
+{
+public:
+	struct Keyframe
+	{
+		double time;		// Seconds from start
+		double value;
+		EasingType easing;
+	};
+
+	//--------------------------------------------------------------------------------------------------
+	/// <summary> Adds (or replaces, at the same time) a keyframe, tracks are kept sorted by time
+	/// </summary>
+	void addKeyframe(AnimationChannel channel, double time, double value, EasingType easing = EASE_IN_OUT);
+
+	void clear();
+	bool hasKeys(AnimationChannel channel) const { return !tracks[channel].empty(); }
+
+	/// <summary> Time of the last keyframe (of all tracks) </summary>
+	double getDuration() const;
+
+	//--------------------------------------------------------------------------------------------------
+	/// <summary> Value of a channel at time (held constant before the first and after the last key)
+	/// </summary>
+	double evaluate(AnimationChannel channel, double time) const;
+
+	//--------------------------------------------------------------------------------------------------
+	/// <summary> Easing curve, t in [0, 1] </summary>
+	static double ease(EasingType easing, double t);
+
+	void play();
+	void stop() { playing = false; }
+	bool isPlaying() const { return playing; }
+
+	//--------------------------------------------------------------------------------------------------
+	/// <summary> Advances clock and evaluates all channels with keys (active) at the current time.
+	/// Playback stops after the last keyframe
+	/// </summary>
+	/// <returns> Whether playing (values are only valid if true) </returns>
+	bool update(double values[ANIM_CHANNELS], bool active[ANIM_CHANNELS]);
+
+private:
+	vector<Keyframe> tracks[ANIM_CHANNELS];
+
+	bool playing = false;
+	double startTime = 0;		// Animation time at playStart
+	std::chrono::high_resolution_clock::time_point playStart;
+};
+#endif
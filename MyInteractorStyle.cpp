@@ -39,6 +39,10 @@ MyInteractorStyle::MyInteractorStyle() : NumberOfClicks(0), NumberOfClicksR(0),
 	dragging = false;
 	creation = false;
 
+	movePending = false;
+	moveX = moveY = 0;
+	lastMoveX = lastMoveY = -1;	// No update applied yet
+
 	a = nullptr;
 }
 //---------------------------------------------------------------------------------------------------------------
@@ -60,11 +64,7 @@ void MyInteractorStyle::OnKeyPress()
 
 	auto toolTip = a->toolTip.lock();
 
-	// CTRL+Z
-	if ((GetKeyState(VK_CONTROL) & 0x1000) && (GetKeyState('Z') & 0x1000) && a->selectedMeshes.size() > 0)
-	{
-		a->removeSelectedMesh(a->selectedMeshes.size() - 1);
-	}
+	// CTRL+Z is undo (aperio's QShortcut)
 
 	// Plant the object
 	if (GetKeyState(VK_RETURN) & 0x1000)
@@ -93,9 +93,7 @@ void MyInteractorStyle::OnKeyPress()
 		{
 			auto selectedMesh = a->selectedMeshes.back().lock();
 
-			vtkSmartPointer<vtkTransformPolyDataFilter> transformFilter = toolTip->transformFilter;
-			transformFilter->SetTransform(a->makeCompositeTransformFromSinglePoint(*toolTip, selectedMesh));
-			transformFilter->Update();
+			a->placeElem(toolTip, a->makeCompositeTransformFromSinglePoint(*toolTip, selectedMesh));
 		}
 		OnMouseMove();
 	}
@@ -108,21 +106,29 @@ void MyInteractorStyle::OnKeyPress()
 	// Show all
 	if (GetKeyState(VK_MENU) & 0x1000 && GetKeyState('H') & 0x1000)
 	{
+		a->flushSliderChanges();
+		a->beginOpacityChange(vector<weak_ptr<CustomMesh> >(a->meshes.begin(), a->meshes.end()));
+
 		for (auto &mesh : a->meshes)
 		{
 			Utility::setMeshOpacity(a, mesh, 1.0);
 		}
 		a->updateOpacitySliderAndList();
+		a->endOpacityChange();
 	}
 
 	// Hide all
 	else if (GetKeyState(VK_SHIFT) & 0x1000 && GetKeyState('H') & 0x1000)
 	{
+		a->flushSliderChanges();
+		a->beginOpacityChange(vector<weak_ptr<CustomMesh> >(a->meshes.begin(), a->meshes.end()));
+
 		for (auto &mesh : a->meshes)
 		{
 			Utility::setMeshOpacity(a, mesh, 0.0);
 		}
 		a->updateOpacitySliderAndList();
+		a->endOpacityChange();
 	}
 	else if (GetKeyState('H') & 0x1000)	// Holding H alone
 	{
@@ -177,10 +183,26 @@ void MyInteractorStyle::OnKeyPress()
 	{
 		a->slot_btnGlass();
 	}
+	if (keypressed == 'k')	// Add explode animation keyframe (from sliders)
+	{
+		a->addAnimationKeyframe();
+	}
+	if (keypressed == 'p')	// Play/stop explode animation
+	{
+		a->toggleAnimation();
+	}
+	if (keypressed == 'l')	// Clear explode animation
+	{
+		a->clearAnimation();
+	}
 	if (keypressed == '0')		// Change shading model
 	{
 		a->shadingnum = (a->shadingnum + 1) % 2;
 	}
+	if (keypressed == '9')		// Change SSAO resolution (full, half, quarter)
+	{
+		a->setSSAOQuality((SSAOQuality)((a->ssaoQuality + 1) % 3));
+	}
 	float thestep = 0.05;
 
 	if (keypressed == 'z' )	// Show elements
@@ -210,14 +232,77 @@ void MyInteractorStyle::OnKeyPress()
 //----------------------------------------------------------------------------------------
 void MyInteractorStyle::OnMouseMove()
 {
-	int x = this->Interactor->GetEventPosition()[0];
-	int y = this->Interactor->GetEventPosition()[1];
-	int prevx = this->Interactor->GetLastEventPosition()[0];
-	int prevy = this->Interactor->GetLastEventPosition()[1];
+	// Only record latest cursor position, the pick and tool update run once per frame (updateInteraction)
+	if (!movePending)
+	{
+		movePending = true;
+		moveFirstTime = std::chrono::high_resolution_clock::now();
+	}
+	moveX = this->Interactor->GetEventPosition()[0];
+	moveY = this->Interactor->GetEventPosition()[1];
+	latencyEvents++;
+
+	// Camera interaction stays immediate (no render here, see Rotate/Pan overrides)
+	vtkInteractorStyleTrackballCamera::OnMouseMove();
+}
+//----------------------------------------------------------------------------------------
+void MyInteractorStyle::updateInteraction()
+{
+	if (!movePending || !this->Interactor)
+		return;
+
+	movePending = false;
+
+	int x = moveX;
+	int y = moveY;
+	int prevx = lastMoveX < 0 ? x : lastMoveX;
+	int prevy = lastMoveY < 0 ? y : lastMoveY;
+
+	lastMoveX = x;
+	lastMoveY = y;
+
+	updateInteractionInternal(x, y, prevx, prevy);
+
+	// Input latency (first coalesced event to tool updated, before the frame renders)
+	double latency = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - moveFirstTime).count();
+	latencySum += latency;
+	latencyMax = std::max(latencyMax, latency);
+	latencyUpdates++;
+}
+//----------------------------------------------------------------------------------------
+void MyInteractorStyle::getLatencyStats(double &average, double &maximum, int &events, int &updates)
+{
+	average = latencyUpdates > 0 ? latencySum / latencyUpdates : 0;
+	maximum = latencyMax;
+	events = latencyEvents;
+	updates = latencyUpdates;
+
+	// Stats are per reporting window
+	latencySum = latencyMax = 0;
+	latencyEvents = latencyUpdates = 0;
+}
+//----------------------------------------------------------------------------------------
+void MyInteractorStyle::updateInteractionInternal(int x, int y, int prevx, int prevy)
+{
+	vtkRenderer *firstRenderer = this->Interactor->GetRenderWindow()->GetRenderers()->GetFirstRenderer();
 
-	cellPicker->Pick(x, y, 0,this->Interactor->GetRenderWindow()->GetRenderers()->GetFirstRenderer());
-	cellPicker->GetPickPosition(a->mouse);
-	cellPicker->GetPickNormal(a->mouseNorm);
+	if (a->widgetSelectMode)
+	{
+		// Elems are pickable in widget select mode, only VTK's picker knows about them
+		cellPicker->Pick(x, y, 0, firstRenderer);
+		cellPicker->GetPickPosition(a->mouse);
+		cellPicker->GetPickNormal(a->mouseNorm);
+		hoveredMesh = a->getMeshByActorRaw(cellPicker->GetActor());
+	}
+	else
+	{
+		// Meshes only (two-level BVH, mesh triangle BVHs built on first hover)
+		SceneBVHHit hit;
+		a->sceneBVH.pick(a, firstRenderer, x, y, hit);
+		std::copy(hit.point, hit.point + 3, a->mouse);
+		std::copy(hit.normal, hit.normal + 3, a->mouseNorm);
+		hoveredMesh = hit.mesh;
+	}
 
 	auto toolTip = a->toolTip.lock();
 
@@ -245,8 +330,8 @@ void MyInteractorStyle::OnMouseMove()
 			
 			this->ComputeWorldToDisplay(toolTip->p1.point.GetX(), toolTip->p1.point.GetY(), toolTip->p1.point.GetZ(), viewFocus);
 			focalDepth = viewFocus[2];
-			this->ComputeDisplayToWorld(rwi->GetEventPosition()[0], rwi->GetEventPosition()[1], focalDepth, newPickPoint);
-			this->ComputeDisplayToWorld(rwi->GetLastEventPosition()[0], rwi->GetLastEventPosition()[1], focalDepth, oldPickPoint);
+			this->ComputeDisplayToWorld(x, y, focalDepth, newPickPoint);
+			this->ComputeDisplayToWorld(prevx, prevy, focalDepth, oldPickPoint);
 			motionVector[0] = newPickPoint[0] - oldPickPoint[0];
 			motionVector[1] = newPickPoint[1] - oldPickPoint[1];
 			motionVector[2] = newPickPoint[2] - oldPickPoint[2];
@@ -263,6 +348,7 @@ void MyInteractorStyle::OnMouseMove()
 			
 			if (toolTip->toolType == RING)
 			{
+				selectedMesh->ensureOBB();
 
 				float deltaR = mv.Dot(selectedMesh->axesOBB[0]);
 				float deltaU = mv.Dot(selectedMesh->axesOBB[1]);
@@ -338,9 +424,7 @@ void MyInteractorStyle::OnMouseMove()
 
 		if (toolTip->toolType != KNIFE)
 		{
-			vtkSmartPointer<vtkTransformPolyDataFilter> transformFilter = toolTip->transformFilter;
-			transformFilter->SetTransform(a->makeCompositeTransformFromSinglePoint(*toolTip));
-			transformFilter->Update();
+			a->placeElem(toolTip, a->makeCompositeTransformFromSinglePoint(*toolTip));
 
 
 			if (!a->selectedMeshes.empty())
@@ -351,8 +435,7 @@ void MyInteractorStyle::OnMouseMove()
 				//if (GetKeyState(VK_MENU) & 0x1000)
 				if (a->snapToBBOXReal)
 				{
-					transformFilter->SetTransform(a->makeCompositeTransformFromSinglePoint(*toolTip, selectedMesh));
-					transformFilter->Update();
+					a->placeElem(toolTip, a->makeCompositeTransformFromSinglePoint(*toolTip, selectedMesh));
 				}				
 			}
 		}
@@ -396,18 +479,11 @@ void MyInteractorStyle::OnMouseMove()
 				toolTip->source->SetThetaRoundness(0);
 				toolTip->scale.SetY(10000);
 
-				vtkSmartPointer<vtkTransformPolyDataFilter> transformFilter = toolTip->transformFilter;
-				transformFilter->SetTransform(a->makeCompositeTransform(*toolTip));
-				//transformFilter->SetInputData(superquad->GetOutput());
-				transformFilter->Update();
+				a->placeElem(toolTip, a->makeCompositeTransform(*toolTip));
 				return;
 			}
 		}
 	}
-	// Gets hovered actor
-	vtkSmartPointer<vtkActor> actorHovered = cellPicker->GetActor();
-
-	vtkInteractorStyleTrackballCamera::OnMouseMove();
 }
 //------------------------------------------------------------------------------------------------------------
 void MyInteractorStyle::OnLeftButtonDown()
@@ -419,6 +495,13 @@ void MyInteractorStyle::OnLeftButtonDown()
 	if (a->toolTipOn && toolTip && (toolTip->toolType == CUTTER || toolTip->toolType == KNIFE))
 		cuttermode = true;
 
+	// Apply any pending mouse move first (tool must be where the cursor is)
+	updateInteraction();
+
+	// Clicks still go through the cellPicker, give it the hovered mesh's locator
+	if (auto mesh = hoveredMesh.lock())
+		a->registerMeshLocator(mesh);
+
 	// ---- Checking for double clicks
 	this->NumberOfClicks++;
 	int pickPosition[2];
@@ -581,10 +664,7 @@ void MyInteractorStyle::OnLeftButtonDown()
 			cellPicker->GetPickNormal()[1],
 			cellPicker->GetPickNormal()[2]);
 
-		vtkSmartPointer<vtkTransformPolyDataFilter> transformFilter = toolTip->transformFilter;
-		transformFilter->SetTransform(a->makeCompositeTransformFromSinglePoint(*toolTip));
-		//transformFilter->SetInputData(superquad->GetOutput());
-		transformFilter->Update();
+		a->placeElem(toolTip, a->makeCompositeTransformFromSinglePoint(*toolTip));
 
 		if (toolTip->toolType == KNIFE) //GetKeyState(VK_CONTROL) & 0x1000)
 		{
@@ -623,6 +703,9 @@ void MyInteractorStyle::OnLeftButtonDown()
 //----------------------------------------------------------------------------------------------
 void MyInteractorStyle::OnLeftButtonUp()
 {
+	// Knife end point comes from the latest mouse position
+	updateInteraction();
+
 	if (dragging)
 	{
 		dragging = false;
@@ -661,10 +744,7 @@ void MyInteractorStyle::OnLeftButtonUp()
 			//toolTip->scale = vtkVector3f(dist(a->pos1, a->pos2), 0.1, 0.1);
 			toolTip->scale.SetX(10000);	// 10000
 
-			vtkSmartPointer<vtkTransformPolyDataFilter> transformFilter = toolTip->transformFilter;
-			transformFilter->SetTransform(a->makeCompositeTransform(*toolTip));
-			//transformFilter->SetInputData(superquad->GetOutput());
-			transformFilter->Update();
+			a->placeElem(toolTip, a->makeCompositeTransform(*toolTip));
 		}
 	}
 	vtkInteractorStyleTrackballCamera::OnLeftButtonUp();
@@ -749,15 +829,15 @@ void MyInteractorStyle::OnMouseWheelForward()
 			return;
 		}
 		
-		MyElem *currentElem;
+		shared_ptr<MyElem> currentElem;
 		bool incisionElem = false;
 		if (a->myelems.size() > 0 && toolTip->toolType == KNIFE)
 		{
-			currentElem = a->myelems[a->myelems.size() - 1].get();
+			currentElem = a->myelems[a->myelems.size() - 1];
 			incisionElem = true;
 		}
 		else
-			currentElem = toolTip.get();
+			currentElem = toolTip;
 		
 		if (GetKeyState(VK_MENU) & 0x1000 && this->Interactor->GetShiftKey() && toolTip->toolType == RING)
 			//((strcmp(this->Interactor->GetKeySym(), "z") == 0)||
@@ -862,13 +942,11 @@ void MyInteractorStyle::OnMouseWheelForward()
 		}
 		if (incisionElem)
 		{
-			currentElem->transformFilter->SetTransform(a->makeCompositeTransform(*currentElem));
-			currentElem->transformFilter->Update();	// Must update transform filter for updates to show
+			a->placeElem(currentElem, a->makeCompositeTransform(*currentElem));
 		}
 		else
 		{
-			currentElem->transformFilter->SetTransform(a->makeCompositeTransformFromSinglePoint(*currentElem));
-			currentElem->transformFilter->Update();	// Must update transform filter for updates to show
+			a->placeElem(currentElem, a->makeCompositeTransformFromSinglePoint(*currentElem));
 		}
 		return;
 	}
@@ -897,15 +975,15 @@ void MyInteractorStyle::OnMouseWheelBackward()
 		}
 
 		
-		MyElem *currentElem;
+		shared_ptr<MyElem> currentElem;
 		bool incisionElem = false;
 		if (a->myelems.size() > 0 && toolTip->toolType == KNIFE)
 		{
-			currentElem = a->myelems[a->myelems.size() - 1].get();
+			currentElem = a->myelems[a->myelems.size() - 1];
 			incisionElem = true;
 		}
 		else
-			currentElem = toolTip.get();
+			currentElem = toolTip;
 
 		if ((GetKeyState(VK_MENU) & 0x1000) && this->Interactor->GetShiftKey() && toolTip->toolType == RING)
 			//((strcmp(this->Interactor->GetKeySym(), "z") == 0) ||
@@ -1000,13 +1078,11 @@ void MyInteractorStyle::OnMouseWheelBackward()
 		}
 		if (incisionElem)
 		{
-			currentElem->transformFilter->SetTransform(a->makeCompositeTransform(*currentElem));
-			currentElem->transformFilter->Update();	// Must update transform filter for updates to show
+			a->placeElem(currentElem, a->makeCompositeTransform(*currentElem));
 		}
 		else
 		{
-			currentElem->transformFilter->SetTransform(a->makeCompositeTransformFromSinglePoint(*currentElem));
-			currentElem->transformFilter->Update();	// Must update transform filter for updates to show
+			a->placeElem(currentElem, a->makeCompositeTransformFromSinglePoint(*currentElem));
 		}
 		return;
 	}
@@ -11,6 +11,7 @@
 #include "vtkInteractorStyleTrackballCamera.h"
 
 class aperio;	// Forward declarations
+class CustomMesh;
 
 //-----------------------------------------------------------------------------------------
 /// <summary> Class MyInteractorStyle, contains direct key press, mouse events etc.
@@ -21,6 +22,8 @@ public:
 	/// <summary> Pointer to the mainwindow class so we can access instance variables, etc. </summary>
 	aperio * a;
 	vtkSmartPointer<vtkCellPicker> cellPicker;
+	/// <summary> Mesh under the cursor (updated on mouse move) </summary>
+	weak_ptr<CustomMesh> hoveredMesh;
 
 private:
 	unsigned int NumberOfClicks;	// For double clicks
@@ -38,8 +41,23 @@ private:
 	bool dragging;
 	bool creation;
 
+	// Coalesced mouse move (latest cursor position, applied once per frame)
+	bool movePending;
+	int moveX, moveY;
+	int lastMoveX, lastMoveY;		// Cursor position of last applied update
+	std::chrono::high_resolution_clock::time_point moveFirstTime;
+
+	// Input latency stats (ms) for the profiler, reset by getLatencyStats
+	double latencySum = 0;
+	double latencyMax = 0;
+	int latencyEvents = 0;		// OS mouse move events received
+	int latencyUpdates = 0;		// Updates actually applied
+
 	void avgNormal(double *currentN, double *averageN);
 
+	// Pick and tool update for a mouse move (from prevx, prevy to x, y)
+	void updateInteractionInternal(int x, int y, int prevx, int prevy);
+
 public:
 
 	//--------------------------------------------------------------------------------------------------
@@ -78,11 +96,21 @@ public:
 
 	//----------------------------------------------------------------------------
 	/// <summary>
-	/// Called when [mouse move].
+	/// Called when [mouse move]. Only records cursor position (see updateInteraction)
 	/// </summary>
 	/// ----------------------------------------------------------------------------
 	virtual void OnMouseMove()  override;
 
+	//----------------------------------------------------------------------------
+	/// <summary> Applies latest mouse move (pick, tool update), called once per frame before rendering
+	/// </summary>
+	void updateInteraction();
+
+	//----------------------------------------------------------------------------
+	/// <summary> Input latency since last call (average/max in ms, events received, updates applied)
+	/// </summary>
+	void getLatencyStats(double &average, double &maximum, int &events, int &updates);
+
 	//----------------------------------------------------------------------------
 	/// <summary>
 	/// Called when [mouse left button click].
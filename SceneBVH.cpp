@@ -0,0 +1,614 @@
+#include "stdafx.h"
+#include "SceneBVH.h"
+
+#include "aperio.h"
+
+#include <algorithm>
+
+// BVH builder ---------------------------------------------------------------------------------
+namespace
+{
+	const int BVH_BINS = 12;
+	const int BVH_STACK_SIZE = 64;
+
+	/// <summary> Item bounds and centroid (triangles or meshes) </summary>
+	struct BVHItem
+	{
+		float bmin[3];
+		float bmax[3];
+		float centroid[3];
+	};
+
+	//------------------------------------------------------------------------------------------
+	void growBounds(float bmin[3], float bmax[3], const float imin[3], const float imax[3])
+	{
+		for (int j = 0; j < 3; j++)
+		{
+			bmin[j] = std::min(bmin[j], imin[j]);
+			bmax[j] = std::max(bmax[j], imax[j]);
+		}
+	}
+	//------------------------------------------------------------------------------------------
+	void resetBounds(float bmin[3], float bmax[3])
+	{
+		for (int j = 0; j < 3; j++)
+		{
+			bmin[j] = VTK_FLOAT_MAX;
+			bmax[j] = -VTK_FLOAT_MAX;
+		}
+	}
+	//------------------------------------------------------------------------------------------
+	float halfArea(const float bmin[3], const float bmax[3])
+	{
+		float e[3] = { bmax[0] - bmin[0], bmax[1] - bmin[1], bmax[2] - bmin[2] };
+		if (e[0] < 0) return 0;
+		return e[0] * e[1] + e[1] * e[2] + e[2] * e[0];
+	}
+	//------------------------------------------------------------------------------------------
+	/// <summary> Binned SAH build. Fills nodes and order (leaf item ranges index into order) </summary>
+	void buildBVH(const vector<BVHItem> &items, int maxLeafSize, vector<BVHNode> &nodes, vector<int> &order)
+	{
+		int n = (int)items.size();
+
+		order.resize(n);
+		for (int i = 0; i < n; i++)
+			order[i] = i;
+
+		nodes.clear();
+		nodes.reserve(std::max(1, 2 * n));
+
+		BVHNode root;
+		root.first = 0;
+		root.count = n;
+		resetBounds(root.bmin, root.bmax);
+		for (int i = 0; i < n; i++)
+			growBounds(root.bmin, root.bmax, items[i].bmin, items[i].bmax);
+		nodes.push_back(root);
+
+		vector<int> stack;
+		stack.push_back(0);
+
+		while (!stack.empty())
+		{
+			int ni = stack.back();
+			stack.pop_back();
+
+			int first = nodes[ni].first;
+			int count = nodes[ni].count;
+
+			if (count <= maxLeafSize)
+				continue;
+
+			// Split axis is the longest axis of the centroid bounds
+			float cmin[3], cmax[3];
+			resetBounds(cmin, cmax);
+			for (int i = first; i < first + count; i++)
+				growBounds(cmin, cmax, items[order[i]].centroid, items[order[i]].centroid);
+
+			int axis = 0;
+			for (int j = 1; j < 3; j++)
+			{
+				if (cmax[j] - cmin[j] > cmax[axis] - cmin[axis])
+					axis = j;
+			}
+
+			float extent = cmax[axis] - cmin[axis];
+			if (extent <= 0)
+				continue;	// All centroids coincide, keep as leaf
+
+			auto binOf = [&](int item) -> int {
+				int b = (int)(BVH_BINS * (items[item].centroid[axis] - cmin[axis]) / extent);
+				return std::min(BVH_BINS - 1, b);
+			};
+
+			// Bin items
+			float binMin[BVH_BINS][3], binMax[BVH_BINS][3];
+			int binCount[BVH_BINS] = { 0 };
+			for (int b = 0; b < BVH_BINS; b++)
+				resetBounds(binMin[b], binMax[b]);
+
+			for (int i = first; i < first + count; i++)
+			{
+				int b = binOf(order[i]);
+				binCount[b]++;
+				growBounds(binMin[b], binMax[b], items[order[i]].bmin, items[order[i]].bmax);
+			}
+
+			// Sweep to find the cheapest split plane (between bin s and s + 1)
+			float rightArea[BVH_BINS];
+			int rightCount[BVH_BINS];
+			float accMin[3], accMax[3];
+			int acc = 0;
+
+			resetBounds(accMin, accMax);
+			for (int b = BVH_BINS - 1; b > 0; b--)
+			{
+				acc += binCount[b];
+				growBounds(accMin, accMax, binMin[b], binMax[b]);
+				rightArea[b] = halfArea(accMin, accMax);
+				rightCount[b] = acc;
+			}
+
+			float bestCost = VTK_FLOAT_MAX;
+			int bestSplit = -1;
+
+			resetBounds(accMin, accMax);
+			acc = 0;
+			for (int s = 0; s < BVH_BINS - 1; s++)
+			{
+				acc += binCount[s];
+				growBounds(accMin, accMax, binMin[s], binMax[s]);
+
+				if (acc == 0 || rightCount[s + 1] == 0)
+					continue;
+
+				float cost = halfArea(accMin, accMax) * acc + rightArea[s + 1] * rightCount[s + 1];
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestSplit = s;
+				}
+			}
+
+			int mid;
+			if (bestSplit >= 0)
+			{
+				auto it = std::partition(order.begin() + first, order.begin() + first + count,
+					[&](int item) { return binOf(item) <= bestSplit; });
+				mid = (int)(it - order.begin());
+			}
+			else
+			{
+				// No useful split found, fall back to a median split
+				mid = first + count / 2;
+				std::nth_element(order.begin() + first, order.begin() + mid, order.begin() + first + count,
+					[&](int i0, int i1) { return items[i0].centroid[axis] < items[i1].centroid[axis]; });
+			}
+
+			// Make children (adjacent)
+			int left = (int)nodes.size();
+			BVHNode children[2];
+			children[0].first = first;
+			children[0].count = mid - first;
+			children[1].first = mid;
+			children[1].count = first + count - mid;
+
+			for (int c = 0; c < 2; c++)
+			{
+				resetBounds(children[c].bmin, children[c].bmax);
+				for (int i = children[c].first; i < children[c].first + children[c].count; i++)
+					growBounds(children[c].bmin, children[c].bmax, items[order[i]].bmin, items[order[i]].bmax);
+
+				nodes.push_back(children[c]);
+			}
+
+			nodes[ni].first = left;
+			nodes[ni].count = 0;
+
+			stack.push_back(left);
+			stack.push_back(left + 1);
+		}
+	}
+	//------------------------------------------------------------------------------------------
+	/// <summary> Segment (origin, invDir) vs node slab test, returns entry t (or -1 if missed) </summary>
+	float slab(const BVHNode &node, const float origin[3], const float invDir[3], float tMax)
+	{
+		float t0 = 0, t1 = tMax;
+
+		for (int j = 0; j < 3; j++)
+		{
+			float tNear = (node.bmin[j] - origin[j]) * invDir[j];
+			float tFar = (node.bmax[j] - origin[j]) * invDir[j];
+			if (tNear > tFar) std::swap(tNear, tFar);
+
+			t0 = std::max(t0, tNear);
+			t1 = std::min(t1, tFar);
+			if (t0 > t1)
+				return -1;
+		}
+		return t0;
+	}
+	//------------------------------------------------------------------------------------------
+	/// <summary> Ordered (nearest child first) traversal, calls leafFunc(item index, tMax&) for leaf items </summary>
+	template <typename F>
+	void traverse(const vector<BVHNode> &nodes, const double p0[3], const double p1[3], double &tMax, F leafFunc)
+	{
+		if (nodes.empty())
+			return;
+
+		float origin[3], invDir[3];
+		for (int j = 0; j < 3; j++)
+		{
+			origin[j] = (float)p0[j];
+			float d = (float)(p1[j] - p0[j]);
+			invDir[j] = (d != 0) ? 1.0f / d : VTK_FLOAT_MAX;
+		}
+
+		// Fixed stack covers any sane tree, deeper (degenerate split) trees continue in overflow
+		int stack[BVH_STACK_SIZE];
+		int top = 0;
+		vector<int> overflow;
+
+		auto push = [&](int index)
+		{
+			if (top < BVH_STACK_SIZE)
+				stack[top++] = index;
+			else
+				overflow.push_back(index);
+		};
+
+		if (slab(nodes[0], origin, invDir, (float)tMax) < 0)
+			return;
+		push(0);
+
+		while (top > 0 || !overflow.empty())
+		{
+			int index;
+			if (!overflow.empty())		// Pushed last (array was full)
+			{
+				index = overflow.back();
+				overflow.pop_back();
+			}
+			else
+				index = stack[--top];
+
+			const BVHNode &node = nodes[index];
+
+			if (node.count > 0)
+			{
+				for (int i = node.first; i < node.first + node.count; i++)
+					leafFunc(i, tMax);
+				continue;
+			}
+
+			float tLeft = slab(nodes[node.first], origin, invDir, (float)tMax);
+			float tRight = slab(nodes[node.first + 1], origin, invDir, (float)tMax);
+
+			// Push farther child first so the nearer one is visited next
+			if (tLeft >= 0 && tRight >= 0)
+			{
+				bool leftFirst = tLeft <= tRight;
+				push(leftFirst ? node.first + 1 : node.first);
+				push(leftFirst ? node.first : node.first + 1);
+			}
+			else if (tLeft >= 0)
+				push(node.first);
+			else if (tRight >= 0)
+				push(node.first + 1);
+		}
+	}
+	//------------------------------------------------------------------------------------------
+	void transformPoint(const double m[16], const double in[3], double out[3])
+	{
+		double w = m[12] * in[0] + m[13] * in[1] + m[14] * in[2] + m[15];
+		for (int j = 0; j < 3; j++)
+			out[j] = (m[4 * j] * in[0] + m[4 * j + 1] * in[1] + m[4 * j + 2] * in[2] + m[4 * j + 3]) / w;
+	}
+}
+
+//----------------------------------------------------------------------------------------------
+MeshBVH::MeshBVH(vtkPolyData *poly)
+{
+	normals = poly->GetPointData()->GetNormals();
+
+	// Triangulate polys as fans
+	vector<vtkIdType> ids;
+	vtkCellArray *polys = poly->GetPolys();
+	vtkIdType npts, *pts;
+
+	ids.reserve(polys->GetNumberOfCells() * 3);
+	for (polys->InitTraversal(); polys->GetNextCell(npts, pts);)
+	{
+		for (vtkIdType k = 1; k + 1 < npts; k++)
+		{
+			ids.push_back(pts[0]);
+			ids.push_back(pts[k]);
+			ids.push_back(pts[k + 1]);
+		}
+	}
+
+	int numTriangles = (int)ids.size() / 3;
+	vtkPoints *points = poly->GetPoints();
+
+	vector<BVHItem> items(numTriangles);
+	for (int i = 0; i < numTriangles; i++)
+	{
+		BVHItem &item = items[i];
+		resetBounds(item.bmin, item.bmax);
+
+		for (int k = 0; k < 3; k++)
+		{
+			double x[3];
+			points->GetPoint(ids[3 * i + k], x);
+			float xf[3] = { (float)x[0], (float)x[1], (float)x[2] };
+			growBounds(item.bmin, item.bmax, xf, xf);
+		}
+		for (int j = 0; j < 3; j++)
+			item.centroid[j] = 0.5f * (item.bmin[j] + item.bmax[j]);
+	}
+
+	vector<int> order;
+	buildBVH(items, 4, nodes, order);
+
+	// Store triangles in BVH order (leaf ranges become contiguous)
+	triangles.resize(numTriangles * 9);
+	pointIds.resize(numTriangles * 3);
+	for (int i = 0; i < numTriangles; i++)
+	{
+		int src = order[i];
+		double v0[3], v1[3], v2[3];
+		points->GetPoint(ids[3 * src], v0);
+		points->GetPoint(ids[3 * src + 1], v1);
+		points->GetPoint(ids[3 * src + 2], v2);
+
+		float *tri = &triangles[9 * i];
+		for (int j = 0; j < 3; j++)
+		{
+			tri[j] = (float)v0[j];
+			tri[3 + j] = (float)(v1[j] - v0[j]);
+			tri[6 + j] = (float)(v2[j] - v0[j]);
+		}
+		for (int k = 0; k < 3; k++)
+			pointIds[3 * i + k] = ids[3 * src + k];
+	}
+}
+//----------------------------------------------------------------------------------------------
+bool MeshBVH::intersect(const double p0[3], const double p1[3], double tMax, double &t, int &triangle, double &u, double &v) const
+{
+	double d[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+	bool hit = false;
+
+	traverse(nodes, p0, p1, tMax, [&](int i, double &tClosest)
+	{
+		// Moller-Trumbore (double sided)
+		const float *tri = &triangles[9 * i];
+		double e1[3] = { tri[3], tri[4], tri[5] };
+		double e2[3] = { tri[6], tri[7], tri[8] };
+
+		double pvec[3];
+		vtkMath::Cross(d, e2, pvec);
+		double det = vtkMath::Dot(e1, pvec);
+		if (fabs(det) < 1e-20)
+			return;
+
+		double invDet = 1.0 / det;
+		double tvec[3] = { p0[0] - tri[0], p0[1] - tri[1], p0[2] - tri[2] };
+
+		double hu = vtkMath::Dot(tvec, pvec) * invDet;
+		if (hu < 0 || hu > 1)
+			return;
+
+		double qvec[3];
+		vtkMath::Cross(tvec, e1, qvec);
+		double hv = vtkMath::Dot(d, qvec) * invDet;
+		if (hv < 0 || hu + hv > 1)
+			return;
+
+		double ht = vtkMath::Dot(e2, qvec) * invDet;
+		if (ht < 0 || ht > tClosest)
+			return;
+
+		tClosest = ht;
+		t = ht; u = hu; v = hv;
+		triangle = i;
+		hit = true;
+	});
+
+	return hit;
+}
+//----------------------------------------------------------------------------------------------
+void MeshBVH::getNormal(int triangle, double u, double v, double normal[3]) const
+{
+	if (normals)
+	{
+		double n0[3], n1[3], n2[3];
+		normals->GetTuple(pointIds[3 * triangle], n0);
+		normals->GetTuple(pointIds[3 * triangle + 1], n1);
+		normals->GetTuple(pointIds[3 * triangle + 2], n2);
+
+		for (int j = 0; j < 3; j++)
+			normal[j] = (1 - u - v) * n0[j] + u * n1[j] + v * n2[j];
+	}
+	else
+	{
+		const float *tri = &triangles[9 * triangle];
+		double e1[3] = { tri[3], tri[4], tri[5] };
+		double e2[3] = { tri[6], tri[7], tri[8] };
+		vtkMath::Cross(e1, e2, normal);
+	}
+	vtkMath::Normalize(normal);
+}
+
+//----------------------------------------------------------------------------------------------
+void SceneBVH::rebuild(aperio *a)
+{
+	vector<Entry> all;
+	vector<BVHItem> items;
+
+	for (auto &mesh : a->meshes)
+	{
+		vtkActor *actor = mesh->actor;
+
+		// Same filter as vtkPicker (visible, pickable, not fully transparent)
+		if (!actor || !actor->GetVisibility() || !actor->GetPickable() || actor->GetProperty()->GetOpacity() <= 0.0)
+			continue;
+
+		Entry entry;
+		entry.mesh = mesh;
+
+		vtkMatrix4x4 *matrix = actor->GetMatrix();	// Includes UserTransform/UserMatrix (explode, hinge)
+		vtkMatrix4x4::DeepCopy(entry.matrix, matrix);
+		vtkMatrix4x4::Invert(entry.matrix, entry.inverse);
+
+		double *bounds = actor->GetBounds();		// World bounds
+		if (!bounds || bounds[0] > bounds[1])
+			continue;
+
+		BVHItem item;
+		for (int j = 0; j < 3; j++)
+		{
+			item.bmin[j] = (float)bounds[2 * j];
+			item.bmax[j] = (float)bounds[2 * j + 1];
+			item.centroid[j] = 0.5f * (item.bmin[j] + item.bmax[j]);
+		}
+
+		all.push_back(entry);
+		items.push_back(item);
+	}
+
+	vector<int> order;
+	buildBVH(items, 2, nodes, order);
+
+	entries.resize(all.size());
+	for (size_t i = 0; i < all.size(); i++)
+		entries[i] = all[order[i]];
+}
+//----------------------------------------------------------------------------------------------
+bool SceneBVH::pick(aperio *a, vtkRenderer *renderer, int x, int y, SceneBVHHit &result)
+{
+	// ---- Rebuild top level if any mesh actor changed (cheap, hundreds of meshes at most)
+	unsigned long mtime = 0;
+	for (auto &mesh : a->meshes)
+	{
+		if (mesh->actor)
+			mtime = std::max(mtime, mesh->actor->GetMTime());
+	}
+
+	if ((int)a->meshes.size() != lastCount || mtime != lastMTime)
+	{
+		rebuild(a);
+		lastCount = (int)a->meshes.size();
+		lastMTime = mtime;
+	}
+
+	// ---- Pick ray (same as vtkPicker): through selection point, from near to far clipping plane
+	vtkCamera *camera = renderer->GetActiveCamera();
+	double focal[4], world[4], p0[3], p1[3];
+
+	camera->GetFocalPoint(focal);
+	focal[3] = 1.0;
+	renderer->SetWorldPoint(focal);
+	renderer->WorldToDisplay();
+	double focalDepth = renderer->GetDisplayPoint()[2];
+
+	auto displayToWorld = [&](double z, double out[3])
+	{
+		renderer->SetDisplayPoint(x, y, z);
+		renderer->DisplayToWorld();
+		renderer->GetWorldPoint(world);
+		for (int j = 0; j < 3; j++)
+			out[j] = world[j] / world[3];
+	};
+
+	displayToWorld(0.0, p0);
+	displayToWorld(1.0, p1);
+
+	// ---- Traverse top level, then hit meshes' triangle BVHs (in their local frame)
+	double tClosest = 1.0;
+	int hitEntry = -1, hitTriangle = -1;
+	double hitU = 0, hitV = 0;
+
+	traverse(nodes, p0, p1, tClosest, [&](int i, double &tMax)
+	{
+		auto mesh = entries[i].mesh.lock();
+		if (!mesh)
+			return;
+
+		double l0[3], l1[3];
+		transformPoint(entries[i].inverse, p0, l0);
+		transformPoint(entries[i].inverse, p1, l1);
+
+		// Affine transforms keep the segment parameter t, so tMax carries across meshes
+		double t, u, v;
+		int triangle;
+		if (mesh->getTriangleBVH()->intersect(l0, l1, tMax, t, triangle, u, v))
+		{
+			tMax = t;
+			hitEntry = i;
+			hitTriangle = triangle;
+			hitU = u;
+			hitV = v;
+		}
+	});
+
+	if (hitEntry < 0)
+	{
+		// Miss: focal plane point, normal pointing at camera (as vtkCellPicker)
+		displayToWorld(focalDepth, result.point);
+
+		double position[3];
+		camera->GetPosition(position);
+		for (int j = 0; j < 3; j++)
+			result.normal[j] = camera->GetParallelProjection() ? position[j] - focal[j] : position[j] - result.point[j];
+		vtkMath::Normalize(result.normal);
+
+		result.hit = false;
+		result.mesh.reset();
+		return false;
+	}
+
+	const Entry &entry = entries[hitEntry];
+	auto mesh = entry.mesh.lock();
+
+	for (int j = 0; j < 3; j++)
+		result.point[j] = p0[j] + tClosest * (p1[j] - p0[j]);
+
+	// Local normal to world (inverse transpose)
+	double n[3];
+	mesh->getTriangleBVH()->getNormal(hitTriangle, hitU, hitV, n);
+	for (int j = 0; j < 3; j++)
+		result.normal[j] = entry.inverse[j] * n[0] + entry.inverse[4 + j] * n[1] + entry.inverse[8 + j] * n[2];
+	vtkMath::Normalize(result.normal);
+
+	result.hit = true;
+	result.mesh = mesh;
+	return true;
+}
+//----------------------------------------------------------------------------------------------
+void SceneBVH::intersectSegment(const vector<shared_ptr<CustomMesh>> &meshes, const double p0[3], const double p1[3],
+	vector<SceneBVHHit> &hits)
+{
+	hits.assign(meshes.size(), SceneBVHHit());
+
+	// ---- Top level over the meshes' local bounds (rest pose, same geometry their triangle BVHs use)
+	vector<BVHItem> items(meshes.size());
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		double *bounds = meshes[i]->accelSource->GetBounds();
+
+		BVHItem &item = items[i];
+		for (int j = 0; j < 3; j++)
+		{
+			item.bmin[j] = (float)bounds[2 * j];
+			item.bmax[j] = (float)bounds[2 * j + 1];
+			item.centroid[j] = 0.5f * (item.bmin[j] + item.bmax[j]);
+		}
+	}
+
+	vector<BVHNode> topNodes;
+	vector<int> order;
+	buildBVH(items, 1, topNodes, order);
+
+	// ---- Every mesh keeps its own closest hit, so the segment is never shortened (tMax stays 1)
+	double tMax = 1.0;
+	traverse(topNodes, p0, p1, tMax, [&](int i, double &)
+	{
+		int m = order[i];
+		auto bvh = meshes[m]->getTriangleBVH();
+
+		double t, u, v;
+		int triangle;
+		if (!bvh->intersect(p0, p1, 1.0, t, triangle, u, v))
+			return;
+
+		SceneBVHHit &hit = hits[m];
+		for (int j = 0; j < 3; j++)
+			hit.point[j] = p0[j] + t * (p1[j] - p0[j]);
+
+		bvh->getNormal(triangle, u, v, hit.normal);
+		vtkMath::Normalize(hit.normal);
+
+		hit.hit = true;
+		hit.mesh = meshes[m];
+	});
+}
@@ -0,0 +1,112 @@
+// ***********************************************************************
+// Scene BVH - Two-level bounding volume hierarchy used for mouse picking
+//			   (top level over meshes' world bounds, bottom level over
+//			   each mesh's triangles in its local frame)
+// ***********************************************************************
+
+#ifndef SCENE_BVH_H
+#define SCENE_BVH_H
+
+class aperio;	// Forward declarations
+class CustomMesh;
+
+//-----------------------------------------------------------------------------------------
+/// <summary> BVH node (32 bytes). Leaf: items [first, first + count), Inner: children first, first + 1 (count = 0)
+/// </summary>
+struct BVHNode
+{
+	float bmin[3];
+	float bmax[3];
+	int first;
+	int count;
+};
+
+//-----------------------------------------------------------------------------------------
+/// <summary> MeshBVH, triangle BVH of one mesh (local/model space, built once from its polydata)
+/// </summary>
+class MeshBVH
+{
+public:
+	/// <summary> Builds BVH over polys (triangulated as fans) of the polydata </summary>
+	MeshBVH(vtkPolyData *poly);
+
+	//--------------------------------------------------------------------------------------------------
+	/// <summary> Closest intersection of segment p0 + t * (p1 - p0), t in [0, tMax]
+	/// </summary>
+	/// <returns> Whether a triangle was hit (t, triangle and barycentrics u, v are returned) </returns>
+	bool intersect(const double p0[3], const double p1[3], double tMax, double &t, int &triangle, double &u, double &v) const;
+
+	//--------------------------------------------------------------------------------------------------
+	/// <summary> Surface normal (interpolated point normals if available, otherwise face normal) at a hit
+	/// </summary>
+	void getNormal(int triangle, double u, double v, double normal[3]) const;
+
+	int getNumberOfTriangles() const { return (int)pointIds.size() / 3; }
+
+private:
+	vector<BVHNode> nodes;
+
+	/// <summary> Per triangle (in BVH order): v0, edge1 = v1 - v0, edge2 = v2 - v0 (9 floats) </summary>
+	vector<float> triangles;
+	/// <summary> Per triangle (in BVH order): its 3 point ids (to interpolate normals) </summary>
+	vector<vtkIdType> pointIds;
+
+	vtkSmartPointer<vtkDataArray> normals;
+};
+
+//-----------------------------------------------------------------------------------------
+/// <summary> Result of a SceneBVH pick
+/// </summary>
+struct SceneBVHHit
+{
+	bool hit = false;
+	double point[3];
+	double normal[3];
+	weak_ptr<CustomMesh> mesh;
+};
+
+//-----------------------------------------------------------------------------------------
+/// <summary> SceneBVH, top level BVH over all meshes (world bounds, follows actor UserTransforms)
+/// Mesh triangle BVHs are built on first use (CustomMesh::getTriangleBVH)
+/// </summary>
+class SceneBVH
+{
+public:
+	//--------------------------------------------------------------------------------------------------
+	/// <summary> Picks visible, pickable meshes at display position x, y (same ray as vtkCellPicker).
+	/// On a miss, point/normal are set like vtkCellPicker does (focal plane point, normal towards camera)
+	/// </summary>
+	/// <returns> Whether a mesh was hit </returns>
+	bool pick(aperio *a, vtkRenderer *renderer, int x, int y, SceneBVHHit &result);
+
+	//--------------------------------------------------------------------------------------------------
+	/// <summary> Closest hit of segment p0-p1 with each mesh, in one traversal of a top level built over the
+	/// meshes' own (rest pose, no actor transform) bounds. hits[i] is the result for meshes[i]
+	/// </summary>
+	static void intersectSegment(const vector<shared_ptr<CustomMesh>> &meshes, const double p0[3], const double p1[3],
+		vector<SceneBVHHit> &hits);
+
+	//--------------------------------------------------------------------------------------------------
+	/// <summary> Forces top level to be rebuilt on next pick
+	/// </summary>
+	void invalidate() { lastCount = -1; }
+
+private:
+	/// <summary> Top level item (a mesh with its world bounds and actor matrices) </summary>
+	struct Entry
+	{
+		weak_ptr<CustomMesh> mesh;
+		double matrix[16];
+		double inverse[16];
+	};
+
+	vector<Entry> entries;
+	vector<BVHNode> nodes;
+
+	// Rebuild when the mesh count or any mesh actor (transform, visibility, opacity) changes
+	int lastCount = -1;
+	unsigned long lastMTime = 0;
+
+	void rebuild(aperio *a);
+};
+#endif
@@ -0,0 +1,308 @@
+#include "stdafx.h"
+#include "ToolPath.h"
+
+#include "MySuperquadricSource.h"
+
+#include <algorithm>
+
+//-------------------------------------------------------------------------------------------
+void ToolPath::setLine(const double start[3], const double end[3], const double normal[3])
+{
+	closed = false;
+	this->start = 0;
+
+	std::copy(start, start + 3, p0);
+	std::copy(end, end + 3, p1);
+
+	std::copy(normal, normal + 3, lineNormal);
+	vtkMath::Normalize(lineNormal);
+
+	length = sqrt(vtkMath::Distance2BetweenPoints(p0, p1));
+
+	// No binormal: rod normals are parallel to the line
+	binormal[0] = binormal[1] = binormal[2] = 0;
+
+	// Line is already parameterized by arc length
+	arcToCurve.clear();
+	curveToArc.clear();
+}
+//-------------------------------------------------------------------------------------------
+void ToolPath::setRing(vtkMatrix4x4 *placement, double roundness, bool inverse)
+{
+	closed = true;
+	start = 0;
+
+	this->roundness = roundness;
+	reversed = inverse;
+
+	vtkMatrix4x4::DeepCopy(matrix, placement);
+	vtkMatrix4x4::Invert(matrix, this->inverse);
+
+	// Normals transform with the inverse transpose
+	for (int r = 0; r < 3; r++)
+		for (int c = 0; c < 3; c++)
+			normalMatrix[r * 3 + c] = this->inverse[c * 4 + r];
+
+	buildArcLength();
+
+	// Ring is planar, normal x tangent is its (signed) axis
+	double pt[3], nm[3], next[3], tmp[3];
+	evaluateCurve(0, pt, nm);
+	evaluateCurve(1.0 / ARC_SAMPLES, next, tmp);
+
+	double tangent[3] = { next[0] - pt[0], next[1] - pt[1], next[2] - pt[2] };
+	vtkMath::Cross(nm, tangent, binormal);
+	vtkMath::Normalize(binormal);
+}
+//-------------------------------------------------------------------------------------------
+void ToolPath::evaluateCurve(double u, double point[3], double normal[3]) const
+{
+	const double pi = vtkMath::Pi();
+	double t = reversed ? pi - 2.0 * pi * u : -pi + 2.0 * pi * u;
+
+	double dims[3] = { 0.5, 0.5, 0.5 };
+	double pt[3], nm[3];
+	evalSuperquadric(t, 0.0, 0.0, 0.0, roundness, 1.0, dims, 0.0, pt, nm);
+
+	// Axis of symmetry is Y (evalsuperquad gives it in Z, so swap Y and Z), same as the ring source
+	double local[4] = { -pt[0], pt[2], pt[1], 1.0 };
+	double localNormal[3] = { -nm[0], nm[2], nm[1] };
+
+	double world[4];
+	vtkMatrix4x4::MultiplyPoint(matrix, local, world);
+	std::copy(world, world + 3, point);
+
+	for (int r = 0; r < 3; r++)
+	{
+		normal[r] = normalMatrix[r * 3 + 0] * localNormal[0] +
+			normalMatrix[r * 3 + 1] * localNormal[1] +
+			normalMatrix[r * 3 + 2] * localNormal[2];
+	}
+	vtkMath::Normalize(normal);
+}
+//-------------------------------------------------------------------------------------------
+void ToolPath::buildArcLength()
+{
+	// Cumulative (world) length at uniform curve parameters
+	curveToArc.resize(ARC_SAMPLES + 1);
+	curveToArc[0] = 0;
+
+	double prev[3], pt[3], nm[3];
+	evaluateCurve(0, prev, nm);
+
+	for (int i = 1; i <= ARC_SAMPLES; i++)
+	{
+		evaluateCurve(i / (double)ARC_SAMPLES, pt, nm);
+		curveToArc[i] = curveToArc[i - 1] + sqrt(vtkMath::Distance2BetweenPoints(prev, pt));
+		std::copy(pt, pt + 3, prev);
+	}
+
+	length = curveToArc[ARC_SAMPLES];
+
+	if (length > 0)
+	{
+		for (auto &arc : curveToArc)
+			arc /= length;
+	}
+
+	// Invert: curve parameter at uniform arc lengths (so evaluate is a table lookup)
+	arcToCurve.resize(ARC_SAMPLES + 1);
+
+	int i = 0;
+	for (int j = 0; j <= ARC_SAMPLES; j++)
+	{
+		double target = j / (double)ARC_SAMPLES;
+
+		while (i < ARC_SAMPLES - 1 && curveToArc[i + 1] < target)
+			i++;
+
+		double span = curveToArc[i + 1] - curveToArc[i];
+		double f = span > 0 ? (target - curveToArc[i]) / span : 0;
+		f = std::min(1.0, std::max(0.0, f));
+
+		arcToCurve[j] = (i + f) / ARC_SAMPLES;
+	}
+}
+//-------------------------------------------------------------------------------------------
+void ToolPath::evaluate(double s, double point[3], double normal[3]) const
+{
+	if (!closed)
+	{
+		s = std::min(1.0, std::max(0.0, s));
+
+		for (int j = 0; j < 3; j++)
+			point[j] = p0[j] + s * (p1[j] - p0[j]);
+		std::copy(lineNormal, lineNormal + 3, normal);
+		return;
+	}
+
+	// Wrap around (start offset)
+	s = s + start;
+	s = s - floor(s);
+
+	double x = s * ARC_SAMPLES;
+	int i = std::min((int)x, ARC_SAMPLES - 1);
+	double f = x - i;
+
+	double u = arcToCurve[i] + f * (arcToCurve[i + 1] - arcToCurve[i]);
+	evaluateCurve(u, point, normal);
+}
+//-------------------------------------------------------------------------------------------
+double ToolPath::closestParameter(const double p[3]) const
+{
+	if (!closed)
+	{
+		double d[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+		double v[3] = { p[0] - p0[0], p[1] - p0[1], p[2] - p0[2] };
+
+		double dd = vtkMath::Dot(d, d);
+		if (dd <= 0)
+			return 0;
+
+		return std::min(1.0, std::max(0.0, vtkMath::Dot(v, d) / dd));
+	}
+
+	// Ring: into local frame (ring in XZ plane), then radial projection onto the superellipse
+	// x = 0.5 * sf(t, e), z = 0.5 * cf(t, e)  =>  sin(t) ~ sgn(x)|x|^(1/e), cos(t) ~ sgn(z)|z|^(1/e)
+	double world[4] = { p[0], p[1], p[2], 1.0 };
+	double local[4];
+	vtkMatrix4x4::MultiplyPoint(inverse, world, local);
+
+	double x = local[0];
+	double z = local[2];
+
+	double m = std::max(fabs(x), fabs(z));
+	if (m <= 0)
+		return 0;
+
+	double e = std::max(roundness, 0.01);
+	double sx = (x < 0 ? -1.0 : 1.0) * pow(fabs(x) / m, 1.0 / e);
+	double sz = (z < 0 ? -1.0 : 1.0) * pow(fabs(z) / m, 1.0 / e);
+
+	const double pi = vtkMath::Pi();
+	double t = atan2(sx, sz);
+	double u = reversed ? (pi - t) / (2.0 * pi) : (t + pi) / (2.0 * pi);
+	u = u - floor(u);
+
+	// Curve parameter to arc length, relative to start
+	double xu = u * ARC_SAMPLES;
+	int i = std::min((int)xu, ARC_SAMPLES - 1);
+	double f = xu - i;
+	double s = curveToArc[i] + f * (curveToArc[i + 1] - curveToArc[i]) - start;
+
+	return s - floor(s);
+}
+//-------------------------------------------------------------------------------------------
+void ToolPath::setStart(double s)
+{
+	if (!closed)
+		return;
+
+	start = start + s;
+	start = start - floor(start);
+}
+//-------------------------------------------------------------------------------------------
+void ToolPath::getBinormal(double binormal[3]) const
+{
+	std::copy(this->binormal, this->binormal + 3, binormal);
+}
+//-------------------------------------------------------------------------------------------
+void ToolPath::getTangent(double s, double tangent[3]) const
+{
+	double a[3], b[3], nm[3];
+
+	if (!closed)
+	{
+		std::copy(p0, p0 + 3, a);
+		std::copy(p1, p1 + 3, b);
+	}
+	else	// One arc length sample ahead
+	{
+		evaluate(s, a, nm);
+		evaluate(s + 1.0 / ARC_SAMPLES, b, nm);
+	}
+
+	for (int j = 0; j < 3; j++)
+		tangent[j] = b[j] - a[j];
+	vtkMath::Normalize(tangent);
+}
+//-------------------------------------------------------------------------------------------
+int ToolPath::intersectOBB(const double corner[3], const double axes[3][3], const double extents[3], double center[3]) const
+{
+	// Point in box coordinates (distance along each axis from the corner)
+	auto toBox = [&](const double p[3], double q[3])
+	{
+		double d[3] = { p[0] - corner[0], p[1] - corner[1], p[2] - corner[2] };
+		for (int j = 0; j < 3; j++)
+			q[j] = vtkMath::Dot(d, axes[j]);
+	};
+
+	int crossings = 0;
+	center[0] = center[1] = center[2] = 0;
+
+	int segments = closed ? ARC_SAMPLES : 1;	// A line is a single segment
+
+	double a[3], qa[3], nm[3];
+	evaluate(0, a, nm);
+	toBox(a, qa);
+
+	for (int i = 1; i <= segments; i++)
+	{
+		double b[3], qb[3];
+		evaluate(i / (double)segments, b, nm);
+		toBox(b, qb);
+
+		// Liang-Barsky clip of segment qa-qb against [0, extents]
+		double t0 = 0, t1 = 1;
+		bool inside = true;
+
+		for (int j = 0; j < 3 && inside; j++)
+		{
+			double d = qb[j] - qa[j];
+
+			if (fabs(d) < 1e-12)
+			{
+				if (qa[j] < 0 || qa[j] > extents[j])
+					inside = false;
+				continue;
+			}
+
+			double tNear = (0 - qa[j]) / d;
+			double tFar = (extents[j] - qa[j]) / d;
+			if (tNear > tFar)
+				std::swap(tNear, tFar);
+
+			t0 = std::max(t0, tNear);
+			t1 = std::min(t1, tFar);
+			if (t0 > t1)
+				inside = false;
+		}
+
+		if (inside)
+		{
+			// Entering (clip starts inside the segment) and/or leaving (clip ends inside it)
+			if (t0 > 0)
+			{
+				for (int j = 0; j < 3; j++)
+					center[j] += a[j] + t0 * (b[j] - a[j]);
+				crossings++;
+			}
+			if (t1 < 1)
+			{
+				for (int j = 0; j < 3; j++)
+					center[j] += a[j] + t1 * (b[j] - a[j]);
+				crossings++;
+			}
+		}
+
+		std::copy(b, b + 3, a);
+		std::copy(qb, qb + 3, qa);
+	}
+
+	if (crossings > 0)
+	{
+		for (int j = 0; j < 3; j++)
+			center[j] /= crossings;
+	}
+	return crossings;
+}
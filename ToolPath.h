@@ -0,0 +1,92 @@
+// ***********************************************************************
+// Tool Path - Analytic path of a ROD (line segment) or RING (superquadric
+//			   ring) tool, parameterized by arc length (used by explode)
+// ***********************************************************************
+
+#ifndef TOOL_PATH_H
+#define TOOL_PATH_H
+
+//-----------------------------------------------------------------------------------------
+/// <summary> ToolPath, parametric curve s in [0, 1] (normalized arc length). Open paths (line)
+/// clamp s, closed paths (ring) wrap s and can have their start moved (setStart)
+/// </summary>
+class ToolPath
+{
+public:
+	//--------------------------------------------------------------------------------------------------
+	/// <summary> Straight line from start to end (ROD), normal is constant along it
+	/// </summary>
+	void setLine(const double start[3], const double end[3], const double normal[3]);
+
+	//--------------------------------------------------------------------------------------------------
+	/// <summary> Closed ring, phi = 0 curve of a MySuperquadricSource (size 0.5, axis of symmetry Y) placed by
+	/// matrix (RING). Roundness is the source's theta roundness, inverse runs the ring backwards
+	/// </summary>
+	void setRing(vtkMatrix4x4 *placement, double roundness, bool inverse);
+
+	bool isClosed() const { return closed; }
+	double getLength() const { return length; }
+
+	//--------------------------------------------------------------------------------------------------
+	/// <summary> Point and unit normal at arc length parameter s (O(1))
+	/// </summary>
+	void evaluate(double s, double point[3], double normal[3]) const;
+
+	//--------------------------------------------------------------------------------------------------
+	/// <summary> Arc length parameter of the path point closest to p (closed form: projection on the
+	/// line, radial projection on the ring in its local frame)
+	/// </summary>
+	double closestParameter(const double p[3]) const;
+
+	//--------------------------------------------------------------------------------------------------
+	/// <summary> Moves start of a closed path to parameter s (s becomes 0, nothing is resampled)
+	/// </summary>
+	void setStart(double s);
+
+	//--------------------------------------------------------------------------------------------------
+	/// <summary> Unit normal x tangent (ring: axis pieces rotate around while sliding). Rings only,
+	/// zero for lines (a rod's normal runs along it)
+	/// </summary>
+	void getBinormal(double binormal[3]) const;
+
+	//--------------------------------------------------------------------------------------------------
+	/// <summary> Unit tangent (direction of increasing s) at arc length parameter s
+	/// </summary>
+	void getTangent(double s, double tangent[3]) const;
+
+	//--------------------------------------------------------------------------------------------------
+	/// <summary> Crossings of the path with an oriented box (corner + sum of axes[i] * [0, extents[i]], unit axes).
+	/// Each arc length segment of the path is clipped against the box slabs, no allocation
+	/// </summary>
+	/// <returns> Number of crossings (their average point is returned in center) </returns>
+	int intersectOBB(const double corner[3], const double axes[3][3], const double extents[3], double center[3]) const;
+
+private:
+	static const int ARC_SAMPLES = 360;
+
+	bool closed = false;
+	double length = 0;
+	double start = 0;			// Arc length offset of s = 0 (closed paths)
+
+	// Line
+	double p0[3], p1[3];
+	double lineNormal[3];
+
+	// Ring (local curve x = 0.5 * sf(t), z = 0.5 * cf(t), t = -pi + 2 pi u, placed by matrix)
+	double matrix[16];
+	double inverse[16];
+	double normalMatrix[9];		// Inverse transpose of upper 3x3 (for normals)
+	double roundness = 1;
+	bool reversed = false;
+
+	/// <summary> Curve parameter u at uniform arc lengths (ARC_SAMPLES + 1 entries) </summary>
+	vector<double> arcToCurve;
+	/// <summary> Arc length at uniform curve parameters (ARC_SAMPLES + 1 entries) </summary>
+	vector<double> curveToArc;
+
+	double binormal[3];			// Rings only
+
+	void evaluateCurve(double u, double point[3], double normal[3]) const;
+	void buildArcLength();
+};
+#endif
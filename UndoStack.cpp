@@ -0,0 +1,338 @@
+#include "stdafx.h"
+#include "UndoStack.h"
+
+#include "aperio.h"
+#include "Utility.h"
+
+#include <algorithm>
+
+//-------------------------------------------------------------------------------------------
+/// <summary> A mesh's path state (set by createPath and the explode sliders) </summary>
+struct MeshPathState
+{
+	shared_ptr<CustomMesh> mesh;
+	weak_ptr<MyElem> elem;
+
+	double path_order, path_param;
+	float path_angle, path_leafangle;
+	ToolType pathType;
+	vtkVector3f path_initpt_exact, lastBitangent;
+
+	double pathMatrix[16];
+	bool pathMoved;
+};
+
+//-------------------------------------------------------------------------------------------
+/// <summary> Elem's placement parameters at plant time (see PlaceCommand::capture), with the path
+/// state of the meshes on its path </summary>
+struct ElemState
+{
+	bool planted = true;	// False: elem wasn't planted yet (only meshes are valid)
+
+	MyPoint p1, p2;
+	vtkVector3f scale;
+	vtkVector3f right, up, forward;
+	float spinAngle, spinFlipped, tilt;
+	bool inverse;
+
+	double placement[16];
+	shared_ptr<ToolPath> path;
+
+	vector<MeshPathState> meshes;
+};
+
+//-------------------------------------------------------------------------------------------
+void UndoStack::push(shared_ptr<UndoCommand> command)
+{
+	if (busy || !command)
+		return;
+
+	done.push_back(command);
+	undone.clear();
+
+	if (done.size() > MAX_COMMANDS)
+		done.pop_front();
+}
+//-------------------------------------------------------------------------------------------
+bool UndoStack::undo(aperio *a)
+{
+	if (done.empty())
+		return false;
+
+	auto command = done.back();
+	done.pop_back();
+
+	busy = true;
+	command->undo(a);
+	busy = false;
+
+	undone.push_back(command);
+
+	cout << "Undo " << command->getName() << "\n";
+	return true;
+}
+//-------------------------------------------------------------------------------------------
+bool UndoStack::redo(aperio *a)
+{
+	if (undone.empty())
+		return false;
+
+	auto command = undone.back();
+	undone.pop_back();
+
+	busy = true;
+	command->redo(a);
+	busy = false;
+
+	done.push_back(command);
+
+	cout << "Redo " << command->getName() << "\n";
+	return true;
+}
+//-------------------------------------------------------------------------------------------
+void UndoStack::clear()
+{
+	done.clear();
+	undone.clear();
+}
+
+//-------------------------------------------------------------------------------------------
+void CutCommand::undo(aperio *a)
+{
+	// Pieces leave the scene (kept alive here for redo), parents come back from history
+	for (auto &piece : pieces)
+		Utility::removeMesh(a, piece);
+
+	for (auto &parent : parents)
+		a->transferToMeshes(parent);
+
+	if (elem)
+		a->addElem(elem);
+
+	a->clearSelectedMeshes();
+	for (auto &parent : parents)
+		a->addSelectedMesh(parent);
+}
+//-------------------------------------------------------------------------------------------
+void CutCommand::redo(aperio *a)
+{
+	for (auto &parent : parents)
+		a->transferToParentMeshes(parent);
+
+	for (auto &piece : pieces)
+		a->transferToMeshes(piece);
+
+	if (elem)
+		a->removeElem(elem);
+
+	a->clearSelectedMeshes();
+	for (auto &piece : pieces)
+		a->addSelectedMesh(piece);
+}
+
+//-------------------------------------------------------------------------------------------
+vector<MeshPathState> PlaceCommand::captureMeshes(aperio *a, const MyElem &elem)
+{
+	vector<MeshPathState> states;
+
+	for (auto &mesh : a->meshes)
+	{
+		bool selected = std::any_of(a->selectedMeshes.begin(), a->selectedMeshes.end(),
+			[&](const weak_ptr<CustomMesh> &selectedMesh) { return selectedMesh.lock() == mesh; });
+
+		if (!selected && mesh->elem.lock().get() != &elem)
+			continue;
+
+		MeshPathState state;
+		state.mesh = mesh;
+		state.elem = mesh->elem;
+		state.path_order = mesh->path_order;
+		state.path_param = mesh->path_param;
+		state.path_angle = mesh->path_angle;
+		state.path_leafangle = mesh->path_leafangle;
+		state.pathType = mesh->pathType;
+		state.path_initpt_exact = mesh->path_initpt_exact;
+		state.lastBitangent = mesh->lastBitangent;
+		std::copy(mesh->pathMatrix, mesh->pathMatrix + 16, state.pathMatrix);
+		state.pathMoved = mesh->pathMoved;
+
+		states.push_back(state);
+	}
+	return states;
+}
+//-------------------------------------------------------------------------------------------
+void PlaceCommand::restoreMeshes(aperio *a, const ElemState &state)
+{
+	for (auto &saved : state.meshes)
+	{
+		auto &mesh = saved.mesh;
+
+		mesh->elem = saved.elem;
+		mesh->path_order = saved.path_order;
+		mesh->path_param = saved.path_param;
+		mesh->path_angle = saved.path_angle;
+		mesh->path_leafangle = saved.path_leafangle;
+		mesh->pathType = saved.pathType;
+		mesh->path_initpt_exact = saved.path_initpt_exact;
+		mesh->lastBitangent = saved.lastBitangent;
+		std::copy(saved.pathMatrix, saved.pathMatrix + 16, mesh->pathMatrix);
+		mesh->pathMoved = saved.pathMoved;
+
+		a->applyExplodeTransform(mesh.get());
+	}
+	a->explodePiecesDirty = true;
+}
+//-------------------------------------------------------------------------------------------
+shared_ptr<ElemState> PlaceCommand::captureBefore(aperio *a, const MyElem &elem)
+{
+	auto state = elem.plantedState ? make_shared<ElemState>(*elem.plantedState) : make_shared<ElemState>();
+
+	state->planted = elem.plantedState != nullptr;
+	state->meshes = captureMeshes(a, elem);
+
+	return state;
+}
+//-------------------------------------------------------------------------------------------
+shared_ptr<ElemState> PlaceCommand::capture(aperio *a, const MyElem &elem)
+{
+	auto state = make_shared<ElemState>();
+
+	state->p1 = elem.p1;
+	state->p2 = elem.p2;
+	state->scale = elem.scale;
+	state->right = elem.right;
+	state->up = elem.up;
+	state->forward = elem.forward;
+	state->spinAngle = elem.spinAngle;
+	state->spinFlipped = elem.spinFlipped;
+	state->tilt = elem.tilt;
+	state->inverse = elem.inverse;
+
+	if (elem.placement)
+		vtkMatrix4x4::DeepCopy(state->placement, elem.placement->GetMatrix());
+	else
+		vtkMatrix4x4::Identity(state->placement);
+
+	state->path = elem.path;
+	state->meshes = captureMeshes(a, elem);
+
+	return state;
+}
+//-------------------------------------------------------------------------------------------
+void PlaceCommand::apply(aperio *a, const ElemState &state)
+{
+	elem->p1 = state.p1;
+	elem->p2 = state.p2;
+	elem->scale = state.scale;
+	elem->right = state.right;
+	elem->up = state.up;
+	elem->forward = state.forward;
+	elem->spinAngle = state.spinAngle;
+	elem->spinFlipped = state.spinFlipped;
+	elem->tilt = state.tilt;
+	elem->inverse = state.inverse;
+
+	if (!elem->placement)
+		elem->placement = vtkSmartPointer<vtkTransform>::New();
+
+	elem->placement->SetMatrix(state.placement);
+	a->placeElem(elem, elem->placement);
+
+	// Paths are never modified after createPath, so the old one is simply shared again
+	elem->path = state.path;
+}
+//-------------------------------------------------------------------------------------------
+void PlaceCommand::undo(aperio *a)
+{
+	if (before->planted)
+		apply(a, *before);
+	else
+		a->removeElem(elem);	// Elem was created by this plant
+
+	// Meshes go back to their previous path (and position on it)
+	restoreMeshes(a, *before);
+
+	elem->plantedState = before->planted ? before : nullptr;
+}
+//-------------------------------------------------------------------------------------------
+void PlaceCommand::redo(aperio *a)
+{
+	if (!before->planted)
+		a->addElem(elem);
+
+	apply(a, *after);
+	restoreMeshes(a, *after);
+
+	elem->plantedState = after;
+}
+
+//-------------------------------------------------------------------------------------------
+void ExplodeCommand::Entry::capture(int which)
+{
+	path_param[which] = mesh->path_param;
+	path_angle[which] = mesh->path_angle;
+	path_leafangle[which] = mesh->path_leafangle;
+	hingeAngle[which] = mesh->hingeAngle;
+	lastBitangent[which] = mesh->lastBitangent;
+	std::copy(mesh->pathMatrix, mesh->pathMatrix + 16, pathMatrix[which]);
+	pathMoved[which] = mesh->pathMoved;
+}
+//-------------------------------------------------------------------------------------------
+bool ExplodeCommand::Entry::changed() const
+{
+	return path_param[0] != path_param[1] || path_leafangle[0] != path_leafangle[1] || hingeAngle[0] != hingeAngle[1] ||
+		pathMoved[0] != pathMoved[1] || !std::equal(pathMatrix[0], pathMatrix[0] + 16, pathMatrix[1]);
+}
+//-------------------------------------------------------------------------------------------
+void ExplodeCommand::apply(aperio *a, int which)
+{
+	for (auto &entry : entries)
+	{
+		auto &mesh = entry.mesh;
+
+		mesh->path_param = entry.path_param[which];
+		mesh->path_angle = entry.path_angle[which];
+		mesh->path_leafangle = entry.path_leafangle[which];
+		mesh->hingeAngle = entry.hingeAngle[which];
+		mesh->lastBitangent = entry.lastBitangent[which];
+		std::copy(entry.pathMatrix[which], entry.pathMatrix[which] + 16, mesh->pathMatrix);
+		mesh->pathMoved = entry.pathMoved[which];
+
+		a->applyExplodeTransform(mesh.get());
+	}
+
+	// Sliders follow without re-running their slots (which would move the current selection)
+	for (auto &slider : sliders)
+	{
+		slider.slider->blockSignals(true);
+		slider.slider->setValue(slider.value[which]);
+		slider.slider->blockSignals(false);
+	}
+}
+//-------------------------------------------------------------------------------------------
+void ExplodeCommand::undo(aperio *a)
+{
+	apply(a, 0);
+}
+//-------------------------------------------------------------------------------------------
+void ExplodeCommand::redo(aperio *a)
+{
+	apply(a, 1);
+}
+
+//-------------------------------------------------------------------------------------------
+void OpacityCommand::apply(aperio *a, int which)
+{
+	for (auto &entry : entries)
+		Utility::setMeshOpacitySeparate(a, entry.mesh, entry.opacity[which], entry.actorOpacity[which]);
+}
+//-------------------------------------------------------------------------------------------
+void OpacityCommand::undo(aperio *a)
+{
+	apply(a, 0);
+}
+//-------------------------------------------------------------------------------------------
+void OpacityCommand::redo(aperio *a)
+{
+	apply(a, 1);
+}
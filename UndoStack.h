@@ -0,0 +1,186 @@
+// ***********************************************************************
+// Undo Stack - Command based undo/redo of cuts, tool placement, explode
+//				and opacity changes. Commands keep references to the meshes,
+//				elems and paths they change (no geometry is copied)
+// ***********************************************************************
+
+#ifndef UNDO_STACK_H
+#define UNDO_STACK_H
+
+#include <deque>
+
+class aperio;	// Forward declarations
+class CustomMesh;
+class MyElem;
+class QSlider;
+struct ElemState;
+struct MeshPathState;
+
+//-----------------------------------------------------------------------------------------
+/// <summary> UndoCommand, a change that has already been done (redo does it again)
+/// </summary>
+class UndoCommand
+{
+public:
+	virtual ~UndoCommand() {}
+
+	virtual void undo(aperio *a) = 0;
+	virtual void redo(aperio *a) = 0;
+	virtual string getName() const = 0;
+};
+
+//-----------------------------------------------------------------------------------------
+/// <summary> UndoStack, done and undone commands (a new command clears the undone ones)
+/// </summary>
+class UndoStack
+{
+public:
+	/// <summary> Oldest commands are dropped past this (releasing what they reference) </summary>
+	static const int MAX_COMMANDS = 100;
+
+	//--------------------------------------------------------------------------------------------------
+	/// <summary> Adds an already done command (ignored while undoing/redoing)
+	/// </summary>
+	void push(shared_ptr<UndoCommand> command);
+
+	bool undo(aperio *a);
+	bool redo(aperio *a);
+
+	bool canUndo() const { return !done.empty(); }
+	bool canRedo() const { return !undone.empty(); }
+
+	/// <summary> Whether a command is being undone/redone (changes it makes are not recorded) </summary>
+	bool isBusy() const { return busy; }
+
+	void clear();
+
+private:
+	std::deque<shared_ptr<UndoCommand> > done;
+	vector<shared_ptr<UndoCommand> > undone;
+	bool busy = false;
+};
+
+//-----------------------------------------------------------------------------------------
+/// <summary> Cut of parents into pieces by elem (undo brings parents back from history, no CSG)
+/// </summary>
+class CutCommand : public UndoCommand
+{
+public:
+	CutCommand(vector<shared_ptr<CustomMesh> > parents, vector<shared_ptr<CustomMesh> > pieces, shared_ptr<MyElem> elem)
+		: parents(parents), pieces(pieces), elem(elem) {}
+
+	virtual void undo(aperio *a) override;
+	virtual void redo(aperio *a) override;
+	virtual string getName() const override { return "Cut"; }
+
+private:
+	vector<shared_ptr<CustomMesh> > parents;
+	vector<shared_ptr<CustomMesh> > pieces;
+	shared_ptr<MyElem> elem;
+};
+
+//-----------------------------------------------------------------------------------------
+/// <summary> Plant (or pick up and re-plant) of an elem, and the path state of the meshes it moves.
+/// Before state not planted: elem was created by this plant
+/// </summary>
+class PlaceCommand : public UndoCommand
+{
+public:
+	PlaceCommand(shared_ptr<MyElem> elem, shared_ptr<ElemState> before, shared_ptr<ElemState> after)
+		: elem(elem), before(before), after(after) {}
+
+	//--------------------------------------------------------------------------------------------------
+	/// <summary> Snapshot of elem's placement parameters, placement and path (path is shared, not copied),
+	/// and of the meshes on its path (linked to elem or selected)
+	/// </summary>
+	static shared_ptr<ElemState> capture(aperio *a, const MyElem &elem);
+
+	//--------------------------------------------------------------------------------------------------
+	/// <summary> Before state of a plant, taken before createPath: elem's last planted state (not planted
+	/// if none) with the meshes' current path state
+	/// </summary>
+	static shared_ptr<ElemState> captureBefore(aperio *a, const MyElem &elem);
+
+	virtual void undo(aperio *a) override;
+	virtual void redo(aperio *a) override;
+	virtual string getName() const override { return "Place"; }
+
+private:
+	shared_ptr<MyElem> elem;
+	shared_ptr<ElemState> before;
+	shared_ptr<ElemState> after;
+
+	void apply(aperio *a, const ElemState &state);
+
+	static vector<MeshPathState> captureMeshes(aperio *a, const MyElem &elem);
+	/// <summary> Path state back on the meshes, explode transforms re-applied </summary>
+	static void restoreMeshes(aperio *a, const ElemState &state);
+};
+
+//-----------------------------------------------------------------------------------------
+/// <summary> Explode/leaf/hinge change of the meshes it moved (their path position and transform are
+/// restored directly, sliders are only moved back to match)
+/// </summary>
+class ExplodeCommand : public UndoCommand
+{
+public:
+	struct Entry
+	{
+		shared_ptr<CustomMesh> mesh;
+		double path_param[2];		// Before, after
+		float path_angle[2];
+		float path_leafangle[2];
+		float hingeAngle[2];
+		vtkVector3f lastBitangent[2];
+		double pathMatrix[2][16];
+		bool pathMoved[2];
+
+		/// <summary> Copies mesh's current state into before (0) or after (1) </summary>
+		void capture(int which);
+		bool changed() const;
+	};
+
+	struct SliderValue
+	{
+		QSlider *slider;
+		int value[2];				// Before, after
+	};
+
+	ExplodeCommand(vector<Entry> entries, vector<SliderValue> sliders) : entries(entries), sliders(sliders) {}
+
+	virtual void undo(aperio *a) override;
+	virtual void redo(aperio *a) override;
+	virtual string getName() const override { return "Explode"; }
+
+private:
+	vector<Entry> entries;
+	vector<SliderValue> sliders;
+
+	void apply(aperio *a, int which);
+};
+
+//-----------------------------------------------------------------------------------------
+/// <summary> Opacity change of one or more meshes (opacity field and actor opacity)
+/// </summary>
+class OpacityCommand : public UndoCommand
+{
+public:
+	struct Entry
+	{
+		shared_ptr<CustomMesh> mesh;
+		float opacity[2];			// Before, after
+		float actorOpacity[2];
+	};
+
+	OpacityCommand(vector<Entry> entries) : entries(entries) {}
+
+	virtual void undo(aperio *a) override;
+	virtual void redo(aperio *a) override;
+	virtual string getName() const override { return "Opacity"; }
+
+private:
+	vector<Entry> entries;
+
+	void apply(aperio *a, int which);
+};
+#endif
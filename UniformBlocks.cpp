@@ -0,0 +1,105 @@
+#include "stdafx.h"
+#include "UniformBlocks.h"
+
+#include "aperio.h"
+
+#include <algorithm>
+
+//-------------------------------------------------------------------------------------------
+void UniformBlocks::update(aperio *a)
+{
+	bool created = (frameBuffer == 0);
+
+	if (created)
+	{
+		glGenBuffers(1, &frameBuffer);
+		glBindBuffer(GL_UNIFORM_BUFFER, frameBuffer);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameBlock), nullptr, GL_DYNAMIC_DRAW);
+
+		glGenBuffers(1, &toolBuffer);
+		glBindBuffer(GL_UNIFORM_BUFFER, toolBuffer);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(tools), nullptr, GL_DYNAMIC_DRAW);
+	}
+
+	// Frame state
+	FrameBlock f = {};
+
+	for (int j = 0; j < 3; j++)
+	{
+		f.mouse[j] = a->mouse[j];
+		f.selectedColor[j] = a->selectedColor[j];
+	}
+	f.mouseSize = a->mouseSize;
+	f.brushSize = a->brushSize;
+	f.darkness = a->darkness;
+	f.time = a->wavetime;
+	f.elemssize = std::min((int)a->myelems.size(), MAX_TOOLS);
+	f.shininess = a->shininess;
+	f.previewer = a->previewer;
+	f.cap = a->cap;
+	f.toolTipOn = a->toolTipOn;
+	f.difftrans = a->difftrans;
+
+	if (created || memcmp(&f, &frame, sizeof(FrameBlock)) != 0)
+	{
+		frame = f;
+
+		glBindBuffer(GL_UNIFORM_BUFFER, frameBuffer);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameBlock), &frame);
+	}
+
+	// Tools (planted elems, in order)
+	int count = f.elemssize;
+	int firstChanged = count;
+
+	for (int i = 0; i < count; i++)
+	{
+		auto &elem = a->myelems[i];
+		ToolBlock t = {};
+
+		for (int j = 0; j < 3; j++)
+		{
+			t.pos1[j] = elem->p1.point[j];
+			t.pos2[j] = elem->p2.point[j];
+			t.norm1[j] = elem->p1.normal[j];
+			t.norm2[j] = elem->p1.normal[j];	// p1's normal at both ends (as the per elem uniforms were)
+			t.scale[j] = elem->scale[j];
+			t.right[j] = elem->right[j];
+			t.up[j] = elem->up[j];
+			t.forward[j] = elem->forward[j];
+		}
+
+		t.phi = elem->source->GetPhiRoundness();
+		t.theta = elem->source->GetThetaRoundness();
+		t.thickness = elem->source->GetThickness();
+		t.taper = elem->source->GetTaper();
+
+		t.angle = elem->spinAngle;
+		t.tilt = elem->tilt;
+		t.ribbonWidth = elem->ribbonWidth;
+		t.ribbonTilt = elem->ribbonTilt;
+		t.ribbonFrequency = elem->ribbonFrequency;
+		t.cutter = (elem->toolType == CUTTER || elem->toolType == KNIFE);
+		t.ribbons = elem->ribbons;
+		t.frontRibbons = elem->frontRibbons;
+		t.toroid = (elem->toolType == RING);
+
+		if (firstChanged == count && (i >= toolCount || memcmp(&t, &tools[i], sizeof(ToolBlock)) != 0))
+			firstChanged = i;
+
+		tools[i] = t;
+	}
+
+	// Typically only the tool being placed changes (the last one), so upload from the first change on
+	if (firstChanged < count)
+	{
+		glBindBuffer(GL_UNIFORM_BUFFER, toolBuffer);
+		glBufferSubData(GL_UNIFORM_BUFFER, firstChanged * sizeof(ToolBlock), (count - firstChanged) * sizeof(ToolBlock), &tools[firstChanged]);
+	}
+	toolCount = count;
+
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	glBindBufferBase(GL_UNIFORM_BUFFER, 0, frameBuffer);
+	glBindBufferBase(GL_UNIFORM_BUFFER, 1, toolBuffer);
+}
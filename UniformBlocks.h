@@ -0,0 +1,63 @@
+// ***********************************************************************
+// Uniform Blocks - Per frame state shared by all geometry shaders (mouse,
+//					brush, shading) and the planted tools, in two std140
+//					uniform buffers (bindings 0 and 1)
+// ***********************************************************************
+
+#ifndef UNIFORM_BLOCKS_H
+#define UNIFORM_BLOCKS_H
+
+class aperio;	// Forward declaration
+
+//-----------------------------------------------------------------------------------------
+/// <summary> UniformBlocks, CPU copies of the FrameState and Tools blocks (see shader.frag).
+/// Only the bytes that changed since the last upload are sent
+/// </summary>
+class UniformBlocks
+{
+public:
+	/// <summary> Same as MAX_TOOLS in the shaders (tools past it don't cut in the preview) </summary>
+	static const int MAX_TOOLS = 64;
+
+	/// <summary> FrameState block, std140 (bools are 4 byte ints) </summary>
+	struct FrameBlock
+	{
+		float mouse[3], mouseSize;
+		float selectedColor[3], brushSize;
+		float darkness, time;
+		int elemssize, shininess;
+		int previewer, cap, toolTipOn, difftrans;
+	};
+	static_assert(sizeof(FrameBlock) == 64, "FrameBlock must match the std140 FrameState layout");
+
+	/// <summary> Tool struct of the Tools block, std140 (vec3s padded by the float after them) </summary>
+	struct ToolBlock
+	{
+		float pos1[3], phi;
+		float pos2[3], theta;
+		float norm1[3], thickness;
+		float norm2[3], taper;
+		float scale[3], angle;
+		float right[3], tilt;
+		float up[3], ribbonWidth;
+		float forward[3], ribbonTilt;
+		int ribbonFrequency, cutter, ribbons, frontRibbons;
+		int toroid, pad[3];
+	};
+	static_assert(sizeof(ToolBlock) == 160, "ToolBlock must match the std140 Tool layout");
+
+	//--------------------------------------------------------------------------------------------------
+	/// <summary> Once per frame, before any geometry pass: packs aperio's state and elems, uploads what
+	/// changed and binds both buffers (needs GL 3.1, aperio's glew_available)
+	/// </summary>
+	void update(aperio *a);
+
+private:
+	FrameBlock frame;
+	ToolBlock tools[MAX_TOOLS];
+	int toolCount = 0;				// Tools uploaded (the rest of the buffer is stale, never read)
+
+	unsigned int frameBuffer = 0;
+	unsigned int toolBuffer = 0;
+};
+#endif
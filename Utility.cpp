@@ -4,6 +4,8 @@
 // Standard
 #include <iostream>
 #include <map>
+#include <array>
+#include <unordered_map>
 #include <time.h>
 
 // VTK Includes
@@ -21,6 +23,135 @@ namespace Utility
 	/// </summary>
 	map<char, clock_t> clocks;
 }
+
+// OBB kernel helpers -----------------------------------------------------------------------
+namespace
+{
+	/// <summary> Point sets smaller than this are handled on the calling thread </summary>
+	const int OBB_PARALLEL_THRESHOLD = 100000;
+	const int OBB_MAX_CHUNKS = 8;
+
+	/// <summary> First and second order moments of a chunk of points (relative to a reference point) </summary>
+	struct OBBMoments
+	{
+		double sum[3];
+		double sumSq[6];	// xx, xy, xz, yy, yz, zz
+	};
+
+	/// <summary> Min/max projections of a chunk of points onto the three OBB axes </summary>
+	struct OBBExtents
+	{
+		double tMin[3];
+		double tMax[3];
+	};
+
+	//------------------------------------------------------------------------------------------
+	template <typename T>
+	void accumulateMoments(const T *p, vtkIdType begin, vtkIdType end, const double ref[3], OBBMoments &m)
+	{
+		double sx = 0, sy = 0, sz = 0;
+		double sxx = 0, sxy = 0, sxz = 0, syy = 0, syz = 0, szz = 0;
+
+		// Straight loop over interleaved xyz (no virtual GetPoint calls), vectorizes well
+		for (vtkIdType i = begin; i < end; i++)
+		{
+			double x = p[3 * i] - ref[0];
+			double y = p[3 * i + 1] - ref[1];
+			double z = p[3 * i + 2] - ref[2];
+
+			sx += x; sy += y; sz += z;
+			sxx += x * x; sxy += x * y; sxz += x * z;
+			syy += y * y; syz += y * z; szz += z * z;
+		}
+		m.sum[0] = sx; m.sum[1] = sy; m.sum[2] = sz;
+		m.sumSq[0] = sxx; m.sumSq[1] = sxy; m.sumSq[2] = sxz;
+		m.sumSq[3] = syy; m.sumSq[4] = syz; m.sumSq[5] = szz;
+	}
+	//------------------------------------------------------------------------------------------
+	template <typename T>
+	void accumulateExtents(const T *p, vtkIdType begin, vtkIdType end, const double mean[3], double axes[3][3], OBBExtents &e)
+	{
+		for (int j = 0; j < 3; j++)
+		{
+			e.tMin[j] = VTK_DOUBLE_MAX;
+			e.tMax[j] = -VTK_DOUBLE_MAX;
+		}
+
+		for (vtkIdType i = begin; i < end; i++)
+		{
+			double x = p[3 * i] - mean[0];
+			double y = p[3 * i + 1] - mean[1];
+			double z = p[3 * i + 2] - mean[2];
+
+			for (int j = 0; j < 3; j++)
+			{
+				double t = x * axes[j][0] + y * axes[j][1] + z * axes[j][2];
+				e.tMin[j] = std::min(e.tMin[j], t);
+				e.tMax[j] = std::max(e.tMax[j], t);
+			}
+		}
+	}
+	//------------------------------------------------------------------------------------------
+	template <typename T>
+	void computeOBBTyped(const T *p, vtkIdType n, double mean[3], double axes[3][3], double eigenvalues[3], double tMin[3], double tMax[3])
+	{
+		// Reference point (first point) keeps the single-pass covariance numerically stable
+		double ref[3] = { (double)p[0], (double)p[1], (double)p[2] };
+
+		// ---- Pass 1: mean and covariance
+		OBBMoments moments[OBB_MAX_CHUNKS];
+		int numChunks = Utility::parallelForChunks((int)n, OBB_PARALLEL_THRESHOLD, OBB_MAX_CHUNKS, [&](int begin, int end, int c) {
+			accumulateMoments(p, begin, end, ref, moments[c]);
+		});
+
+		double sum[3] = { 0, 0, 0 }, sumSq[6] = { 0, 0, 0, 0, 0, 0 };
+		for (int c = 0; c < numChunks; c++)
+		{
+			for (int j = 0; j < 3; j++) sum[j] += moments[c].sum[j];
+			for (int j = 0; j < 6; j++) sumSq[j] += moments[c].sumSq[j];
+		}
+
+		double d[3] = { sum[0] / n, sum[1] / n, sum[2] / n };	// mean - ref
+		for (int j = 0; j < 3; j++)
+			mean[j] = ref[j] + d[j];
+
+		double a0[3], a1[3], a2[3];
+		double *a[3] = { a0, a1, a2 };
+		a0[0] = sumSq[0] / n - d[0] * d[0]; a0[1] = sumSq[1] / n - d[0] * d[1]; a0[2] = sumSq[2] / n - d[0] * d[2];
+		a1[1] = sumSq[3] / n - d[1] * d[1]; a1[2] = sumSq[4] / n - d[1] * d[2];
+		a2[2] = sumSq[5] / n - d[2] * d[2];
+		a1[0] = a0[1]; a2[0] = a0[2]; a2[1] = a1[2];
+
+		// Eigenvectors (columns, sorted by decreasing eigenvalue) are the box axes
+		double v0[3], v1[3], v2[3];
+		double *v[3] = { v0, v1, v2 };
+		vtkMath::Jacobi(a, eigenvalues, v);
+
+		for (int j = 0; j < 3; j++)
+		{
+			axes[0][j] = v[j][0];
+			axes[1][j] = v[j][1];
+			axes[2][j] = v[j][2];
+		}
+
+		// ---- Pass 2: extents along each axis
+		OBBExtents extents[OBB_MAX_CHUNKS];
+		numChunks = Utility::parallelForChunks((int)n, OBB_PARALLEL_THRESHOLD, OBB_MAX_CHUNKS, [&](int begin, int end, int c) {
+			accumulateExtents(p, begin, end, mean, axes, extents[c]);
+		});
+
+		for (int j = 0; j < 3; j++)
+		{
+			tMin[j] = VTK_DOUBLE_MAX;
+			tMax[j] = -VTK_DOUBLE_MAX;
+			for (int c = 0; c < numChunks; c++)
+			{
+				tMin[j] = std::min(tMin[j], extents[c].tMin[j]);
+				tMax[j] = std::max(tMax[j], extents[c].tMax[j]);
+			}
+		}
+	}
+}
 ///---------------------------------------------------------------------------------------------
 void Utility::start_clock(char clockname)
 {
@@ -225,52 +356,11 @@ weak_ptr<CustomMesh> Utility::addMesh(aperio *a, vtkSmartPointer<vtkPolyData> so
 	customMesh->name = groupname;
 	customMesh->selected = false;
 
-	// Add cell locator for mesh to cellpicker and to mesh
-	customMesh->cellLocator = vtkSmartPointer<vtkCellLocator>::New();
-	customMesh->cellLocator->SetDataSet(source);
-	customMesh->cellLocator->BuildLocator();
-	customMesh->cellLocator->LazyEvaluationOn();
-
-	a->interactorstyle->cellPicker->AddLocator(customMesh->cellLocator);
-
-	// ------ Make OBB Tree
-	double corner[3], max[3], mid[3], min[3], size[3];
-	vtkSmartPointer<vtkOBBTree> objectOBBTree = vtkSmartPointer<vtkOBBTree>::New();
-	objectOBBTree->SetDataSet(source);
-	objectOBBTree->ComputeOBB(source->GetPoints(), corner, max, mid, min, size);
-	vtkVector3f meshSize = vtkVector3f(size[0], size[1], size[2]);
-
-	vtkSmartPointer<vtkPolyData> polydataOBB = vtkSmartPointer<vtkPolyData>::New();
-	objectOBBTree->BuildLocator();
-	objectOBBTree->GenerateRepresentation(0, polydataOBB);
-	vtkSmartPointer<vtkActor> actorOBB = Utility::sourceToActor(a, polydataOBB);
-
-	customMesh->cornerOBB = vtkVector3f(corner[0], corner[1], corner[2]);
-	customMesh->axesOBB[0] = vtkVector3f(max[0], max[1], max[2]); customMesh->axesOBB[0].Normalize();
-	customMesh->axesOBB[1] = vtkVector3f(mid[0], mid[1], mid[2]); customMesh->axesOBB[1].Normalize();
-	customMesh->axesOBB[2] = vtkVector3f(min[0], min[1], min[2]); customMesh->axesOBB[2].Normalize();
-	customMesh->sizeOBB = vtkVector3f(size[0], size[1], size[2]);
-	customMesh->actorOBB = actorOBB;
-	customMesh->actorOBB->VisibilityOff();
-	customMesh->actorOBB->PickableOff();
-	//a->renderer->AddActor(customMesh->actorOBB);
-
-
-	customMesh->size[0] = size[0];
-	customMesh->size[1] = size[1];
-	customMesh->size[2] = size[2];
-
-	// Compute OBB's Center of Mass
-	vtkSmartPointer<vtkCenterOfMass> centerOfMassFilter = vtkSmartPointer<vtkCenterOfMass>::New();
-	centerOfMassFilter->SetInputData(polydataOBB);
-	centerOfMassFilter->SetUseScalarsAsWeights(false);
-	centerOfMassFilter->Update();
-	double center[3];
-	centerOfMassFilter->GetCenter(center);
-
-	customMesh->center[0] = center[0];
-	customMesh->center[1] = center[1];
-	customMesh->center[2] = center[2];
+	// Locator, OBB and center of mass are built lazily on first use (or prebuilt when idle)
+	// Build cells and bounds here (main thread) so later lazy builds only ever read the polydata
+	source->BuildCells();
+	source->GetBounds();
+	customMesh->accelSource = source;
 
 	// ----- If there is an oldMesh available (inputted), copy its path properties
 	if (oldMesh != nullptr)
@@ -279,7 +369,7 @@ weak_ptr<CustomMesh> Utility::addMesh(aperio *a, vtkSmartPointer<vtkPolyData> so
 		customMesh->path_angle = oldMesh->path_angle;
 		customMesh->path_initpt_exact = oldMesh->path_initpt_exact;
 		customMesh->path_leafangle = oldMesh->path_leafangle;
-		customMesh->path_pt = oldMesh->path_pt;
+		customMesh->path_param = oldMesh->path_param;
 		customMesh->pathType = oldMesh->pathType;
 	}
 	// ----- Make mapper and actors
@@ -300,6 +390,310 @@ weak_ptr<CustomMesh> Utility::addMesh(aperio *a, vtkSmartPointer<vtkPolyData> so
 	return customMesh;
 }
 //-----------------------------------------------------------------------------------------------
+vtkSmartPointer<vtkCellLocator> CustomMesh::getCellLocator()
+{
+	std::lock_guard<std::mutex> lock(accelMutex);
+
+	if (!locatorBuilt)
+	{
+		cellLocator = vtkSmartPointer<vtkCellLocator>::New();
+		cellLocator->SetDataSet(accelSource);
+		cellLocator->BuildLocator();
+		cellLocator->LazyEvaluationOn();
+
+		locatorBuilt = true;
+	}
+	return cellLocator;
+}
+//-----------------------------------------------------------------------------------------------
+void CustomMesh::ensureOBB()
+{
+	std::lock_guard<std::mutex> lock(accelMutex);
+
+	if (obbBuilt)
+		return;
+
+	// ------ Compute OBB and its center straight from the points (no tree, no center of mass filter)
+	double corner[3], max[3], mid[3], min[3], obbsize[3];
+	Utility::computeOBB(accelSource->GetPoints(), corner, max, mid, min, obbsize, center);
+
+	cornerOBB = vtkVector3f(corner[0], corner[1], corner[2]);
+	axesOBB[0] = vtkVector3f(max[0], max[1], max[2]); axesOBB[0].Normalize();
+	axesOBB[1] = vtkVector3f(mid[0], mid[1], mid[2]); axesOBB[1].Normalize();
+	axesOBB[2] = vtkVector3f(min[0], min[1], min[2]); axesOBB[2].Normalize();
+	sizeOBB = vtkVector3f(obbsize[0], obbsize[1], obbsize[2]);
+	extentsOBB = vtkVector3f(vtkMath::Norm(max), vtkMath::Norm(mid), vtkMath::Norm(min));
+
+	size[0] = obbsize[0];
+	size[1] = obbsize[1];
+	size[2] = obbsize[2];
+
+	// Published last: lock-free readers (isOBBBuilt) only see finished OBB fields
+	obbBuilt.store(true, std::memory_order_release);
+}
+//-----------------------------------------------------------------------------------------------
+vtkSmartPointer<vtkActor> CustomMesh::getActorOBB()
+{
+	ensureOBB();
+
+	// Mapper/actor creation stays on the main thread, only the OBB numbers are built by the prebuild
+	if (!actorOBB)
+	{
+		double corner[3], axes[3][3];
+		for (int j = 0; j < 3; j++)
+		{
+			corner[j] = cornerOBB[j];
+			for (int k = 0; k < 3; k++)
+				axes[k][j] = axesOBB[k][j] * extentsOBB[k];
+		}
+
+		actorOBB = Utility::sourceToActor(nullptr, Utility::makeOBBPolyData(corner, axes[0], axes[1], axes[2]));
+		actorOBB->VisibilityOff();
+		actorOBB->PickableOff();
+	}
+	return actorOBB;
+}
+//-----------------------------------------------------------------------------------------------
+shared_ptr<MeshBVH> CustomMesh::getTriangleBVH()
+{
+	std::lock_guard<std::mutex> lock(accelMutex);
+
+	if (!triangleBVH)
+		triangleBVH = make_shared<MeshBVH>(accelSource);
+
+	return triangleBVH;
+}
+//-----------------------------------------------------------------------------------------------
+void CustomMesh::releaseAccel()
+{
+	std::lock_guard<std::mutex> lock(accelMutex);
+
+	cellLocator = nullptr;
+	triangleBVH = nullptr;
+	actorOBB = nullptr;
+
+	locatorBuilt = false;
+	obbBuilt = false;
+}
+//-----------------------------------------------------------------------------------------------
+namespace
+{
+	// Spill file: each array is (data type, components, tuples, raw values)
+	bool writeArray(QFile &file, vtkDataArray *array)
+	{
+		int header[3] = { array->GetDataType(), array->GetNumberOfComponents(), (int)array->GetNumberOfTuples() };
+		qint64 size = (qint64)header[1] * header[2] * array->GetDataTypeSize();
+
+		return file.write((const char*)header, sizeof(header)) == sizeof(header) &&
+			file.write((const char*)array->GetVoidPointer(0), size) == size;
+	}
+
+	bool writeValue(QFile &file, const void *value, qint64 size)
+	{
+		return file.write((const char*)value, size) == size;
+	}
+
+	bool readValue(QFile &file, void *value, qint64 size)
+	{
+		return file.read((char*)value, size) == size;
+	}
+
+	// Null on a short read or a header that doesn't fit the rest of the file
+	vtkSmartPointer<vtkDataArray> readArray(QFile &file)
+	{
+		int header[3];
+		if (!readValue(file, header, sizeof(header)) || header[1] <= 0 || header[2] < 0)
+			return nullptr;
+
+		vtkSmartPointer<vtkDataArray> array = vtkSmartPointer<vtkDataArray>::Take(vtkDataArray::CreateDataArray(header[0]));
+		if (!array)
+			return nullptr;
+
+		qint64 size = (qint64)header[1] * header[2] * array->GetDataTypeSize();
+		if (size > file.size() - file.pos())
+			return nullptr;
+
+		array->SetNumberOfComponents(header[1]);
+		array->SetNumberOfTuples(header[2]);
+		if (!readValue(file, array->GetVoidPointer(0), size))
+			return nullptr;
+
+		return array;
+	}
+}
+//-----------------------------------------------------------------------------------------------
+bool CustomMesh::spillGeometry()
+{
+	std::lock_guard<std::mutex> lock(accelMutex);
+
+	if (spilled || !accelSource || !accelSource->GetPoints())
+		return false;
+
+	spillFile.reset(new QTemporaryFile());
+	if (!spillFile->open())
+	{
+		spillFile = nullptr;
+		return false;
+	}
+
+	QFile &file = *spillFile;
+
+	bool ok = writeArray(file, accelSource->GetPoints()->GetData());
+
+	// Cells (verts, lines, polys, strips)
+	vtkCellArray *cells[4] = { accelSource->GetVerts(), accelSource->GetLines(), accelSource->GetPolys(), accelSource->GetStrips() };
+	for (auto cellArray : cells)
+	{
+		vtkIdType numCells = cellArray ? cellArray->GetNumberOfCells() : 0;
+		ok = ok && writeValue(file, &numCells, sizeof(numCells));
+
+		if (numCells > 0)
+			ok = ok && writeArray(file, cellArray->GetData());
+	}
+
+	// Point data (with its attribute, e.g. normals, texture coordinates)
+	vtkPointData *pointData = accelSource->GetPointData();
+	int numArrays = pointData->GetNumberOfArrays();
+	ok = ok && writeValue(file, &numArrays, sizeof(numArrays));
+
+	for (int i = 0; i < numArrays && ok; i++)
+	{
+		vtkDataArray *array = pointData->GetArray(i);
+		std::string name = array->GetName() ? array->GetName() : "";
+		int attribute = pointData->IsArrayAnAttribute(i);
+		int nameLength = name.size();
+
+		ok = writeValue(file, &attribute, sizeof(attribute)) &&
+			writeValue(file, &nameLength, sizeof(nameLength)) &&
+			writeValue(file, name.c_str(), nameLength) &&
+			writeArray(file, array);
+	}
+
+	ok = ok && file.flush() && file.error() == QFileDevice::NoError;
+
+	// Failed (e.g. disk full): temp file is removed, geometry stays in memory
+	if (!ok)
+	{
+		cout << "Could not spill geometry of " << name << ": " << file.errorString().toStdString() << "\n";
+		spillFile = nullptr;
+		return false;
+	}
+
+	// Empty polydata (same object stays the actor's mapper input)
+	accelSource->Initialize();
+	spilled = true;
+
+	return true;
+}
+//-----------------------------------------------------------------------------------------------
+bool CustomMesh::unspillGeometry()
+{
+	std::lock_guard<std::mutex> lock(accelMutex);
+
+	if (!spilled)
+		return true;
+
+	QFile &file = *spillFile;
+	bool ok = file.seek(0);
+
+	// Everything is read before the polydata is touched, so a bad file leaves the mesh spilled
+	vtkSmartPointer<vtkDataArray> pointArray = ok ? readArray(file) : nullptr;
+	ok = pointArray != nullptr;
+
+	vtkSmartPointer<vtkCellArray> cells[4];
+	for (auto &cellArray : cells)
+	{
+		vtkIdType numCells = 0;
+		ok = ok && readValue(file, &numCells, sizeof(numCells));
+
+		if (ok && numCells > 0)
+		{
+			auto array = readArray(file);
+			vtkIdTypeArray *ids = vtkIdTypeArray::SafeDownCast(array);
+			ok = ids != nullptr;
+
+			if (ok)
+			{
+				cellArray = vtkSmartPointer<vtkCellArray>::New();
+				cellArray->SetCells(numCells, ids);
+			}
+		}
+	}
+
+	struct SpilledArray
+	{
+		vtkSmartPointer<vtkDataArray> array;
+		int attribute;
+	};
+	vector<SpilledArray> arrays;
+
+	int numArrays = 0;
+	ok = ok && readValue(file, &numArrays, sizeof(numArrays)) && numArrays >= 0;
+
+	for (int i = 0; i < numArrays && ok; i++)
+	{
+		int attribute, nameLength;
+		ok = readValue(file, &attribute, sizeof(attribute)) && readValue(file, &nameLength, sizeof(nameLength)) &&
+			nameLength >= 0 && nameLength <= file.size() - file.pos();
+		if (!ok)
+			break;
+
+		std::string name(nameLength, ' ');
+		ok = readValue(file, &name[0], nameLength);
+
+		auto array = ok ? readArray(file) : nullptr;
+		ok = array != nullptr;
+
+		if (ok)
+		{
+			if (!name.empty())
+				array->SetName(name.c_str());
+
+			SpilledArray spilledArray = { array, attribute };
+			arrays.push_back(spilledArray);
+		}
+	}
+
+	if (!ok)
+	{
+		cout << "Could not read spilled geometry of " << name << ", it stays in " << file.fileName().toStdString() << "\n";
+		return false;
+	}
+
+	vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+	points->SetData(pointArray);
+	accelSource->SetPoints(points);
+
+	accelSource->SetVerts(cells[0]);
+	accelSource->SetLines(cells[1]);
+	accelSource->SetPolys(cells[2]);
+	accelSource->SetStrips(cells[3]);
+
+	vtkPointData *pointData = accelSource->GetPointData();
+	for (auto &spilledArray : arrays)
+	{
+		int index = pointData->AddArray(spilledArray.array);
+		if (spilledArray.attribute >= 0)
+			pointData->SetActiveAttribute(index, spilledArray.attribute);
+	}
+
+	// Same as Utility::addMesh, so later lazy builds only read the polydata
+	accelSource->BuildCells();
+	accelSource->GetBounds();
+
+	// Anything built while spilled (e.g. by a prebuild already running) saw no geometry
+	cellLocator = nullptr;
+	triangleBVH = nullptr;
+	actorOBB = nullptr;
+	locatorBuilt = false;
+	obbBuilt = false;
+
+	spillFile = nullptr;
+	spilled = false;
+
+	return true;
+}
+//-----------------------------------------------------------------------------------------------
 void Utility::removeMesh(aperio *a, weak_ptr<CustomMesh> mesh)
 {
 	auto it = a->getMeshIterator(mesh);
@@ -314,6 +708,13 @@ void Utility::removeMesh(aperio *a, weak_ptr<CustomMesh> mesh)
 		// Remove from renderer
 		a->renderer->RemoveActor(actualMesh->actor);
 
+		// Remove locator from picker (re-added in transferToMeshes)
+		if (actualMesh->locatorRegistered)
+		{
+			a->interactorstyle->cellPicker->RemoveLocator(actualMesh->cellLocator);
+			actualMesh->locatorRegistered = false;
+		}
+
 		// Remove from meshes vector
 		a->meshes.erase(it);
 	}
@@ -355,6 +756,219 @@ vtkSmartPointer<vtkPolyData> Utility::computeNormals(vtkSmartPointer<vtkPolyData
 	return dataset->GetOutput();
 }
 //-------------------------------------------------------------------------------------------------------------------------
+namespace
+{
+	typedef std::array<float, 3> PointKey;
+
+	struct PointKeyHash
+	{
+		size_t operator()(const PointKey &p) const
+		{
+			size_t h = 0;
+			for (int j = 0; j < 3; j++)
+			{
+				unsigned int bits;
+				memcpy(&bits, &p[j], sizeof(bits));
+				h = h * 1000003u ^ bits;
+			}
+			return h;
+		}
+	};
+}
+//-------------------------------------------------------------------------------------------------------------------------
+vtkSmartPointer<vtkPolyData> Utility::computeNormalsIncremental(vtkSmartPointer<vtkPolyData> result, vtkSmartPointer<vtkPolyData> source)
+{
+	vtkDataArray *sourceNormals = source->GetPointData()->GetNormals();
+
+	if (sourceNormals == nullptr)
+		return computeNormals(result);
+
+	// ---- Source point ids by exact position (CSG copies preserved vertices, float -> double -> float is exact).
+	// Source is not cleaned, so a feature edge vertex has one copy per side (each with that side's normal)
+	std::unordered_map<PointKey, vector<vtkIdType>, PointKeyHash> positions;
+	positions.reserve(source->GetNumberOfPoints());
+
+	for (vtkIdType i = 0; i < source->GetNumberOfPoints(); i++)
+	{
+		double p[3];
+		source->GetPoint(i, p);
+
+		PointKey key = { { (float)p[0], (float)p[1], (float)p[2] } };
+		positions[key].push_back(i);
+	}
+
+	vtkIdType n = result->GetNumberOfPoints();
+	vector<const vector<vtkIdType> *> candidates(n, nullptr);
+	vector<char> isNew(n, 0);
+
+	for (vtkIdType i = 0; i < n; i++)
+	{
+		double p[3];
+		result->GetPoint(i, p);
+
+		PointKey key = { { (float)p[0], (float)p[1], (float)p[2] } };
+		auto found = positions.find(key);
+
+		if (found != positions.end())
+			candidates[i] = &found->second;
+		else
+			isNew[i] = 1;
+	}
+
+	// ---- Recomputed points: new (cut/cap) points and their one-ring
+	vtkCellArray *polys = result->GetPolys();
+	vector<char> marked(isNew);
+
+	vtkIdType npts;
+	vtkIdType *pts = nullptr;
+
+	for (polys->InitTraversal(); polys->GetNextCell(npts, pts);)
+	{
+		bool touchesNew = false;
+		for (vtkIdType j = 0; j < npts && !touchesNew; j++)
+			touchesNew = isNew[pts[j]] != 0;
+
+		if (touchesNew)
+		{
+			for (vtkIdType j = 0; j < npts; j++)
+				marked[pts[j]] = 1;
+		}
+	}
+
+	// Faces around recomputed points get new normals, all others are kept as is
+	vtkSmartPointer<vtkCellArray> region = vtkSmartPointer<vtkCellArray>::New();
+	vtkSmartPointer<vtkCellArray> kept = vtkSmartPointer<vtkCellArray>::New();
+
+	for (polys->InitTraversal(); polys->GetNextCell(npts, pts);)
+	{
+		bool touchesMarked = false;
+		for (vtkIdType j = 0; j < npts && !touchesMarked; j++)
+			touchesMarked = marked[pts[j]] != 0;
+
+		if (touchesMarked)
+			region->InsertNextCell(npts, pts);
+		else
+			kept->InsertNextCell(npts, pts);
+	}
+
+	// Same points, region faces only: vtkPolyDataNormals keeps the first n points and appends split copies
+	vtkSmartPointer<vtkPolyData> regionPoly = vtkSmartPointer<vtkPolyData>::New();
+	regionPoly->SetPoints(result->GetPoints());
+	regionPoly->SetPolys(region);
+
+	vtkSmartPointer<vtkPolyDataNormals> normals = vtkSmartPointer<vtkPolyDataNormals>::New();
+	normals->SetInputData(regionPoly);
+	normals->ComputePointNormalsOn();
+	normals->ComputeCellNormalsOff();
+	normals->SplittingOn();
+	normals->SetConsistency(false);		// Carve output is consistently oriented already
+	normals->SetFeatureAngle(60);
+	normals->Update();
+
+	vtkPolyData *regionOut = normals->GetOutput();
+	vtkDataArray *regionNormals = regionOut->GetPointData()->GetNormals();
+
+	vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+	points->DeepCopy(regionOut->GetPoints());
+
+	vtkSmartPointer<vtkFloatArray> merged = vtkSmartPointer<vtkFloatArray>::New();
+	merged->DeepCopy(regionNormals);
+	merged->SetName("Normals");
+
+	// Split copies (ids >= n) back to the result point they were made from (copies of preserved points end up unused)
+	std::unordered_map<PointKey, vtkIdType, PointKeyHash> resultIds;
+	resultIds.reserve(n);
+
+	for (vtkIdType i = 0; i < n; i++)
+	{
+		double p[3];
+		result->GetPoint(i, p);
+
+		PointKey key = { { (float)p[0], (float)p[1], (float)p[2] } };
+		resultIds.emplace(key, i);
+	}
+
+	// ---- Corners at preserved points take the source copy on the face's side (best matching normal),
+	// one output point per (result point, source copy). Corners at recomputed points keep the region normals
+	std::map<std::pair<vtkIdType, vtkIdType>, vtkIdType> copies;
+	vector<char> claimed(n, 0);
+
+	auto remapCorners = [&](vtkIdType count, vtkIdType *ids, vtkPoints *cellPoints, vtkCellArray *out)
+	{
+		double faceNormal[3];
+		vtkPolygon::ComputeNormal(cellPoints, static_cast<int>(count), ids, faceNormal);
+
+		vector<vtkIdType> corners(ids, ids + count);
+
+		for (auto &id : corners)
+		{
+			vtkIdType orig = id;
+			if (orig >= n)
+			{
+				double p[3];
+				cellPoints->GetPoint(orig, p);
+
+				PointKey key = { { (float)p[0], (float)p[1], (float)p[2] } };
+				orig = resultIds[key];
+			}
+
+			if (marked[orig])
+				continue;
+
+			auto &sourceIds = *candidates[orig];
+			vtkIdType best = sourceIds[0];
+			double bestDot = -2;
+
+			for (auto sourceId : sourceIds)
+			{
+				double d = vtkMath::Dot(sourceNormals->GetTuple3(sourceId), faceNormal);
+				if (d > bestDot)
+				{
+					bestDot = d;
+					best = sourceId;
+				}
+			}
+
+			auto key = std::make_pair(orig, best);
+			auto found = copies.find(key);
+
+			if (found != copies.end())
+				id = found->second;
+			else
+			{
+				if (!claimed[orig])		// First side keeps the point's own id
+				{
+					claimed[orig] = 1;
+					id = orig;
+				}
+				else
+					id = points->InsertNextPoint(points->GetPoint(orig));
+
+				merged->InsertTuple(id, sourceNormals->GetTuple(best));
+				copies[key] = id;
+			}
+		}
+		out->InsertNextCell(count, corners.data());
+	};
+
+	vtkSmartPointer<vtkCellArray> allPolys = vtkSmartPointer<vtkCellArray>::New();
+	allPolys->Allocate(kept->GetSize() + regionOut->GetPolys()->GetSize());
+
+	for (kept->InitTraversal(); kept->GetNextCell(npts, pts);)
+		remapCorners(npts, pts, result->GetPoints(), allPolys);
+
+	vtkCellArray *regionPolys = regionOut->GetPolys();
+	for (regionPolys->InitTraversal(); regionPolys->GetNextCell(npts, pts);)
+		remapCorners(npts, pts, regionOut->GetPoints(), allPolys);
+
+	vtkSmartPointer<vtkPolyData> output = vtkSmartPointer<vtkPolyData>::New();
+	output->SetPoints(points);
+	output->SetPolys(allPolys);
+	output->GetPointData()->SetNormals(merged);
+
+	return output;
+}
+//-------------------------------------------------------------------------------------------------------------------------
 #define aisgl_min(x,y) (x<y?x:y)
 #define aisgl_max(x,y) (y>x?y:x)
 
@@ -439,6 +1053,74 @@ vtkSmartPointer<vtkActor> Utility::plotSphere(aperio *a, float x, float y, float
 	return actor;
 }
 //---------------------------------------------------------------------------------------------------
+void Utility::computeOBB(vtkPoints *points, double corner[3], double max[3], double mid[3], double min[3], double size[3], double center[3])
+{
+	vtkIdType n = points->GetNumberOfPoints();
+
+	double mean[3] = { 0, 0, 0 }, axes[3][3], tMin[3] = { 0, 0, 0 }, tMax[3] = { 0, 0, 0 };
+
+	if (n == 0)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			corner[i] = max[i] = mid[i] = min[i] = size[i] = center[i] = 0;
+		}
+		return;
+	}
+
+	if (points->GetDataType() == VTK_FLOAT)
+		computeOBBTyped(static_cast<float*>(points->GetVoidPointer(0)), n, mean, axes, size, tMin, tMax);
+	else if (points->GetDataType() == VTK_DOUBLE)
+		computeOBBTyped(static_cast<double*>(points->GetVoidPointer(0)), n, mean, axes, size, tMin, tMax);
+	else
+	{
+		// Uncommon point types, convert to double first
+		vtkSmartPointer<vtkPoints> converted = vtkSmartPointer<vtkPoints>::New();
+		converted->SetDataTypeToDouble();
+		converted->DeepCopy(points);
+		computeOBBTyped(static_cast<double*>(converted->GetVoidPointer(0)), n, mean, axes, size, tMin, tMax);
+	}
+
+	for (int i = 0; i < 3; i++)
+	{
+		corner[i] = mean[i] + tMin[0] * axes[0][i] + tMin[1] * axes[1][i] + tMin[2] * axes[2][i];
+		max[i] = (tMax[0] - tMin[0]) * axes[0][i];
+		mid[i] = (tMax[1] - tMin[1]) * axes[1][i];
+		min[i] = (tMax[2] - tMin[2]) * axes[2][i];
+		center[i] = corner[i] + 0.5 * (max[i] + mid[i] + min[i]);
+	}
+}
+//---------------------------------------------------------------------------------------------------
+vtkSmartPointer<vtkPolyData> Utility::makeOBBPolyData(const double corner[3], const double max[3], const double mid[3], const double min[3])
+{
+	vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+	points->SetNumberOfPoints(8);
+
+	// Same point order as vtkOBBTree::GenerateRepresentation
+	for (int i = 0; i < 8; i++)
+	{
+		double x[3];
+		for (int j = 0; j < 3; j++)
+		{
+			x[j] = corner[j] + ((i & 1) ? max[j] : 0) + ((i & 2) ? mid[j] : 0) + ((i & 4) ? min[j] : 0);
+		}
+		points->SetPoint(i, x);
+	}
+
+	vtkIdType faces[6][4] = { { 0, 1, 3, 2 }, { 0, 2, 6, 4 }, { 0, 4, 5, 1 },
+							  { 1, 5, 7, 3 }, { 2, 3, 7, 6 }, { 4, 6, 7, 5 } };
+
+	vtkSmartPointer<vtkCellArray> polys = vtkSmartPointer<vtkCellArray>::New();
+	for (int i = 0; i < 6; i++)
+		polys->InsertNextCell(4, faces[i]);
+
+	vtkSmartPointer<vtkPolyData> poly = vtkSmartPointer<vtkPolyData>::New();
+	poly->SetPoints(points);
+	poly->SetPolys(polys);
+
+	return poly;
+}
+//---------------------------------------------------------------------------------------------------
 vtkSmartPointer<vtkCellArray> Utility::generateLinesFromPoints(vtkSmartPointer<vtkPoints> points)
 {
 	// Generate lines from points
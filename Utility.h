@@ -11,6 +11,7 @@
 #include <stdarg.h>
 #include <iostream>
 #include <sstream>
+#include <climits>
 
 class aperio;	// Forward declarations
 class CustomMesh;
@@ -86,6 +87,66 @@ namespace Utility
 	/// </summary>
 	vtkSmartPointer<vtkPolyData> computeNormals(vtkSmartPointer<vtkPolyData> source);
 
+	///-------------------------------------------------------------------------
+	/// <summary> Normals for a CSG result of source: points kept from source (same position) keep its normals,
+	/// only new (cut/cap) points and their one-ring are recomputed, on the faces around them.
+	/// Source must be the uncleaned mesh (feature edges split into copies per side): each face corner takes
+	/// the copy whose normal best matches the face, so sharp edges stay split.
+	/// Falls back to computeNormals if source has no normals
+	/// </summary>
+	vtkSmartPointer<vtkPolyData> computeNormalsIncremental(vtkSmartPointer<vtkPolyData> result, vtkSmartPointer<vtkPolyData> source);
+
+
+	///-------------------------------------------------------------------------
+	/// <summary> Fast oriented bounding box of a point set (same outputs as vtkOBBTree::ComputeOBB:
+	/// corner, max/mid/min axes scaled to the box extent, covariance eigenvalues in size) plus the box center.
+	/// Reads the point buffer directly, large point sets are split across threads
+	/// </summary>
+	void computeOBB(vtkPoints *points, double corner[3], double max[3], double mid[3], double min[3], double size[3], double center[3]);
+
+	///-------------------------------------------------------------------------
+	/// <summary> Box polydata (8 points, 6 quads) from an OBB (same as vtkOBBTree::GenerateRepresentation level 0)
+	/// </summary>
+	vtkSmartPointer<vtkPolyData> makeOBBPolyData(const double corner[3], const double max[3], const double mid[3], const double min[3]);
+
+	///-------------------------------------------------------------------------
+	/// <summary> Runs func(begin, end, chunkIndex) over [0, n), split in up to maxChunks chunks across
+	/// threads when n >= threshold (first chunk runs on the calling thread). Returns the number of chunks
+	/// </summary>
+	template <typename F>
+	int parallelForChunks(int n, int threshold, int maxChunks, F func)
+	{
+		int numChunks = 1;
+
+		if (n >= threshold)
+			numChunks = std::max(1, std::min(maxChunks, (int)std::thread::hardware_concurrency()));
+
+		int chunkSize = (n + numChunks - 1) / numChunks;
+		vector<std::future<void> > tasks;
+
+		for (int c = 1; c < numChunks; c++)
+		{
+			int begin = std::min(n, c * chunkSize);
+			int end = std::min(n, begin + chunkSize);
+			tasks.push_back(std::async(std::launch::async, [=]() { func(begin, end, c); }));
+		}
+		func(0, std::min(n, chunkSize), 0);
+
+		for (auto &task : tasks)
+			task.get();
+
+		return numChunks;
+	}
+
+	///-------------------------------------------------------------------------
+	/// <summary> Runs func(begin, end) over [0, n), split in chunks across threads when n >= threshold
+	/// (first chunk runs on the calling thread)
+	/// </summary>
+	template <typename F>
+	void parallelFor(int n, int threshold, F func)
+	{
+		parallelForChunks(n, threshold, INT_MAX, [&](int begin, int end, int) { func(begin, end); });
+	}
 
 	///-------------------------------------------------------------------------
 	/// <summary> Get Image Data from .jpg or .png file
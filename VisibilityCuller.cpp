@@ -0,0 +1,163 @@
+#include "stdafx.h"
+#include "VisibilityCuller.h"
+
+#include "aperio.h"
+
+#include <algorithm>
+
+//-------------------------------------------------------------------------------------------
+void VisibilityCuller::update(aperio *a, vtkRenderer *renderer, double aspect)
+{
+	frame++;
+
+	if (!enabled)
+		return;
+
+	double planes[24];	// Left, right, bottom, top, near, far (normals point inwards)
+	renderer->GetActiveCamera()->GetFrustumPlanes(aspect, planes);
+
+	for (auto &mesh : a->meshes)
+	{
+		vtkActor *actor = mesh->actor;
+
+		// Not drawn, or OBB not built yet (never built here, that's the idle prebuild's job)
+		if (!actor->GetVisibility() || !mesh->isOBBBuilt())
+			continue;
+
+		Entry &entry = entries[actor];
+		entry.lastFrame = frame;
+
+		// Last frame's query (stays pending until the result is available)
+		if (entry.queryPending)
+		{
+			GLuint available = 0;
+			glGetQueryObjectuiv(entry.query, GL_QUERY_RESULT_AVAILABLE, &available);
+
+			if (available)
+			{
+				GLuint samples = 0;
+				glGetQueryObjectuiv(entry.query, GL_QUERY_RESULT, &samples);
+
+				entry.occluded = (samples == 0);
+				entry.queryPending = false;
+			}
+		}
+
+		// OBB corners (bit j of the index: + axis j) in world coordinates
+		vtkMatrix4x4 *matrix = actor->GetMatrix();
+
+		for (int i = 0; i < 8; i++)
+		{
+			double local[4] = { mesh->cornerOBB[0], mesh->cornerOBB[1], mesh->cornerOBB[2], 1.0 };
+
+			for (int j = 0; j < 3; j++)
+			{
+				if (i & (1 << j))
+				{
+					for (int k = 0; k < 3; k++)
+						local[k] += mesh->axesOBB[j][k] * mesh->extentsOBB[j];
+				}
+			}
+
+			double world[4];
+			matrix->MultiplyPoint(local, world);
+			std::copy(world, world + 3, entry.corners[i]);
+		}
+
+		// Outside if all corners are behind one plane
+		bool inside = true;
+		bool straddlesNear = false;
+
+		for (int k = 0; k < 6 && inside; k++)
+		{
+			const double *plane = planes + 4 * k;
+			int outside = 0;
+
+			for (int i = 0; i < 8; i++)
+			{
+				if (vtkMath::Dot(plane, entry.corners[i]) + plane[3] < 0)
+					outside++;
+			}
+
+			if (outside == 8)
+				inside = false;
+			else if (k == 4 && outside > 0)
+				straddlesNear = true;
+		}
+		entry.inFrustum = inside;
+
+		// Occluders only write depth when opaque. Selected meshes show through others (cutaway), a box
+		// clipped by the near plane can't be tested
+		bool translucent = actor->GetProperty()->GetOpacity() < 1.0;
+		entry.testOcclusion = occlusionEnabled && inside && !straddlesNear && !translucent && !mesh->selected;
+
+		if (!entry.testOcclusion)
+			entry.occluded = false;
+	}
+
+	// Meshes removed, hidden (or OBB released) since last frame
+	for (auto it = entries.begin(); it != entries.end();)
+	{
+		if (it->second.lastFrame != frame)
+		{
+			releaseQuery(it->second);
+			it = entries.erase(it);
+		}
+		else
+			++it;
+	}
+}
+//-------------------------------------------------------------------------------------------
+void VisibilityCuller::issueOcclusionQueries()
+{
+	if (!enabled || !occlusionEnabled)
+		return;
+
+	// Faces of the box (corner indices)
+	static const int faces[6][4] = { { 0, 2, 6, 4 }, { 1, 3, 7, 5 }, { 0, 1, 5, 4 }, { 2, 3, 7, 6 }, { 0, 1, 3, 2 }, { 4, 5, 7, 6 } };
+
+	// Boxes are only tested against the depth buffer
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDepthMask(GL_FALSE);
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_LEQUAL);
+	glDisable(GL_CULL_FACE);
+
+	// Modelview holds the camera's view matrix between props (corners are in world coordinates)
+	for (auto &pair : entries)
+	{
+		Entry &entry = pair.second;
+
+		if (!entry.testOcclusion || entry.queryPending)
+			continue;
+
+		if (entry.query == 0)
+			glGenQueries(1, &entry.query);
+
+		glBeginQuery(GL_ANY_SAMPLES_PASSED, entry.query);
+
+		glBegin(GL_QUADS);
+		for (auto &face : faces)
+		{
+			for (int v : face)
+				glVertex3dv(entry.corners[v]);
+		}
+		glEnd();
+
+		glEndQuery(GL_ANY_SAMPLES_PASSED);
+		entry.queryPending = true;
+	}
+
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glDepthMask(GL_TRUE);
+	glDisable(GL_DEPTH_TEST);
+}
+//-------------------------------------------------------------------------------------------
+void VisibilityCuller::releaseQuery(Entry &entry)
+{
+	if (entry.query != 0)
+		glDeleteQueries(1, &entry.query);
+
+	entry.query = 0;
+	entry.queryPending = false;
+}
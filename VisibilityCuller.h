@@ -0,0 +1,71 @@
+// ***********************************************************************
+// Visibility Culler - Per frame frustum culling of meshes (world OBBs) and
+//					   occlusion culling of opaque meshes (OBB occlusion
+//					   queries, results used one frame later)
+// ***********************************************************************
+
+#ifndef VISIBILITY_CULLER_H
+#define VISIBILITY_CULLER_H
+
+#include <unordered_map>
+
+class aperio;	// Forward declarations
+class CustomMesh;
+
+//-----------------------------------------------------------------------------------------
+/// <summary> VisibilityCuller, visibility of the meshes' props for the current frame. Props that
+/// aren't meshes (elems, tool tip, etc.) or whose OBB isn't built yet are always visible
+/// </summary>
+class VisibilityCuller
+{
+public:
+	//--------------------------------------------------------------------------------------------------
+	/// <summary> Once per frame, before any geometry pass: frustum test of each mesh's OBB (camera of
+	/// renderer, aspect of the target) and collection of last frame's occlusion query results
+	/// </summary>
+	void update(aperio *a, vtkRenderer *renderer, double aspect);
+
+	//--------------------------------------------------------------------------------------------------
+	/// <summary> After the opaque geometry (depth buffer filled): one query per opaque, unselected mesh
+	/// in the frustum, drawing its OBB against the depth (no colour/depth writes)
+	/// </summary>
+	void issueOcclusionQueries();
+
+	/// <summary> Whether prop must be drawn this frame (call before any per-prop setup) </summary>
+	bool isVisible(vtkProp *p) const
+	{
+		if (!enabled)
+			return true;
+
+		auto it = entries.find(p);
+		return it == entries.end() || (it->second.inFrustum && !it->second.occluded);
+	}
+
+	/// <summary> Disabled: everything is visible (queries are kept, but not issued) </summary>
+	void setEnabled(bool enabled) { this->enabled = enabled; }
+	bool isEnabled() const { return enabled; }
+
+	/// <summary> Occlusion queries need GL 3.3 (aperio's glew_available) </summary>
+	void setOcclusionEnabled(bool enabled) { occlusionEnabled = enabled; }
+
+private:
+	struct Entry
+	{
+		double corners[8][3];		// World OBB corners (this frame)
+		bool inFrustum = true;
+		bool occluded = false;		// Last available query result
+		bool testOcclusion = false;	// Opaque, unselected, in frustum and not cut by the near plane
+		unsigned int query = 0;
+		bool queryPending = false;
+		int lastFrame = 0;
+	};
+
+	std::unordered_map<vtkProp *, Entry> entries;
+
+	bool enabled = true;
+	bool occlusionEnabled = false;
+	int frame = 0;
+
+	void releaseQuery(Entry &entry);
+};
+#endif
@@ -1,5 +1,7 @@
 #include "stdafx.h"
 
+#include <algorithm>
+
 // QT Includes
 #include <QLayout>
 #include <QDesktopWidget>
@@ -82,6 +84,7 @@ float aperio::RING_PERCENT = 1.0;// 0.90f; // 0.85
 double aperio::DEFAULT_TAPER = 0.1;	// For Knife
 
 double aperio::DEFAULT_RODSIZE = 0.15;	// For Rod
+double aperio::KEYFRAME_SPACING = 1.5;	// Seconds
 
 //-------------------------------------------------------------------------------------------------------------
 aperio::aperio(QWidget *parent)
@@ -160,6 +163,11 @@ void aperio::slot_afterShowWindow()
 	status_label->setStyleSheet("background-color: rgba(0,0,0,0);");
 	ui.statusBar->addWidget(status_label);
 
+	// Profiler label (right side of status bar)
+	profiler_label = new QLabel("", this);
+	profiler_label->setStyleSheet("background-color: rgba(0,0,0,0);");
+	ui.statusBar->addPermanentWidget(profiler_label);
+
 	QTimer* timer_instant = nullptr;	// Instantaneous timer (executed as fast as possible)
 	timer_instant = new QTimer(this);
 	timer_instant->setInterval(0);
@@ -186,6 +194,14 @@ void aperio::slot_afterShowWindow()
 	timer_explode->setTimerType(Qt::TimerType::PreciseTimer);
 	*/
 
+	timer_prebuild = new QTimer(this);			// Idle timer (prebuilds mesh locators/OBBs in background)
+	timer_prebuild->setInterval(100);
+	timer_prebuild->start();
+
+	timer_sliderChange = new QTimer(this);		// Undo: slider change is recorded once its value settles
+	timer_sliderChange->setSingleShot(true);
+	timer_sliderChange->setInterval(SLIDER_SETTLE_MS);
+
 	timer_highlight = new QTimer(this);
 	timer_highlight->setInterval(1000.0 / fps);
 	timer_highlight->setTimerType(Qt::TimerType::PreciseTimer);
@@ -245,6 +261,7 @@ void aperio::slot_afterShowWindow()
 	mainP->initialize(this);
 	mainP->setShaderFile("shader_water.vert", false);
 	mainP->setShaderFile("shader.frag", true);
+	mainP->setResolveShaderFiles("shader_pass.vert", "shader_oit.frag");
 	mainP->SetDelegatePass(precameraP);	// We need the camera-transformed image in the FBO
 
 	vtkSmartPointer<vtkCameraPass> cameraP = vtkSmartPointer<vtkCameraPass>::New();
@@ -255,27 +272,23 @@ void aperio::slot_afterShowWindow()
 	//dofP->setShaderFile("shader_dof.frag", true);
 	//dofP->SetDelegatePass(cameraP);
 
-	// Requires Depth from camera pass
-	vtkSmartPointer<vtkMyImageProcessingPass> ssaoP = vtkSmartPointer<vtkMyImageProcessingPass>::New();
-	ssaoP->setShaderFile("shader_pass.vert", false);
-	ssaoP->setShaderFile("shader_ssao.frag", true);
-	ssaoP->SetDelegatePass(cameraP);
-
 	//vtkSmartPointer<vtkMyProcessingPass> dotP = vtkSmartPointer<vtkMyProcessingPass>::New();
 	//dotP->setShaderFile("shader_dot.frag", true);
 	//dotP->SetDelegatePass(ssaoP);
 
-	vtkSmartPointer<vtkMyImageProcessingPass> fxaaP = vtkSmartPointer<vtkMyImageProcessingPass>::New();
-	fxaaP->setShaderFile("shader_fxaa.vert", false);
-	fxaaP->setShaderFile("shader_fxaa.frag", true);
-	fxaaP->SetDelegatePass(ssaoP);
+	// Post-processing: scene is rendered once (G-buffer), SSAO (at reduced resolution) is upsampled
+	// into its colour ("source"), bloom runs at half resolution, and FXAA (adding the bloom) draws to screen
+	postP = vtkSmartPointer<vtkMyImageProcessingPass>::New();
+	postP->addStage("ao", "shader_pass.vert", "shader_ssao.frag", 1, VTK_FLOAT);	// Requires Depth from camera pass
+	postP->addStage("source", "shader_pass.vert", "shader_ssao_upsample.frag");
+	postP->addStage("bloom", "shader_pass.vert", "shader_bloom.frag", 2);
+	postP->setShaderFile("shader_fxaa.vert", false);
+	postP->setShaderFile("shader_fxaa.frag", true);
+	postP->SetDelegatePass(cameraP);
 
-	vtkSmartPointer<vtkMyImageProcessingPass> bloomP = vtkSmartPointer<vtkMyImageProcessingPass>::New();
-	bloomP->setShaderFile("shader_pass.vert", false);
-	bloomP->setShaderFile("shader_bloom.frag", true);
-	bloomP->SetDelegatePass(fxaaP);
+	setSSAOQuality(ssaoQuality);
 
-	vtkOpenGLRenderer::SafeDownCast(renderer.GetPointer())->SetPass(bloomP);
+	vtkOpenGLRenderer::SafeDownCast(renderer.GetPointer())->SetPass(postP);
 
 	// Render window interactor
 	vtkSmartPointer<QVTKInteractor> renderWindowInteractor = vtkSmartPointer<QVTKInteractor>::New();
@@ -308,6 +321,9 @@ void aperio::slot_afterShowWindow()
 	{
 		glew_available = true;
 		cout << "GLEW Initialized: " << glewGetString(GLEW_VERSION) << "\n";
+
+		culler.setOcclusionEnabled(true);	// Needs occlusion queries
+		postP->setDynamicResolution(true);	// Needs timer queries
 	}
 
 	//---- GLEW loaded (place all OpenGL calls after this line
@@ -334,6 +350,7 @@ void aperio::slot_afterShowWindow()
 	// ---- Custom Thread Timers
 	//connect(timer_explode, &QTimer::timeout, this, &aperio::slot_timer_explode);
 	connect(timer_highlight, &QTimer::timeout, this, &aperio::slot_timer_highlight);
+	connect(timer_prebuild, &QTimer::timeout, this, &aperio::slot_timeout_prebuild);
 
 	connect(ui.actionOpen, &QAction::triggered, this, &aperio::slot_open);
 	connect(ui.actionAppend, &QAction::triggered, this, &aperio::slot_append);
@@ -396,6 +413,22 @@ void aperio::slot_afterShowWindow()
 	connect(ui.hingeSlider, &QSlider::valueChanged, this, &aperio::slot_hingeSlider);
 	connect(ui.ringSlider, &QSlider::valueChanged, this, &aperio::slot_ringSlider);
 	connect(ui.rodSlider, &QSlider::valueChanged, this, &aperio::slot_rodSlider);
+
+	// Undo/redo. Slider changes (drag, click, keys, wheel) are recorded once the value settles
+	connect(new QShortcut(QKeySequence::Undo, this), &QShortcut::activated, this, &aperio::slot_undo);
+	connect(new QShortcut(QKeySequence::Redo, this), &QShortcut::activated, this, &aperio::slot_redo);
+
+	connect(timer_sliderChange, &QTimer::timeout, this, [=]()
+	{
+		if (!ui.ringSlider->isSliderDown() && !ui.rodSlider->isSliderDown() && !ui.hingeSlider->isSliderDown() &&
+			!ui.opacitySlider->isSliderDown())
+			flushSliderChanges();	// Otherwise recorded on release
+	});
+
+	for (auto slider : { ui.ringSlider, ui.rodSlider, ui.hingeSlider, ui.opacitySlider })
+		connect(slider, &QSlider::sliderReleased, this, &aperio::flushSliderChanges);
+
+	settleSliders();
 	connect(ui.chkFrontRibbons, &QCheckBox::toggled, this, &aperio::slot_chkFrontRibbons);
 
 	
@@ -992,7 +1025,6 @@ void aperio::slot_chkToroid(bool checked)
 	int i = myelems.size() - 1;
 	myelems[i]->source->SetToroidal(checked);
 	myelems[i]->source->Update();
-	myelems[i]->transformFilter->Update();		// Must update transformfilter for transforms to show
 	renderWindow->Render();
 }
 //--------------------------------------------------------------------------------------
@@ -1026,8 +1058,7 @@ void aperio::slot_thetaSlider(int value)
 
 		toolTip->source->SetThetaRoundness(roundness);
 		toolTip->source->Update();
-		toolTip->transformFilter->SetTransform(makeCompositeTransformFromSinglePoint(*toolTip));
-		toolTip->transformFilter->Update();
+		placeElem(toolTip, makeCompositeTransformFromSinglePoint(*toolTip));
 	}
 	else
 	{
@@ -1037,7 +1068,6 @@ void aperio::slot_thetaSlider(int value)
 
 		elem->source->SetThetaRoundness(roundness);
 		elem->source->Update();
-		elem->transformFilter->Update();		// Must update transformfilter for transforms to show
 	}
 	renderWindow->Render();
 }
@@ -1072,8 +1102,7 @@ void aperio::slot_taperSlider(int value)
 	{
 		toolTip->source->SetTaper(value / totalTaper);
 		toolTip->source->Update();
-		toolTip->transformFilter->SetTransform(makeCompositeTransformFromSinglePoint(*toolTip));
-		toolTip->transformFilter->Update();
+		placeElem(toolTip, makeCompositeTransformFromSinglePoint(*toolTip));
 
 		//if (toolTip->outline)
 //			toolTip->
@@ -1084,7 +1113,6 @@ void aperio::slot_taperSlider(int value)
 		int i = myelems.size() - 1;
 		myelems[i]->source->SetTaper(value / totalTaper);
 		myelems[i]->source->Update();
-		myelems[i]->transformFilter->Update();		// Must update transformfilter for transforms to show
 	}
 	renderWindow->Render();
 }
@@ -1105,15 +1133,13 @@ void aperio::slot_phiSlider(int value)
 	{
 		toolTip->source->SetPhiRoundness(value / roundnessScale);
 		toolTip->source->Update();
-		toolTip->transformFilter->SetTransform(makeCompositeTransformFromSinglePoint(*toolTip));
-		toolTip->transformFilter->Update();
+		placeElem(toolTip, makeCompositeTransformFromSinglePoint(*toolTip));
 	}
 	else
 	{
 		int i = myelems.size() - 1;
 		myelems[i]->source->SetPhiRoundness(value / roundnessScale);
 		myelems[i]->source->Update();
-		myelems[i]->transformFilter->Update();		// Must update transformfilter for transforms to show
 	}
 	renderWindow->Render();
 }
@@ -1134,15 +1160,13 @@ void aperio::slot_thicknessSlider(int value)
 	{
 		toolTip->source->SetThickness(value / thicknessScale);
 		toolTip->source->Update();
-		toolTip->transformFilter->SetTransform(makeCompositeTransformFromSinglePoint(*toolTip));
-		toolTip->transformFilter->Update();
+		placeElem(toolTip, makeCompositeTransformFromSinglePoint(*toolTip));
 	}
 	else
 	{
 		int i = myelems.size() - 1;
 		myelems[i]->source->SetThickness(value / thicknessScale);	// 0..1
 		myelems[i]->source->Update();
-		myelems[i]->transformFilter->Update();		// Must update transformfilter for transforms to show
 	}
 	renderWindow->Render();
 }
@@ -1276,6 +1300,9 @@ void aperio::slot_btnPlant()
 		toolTip->inverse = !toolTip->inverse;
 		
 
+	// Undo goes back to the last planted placement (or removes a new elem), and the meshes' paths before createPath
+	auto before = PlaceCommand::captureBefore(this, *toolTip);
+
 	if (toolTip->toolType == CUTTER)
 	{
 	}
@@ -1284,6 +1311,10 @@ void aperio::slot_btnPlant()
 		createPath();
 	}
 
+	auto plantedState = PlaceCommand::capture(this, *toolTip);
+	undoStack.push(make_shared<PlaceCommand>(toolTip, before, plantedState));
+	toolTip->plantedState = plantedState;
+
 	// Plant cutter - move elem to the end of vector (and set active toolTip back to nullptr)
 
 	auto elem = this->toolTip.lock();	
@@ -1385,6 +1416,9 @@ void aperio::slot_btnRestore()
 	if (parentMeshes.size() == 0 || selectedMeshes.size() == 0)
 		return;
 
+	// Cuts being restored can't be undone anymore
+	undoStack.clear();
+
 	for (auto &selectedMesh_wk : selectedMeshes)
 	{
 		auto selectedMesh = selectedMesh_wk.lock();
@@ -1632,6 +1666,11 @@ void aperio::slot_timeout_fps()
 
 	if (!pause)
 	{
+		// Animation (all pieces in one batch), then coalesced mouse move: one pick and tool update per frame, right before rendering
+		updateAnimation();
+		interactorstyle->updateInteraction();
+		updateProfiler();
+
 		if (realtimeupdate)
 			qv->update();
 		else
@@ -1642,8 +1681,130 @@ void aperio::slot_timeout_fps()
 	}
 }
 //-------------------------------------------------------------------------------------
+void aperio::updateProfiler()
+{
+	// Refresh about once a second
+	if (++profiler_frames < fps)
+		return;
+
+	profiler_frames = 0;
+
+	double latencyAvg, latencyMax;
+	int events, updates;
+	interactorstyle->getLatencyStats(latencyAvg, latencyMax, events, updates);
+
+	stringstream ss;
+	ss.precision(2);
+	ss << std::fixed << "Input latency: " << latencyAvg << " ms (max " << latencyMax << " ms), "
+		<< events << " moves / " << updates << " updates";
+
+	profiler_label->setText(ss.str().c_str());
+}
+//-------------------------------------------------------------------------------------
+void aperio::updateAnimation()
+{
+	double values[ANIM_CHANNELS];
+	bool active[ANIM_CHANNELS];
+
+	if (!animation.update(values, active))
+		return;
+
+	double explode = active[ANIM_EXPLODE] ? values[ANIM_EXPLODE] : ui.ringSlider->value();
+
+	// Leafing keeps each piece's path position, so set position first when both are animated
+	if (active[ANIM_LEAF])
+	{
+		if (active[ANIM_EXPLODE])
+			explodeSlide(animationPieces, explode);
+		explodeSlide(animationPieces, explode, values[ANIM_LEAF]);
+	}
+	else if (active[ANIM_EXPLODE])
+		explodeSlide(animationPieces, explode);
+
+	if (active[ANIM_HINGE])
+		hingeSlide(animationMeshes, values[ANIM_HINGE]);
+
+	// Keep sliders in sync (without re-running their slots)
+	QSlider *sliders[ANIM_CHANNELS] = { ui.ringSlider, ui.rodSlider, ui.hingeSlider };
+
+	for (int i = 0; i < ANIM_CHANNELS; i++)
+	{
+		if (!active[i])
+			continue;
+
+		sliders[i]->blockSignals(true);
+		sliders[i]->setValue((int)(values[i] + 0.5));
+		sliders[i]->blockSignals(false);
+	}
+	settleSliders();
+}
+//-------------------------------------------------------------------------------------
+void aperio::addAnimationKeyframe()
+{
+	double time = 0;
+	bool empty = !animation.hasKeys(ANIM_EXPLODE) && !animation.hasKeys(ANIM_LEAF) && !animation.hasKeys(ANIM_HINGE);
+
+	if (!empty)
+		time = animation.getDuration() + KEYFRAME_SPACING;
+	else
+	{
+		// Keyframes animate the pieces selected now, whatever is selected at playback
+		if (explodePiecesDirty)
+			buildExplodePieces();
+		animationPieces = explodePieces;
+
+		animationMeshes.clear();
+		for (auto &selectedMesh_wk : selectedMeshes)
+		{
+			auto selectedMesh = selectedMesh_wk.lock();
+
+			if (selectedMesh != nullptr && selectedMesh->generated)
+				animationMeshes.push_back(selectedMesh);
+		}
+	}
+
+	animation.addKeyframe(ANIM_EXPLODE, time, ui.ringSlider->value());
+
+	// Leaf and hinge are only keyed once used (unkeyed channels keep their slider values)
+	if (animation.hasKeys(ANIM_LEAF) || ui.rodSlider->value() != 0)
+		animation.addKeyframe(ANIM_LEAF, time, ui.rodSlider->value());
+	if (animation.hasKeys(ANIM_HINGE) || ui.hingeSlider->value() != 0)
+		animation.addKeyframe(ANIM_HINGE, time, ui.hingeSlider->value());
+
+	stringstream ss;
+	ss << "Keyframe added at " << time << " s";
+	print_statusbar(ss.str());
+}
+//-------------------------------------------------------------------------------------
+void aperio::toggleAnimation()
+{
+	if (animation.isPlaying())
+		animation.stop();
+	else
+		animation.play();
+}
+//-------------------------------------------------------------------------------------
+void aperio::clearAnimation()
+{
+	animation.clear();
+	animationPieces.clear();
+	animationMeshes.clear();
+}
+//-------------------------------------------------------------------------------------
+void aperio::setSSAOQuality(SSAOQuality quality)
+{
+	ssaoQuality = quality;
+
+	int downsample[] = { 1, 2, 4 };
+
+	postP->setStageDownsample("ao", downsample[quality]);
+	postP->setStageTemporal("ao", quality != SSAO_FULL);
+}
+//-------------------------------------------------------------------------------------
 void aperio::slot_chkDepthPeel(bool checked)
 {
+	// Exact (several passes) or weighted (one pass) order independent transparency
+	mainP->setTranslucencyMode(checked ? TRANSLUCENCY_DUAL_PEEL : TRANSLUCENCY_WEIGHTED);
 }
 //-------------------------------------------------------------------------------------
 void aperio::slot_chkSnapReal(bool checked)
@@ -1665,45 +1826,83 @@ static int lastringvalue;
 //----------------------------------------------------------------------------------------------
 void aperio::slot_ringSlider(int value)
 {
+	recordSliderChange(ui.ringSlider);
 	explodeSlide(value);
 }
 //----------------------------------------------------------------------------------------------
 void aperio::slot_rodSlider(int value)
 {
+	recordSliderChange(ui.rodSlider);
 	explodeSlide(ui.ringSlider->value(), value);
 }
 //----------------------------------------------------------------------------------------------
 void aperio::slot_hingeSlider(int value)
 {
-	return;
+	recordSliderChange(ui.hingeSlider);
+	hingeSlide(value);
+}
+//----------------------------------------------------------------------------------------------
+void aperio::hingeSlide(double value)
+{
+	float amount = ui.txtHingeAmount->text().toInt();
+	vector<shared_ptr<CustomMesh> > meshes;
 
-	if (selectedMeshes.size() == 0)
-		return;
+	for (auto &selectedMesh_wk : selectedMeshes)
+	{
+		auto selectedMesh = selectedMesh_wk.lock();
 
-	auto selectedMesh = selectedMeshes.back().lock();
+		if (selectedMesh == nullptr || !selectedMesh->generated)	//	Make sure selected & generated mesh (Rather than original mesh)
+			continue;
 
-	if (selectedMesh == nullptr || !selectedMesh->generated)	//	Make sure selected & generated mesh (Rather than original mesh)
-		return;
+		selectedMesh->hingeAmount = amount;
+		meshes.push_back(selectedMesh);
+	}
 
-	float angle = (value / 100.0) * ui.txtHingeAmount->text().toInt();
+	hingeSlide(meshes, value);
+}
+//----------------------------------------------------------------------------------------------
+void aperio::hingeSlide(const vector<shared_ptr<CustomMesh> > &meshes, double value)
+{
+	for (auto &mesh : meshes)
+	{
+		mesh->hingeAngle = (value / 100.0) * mesh->hingeAmount;
 
-	selectedMesh->hingeAngle = angle;
-	selectedMesh->hingeAmount = ui.txtHingeAmount->text().toInt();
+		// Keeps the explode/leaf position (hinge is combined with it, not written over it)
+		applyExplodeTransform(mesh.get());
+	}
+}
+//----------------------------------------------------------------------------------------------
+void aperio::applyExplodeTransform(CustomMesh *mesh)
+{
+	// Rotation around hinge pivot: x' = R (x - pivot) + pivot (generated meshes only)
+	double hinge[16];
+	vtkMatrix4x4::Identity(hinge);
 
-	vtkSmartPointer<vtkTransform> transform = vtkSmartPointer<vtkTransform>::New();
-	transform->PostMultiply();
-	transform->Translate( (-1 * selectedMesh->hingePivot).GetData() );
-	transform->RotateWXYZ(angle, selectedMesh->sforward.GetData());
-	transform->Translate(selectedMesh->hingePivot.GetData());
+	if (mesh->generated && mesh->hingeAngle != 0)
+	{
+		SetRotationMatrix4x4(hinge, vtkMath::RadiansFromDegrees(mesh->hingeAngle), mesh->sforward);
 
+		for (int r = 0; r < 3; r++)
+		{
+			hinge[r * 4 + 3] = mesh->hingePivot[r] - (hinge[r * 4 + 0] * mesh->hingePivot[0] +
+				hinge[r * 4 + 1] * mesh->hingePivot[1] + hinge[r * 4 + 2] * mesh->hingePivot[2]);
+		}
+	}
 
-	selectedMesh->actor->SetUserTransform(transform);
+	if (!mesh->explodeTransform)
+		mesh->explodeTransform = vtkSmartPointer<vtkTransform>::New();
 
-	// Update highlight
-	//interactorstyle->HighlightProp3D(selectedMesh->actor);
+	// Hinged at rest, then carried along the path
+	double matrix[16];
+	if (mesh->pathMoved)
+		vtkMatrix4x4::Multiply4x4(mesh->pathMatrix, hinge, matrix);
+	else
+		std::copy(hinge, hinge + 16, matrix);
 
-	QApplication::processEvents();
-	//}
+	mesh->explodeTransform->SetMatrix(matrix);
+
+	if (mesh->actor->GetUserTransform() != mesh->explodeTransform)
+		mesh->actor->SetUserTransform(mesh->explodeTransform);
 }
 //-------------------------------------------------------------------------------
 void aperio::slot_btnHide()
@@ -1711,6 +1910,9 @@ void aperio::slot_btnHide()
 	if (selectedMeshes.size() == 0)
 		return;
 
+	flushSliderChanges();
+	beginOpacityChange(selectedMeshes);
+
 	// If some selected meshes hidden and some shown, just make them all same (all hidden/shown)
 	bool allsame = true;
 	int lastopacity = selectedMeshes.back().lock()->opacity;
@@ -1756,6 +1958,143 @@ void aperio::slot_btnHide()
 		}
 	}
 	updateOpacitySliderAndList();
+
+	endOpacityChange();
+}
+//-------------------------------------------------------------------------------------
+void aperio::beginOpacityChange(const vector<weak_ptr<CustomMesh> > &changed)
+{
+	opacityChange.clear();
+
+	for (auto &mesh_wk : changed)
+	{
+		auto mesh = mesh_wk.lock();
+		if (!mesh)
+			continue;
+
+		OpacityCommand::Entry entry;
+		entry.mesh = mesh;
+		entry.opacity[0] = mesh->opacity;
+		entry.actorOpacity[0] = mesh->actor->GetProperty()->GetOpacity();
+		opacityChange.push_back(entry);
+	}
+}
+//-------------------------------------------------------------------------------------
+void aperio::endOpacityChange()
+{
+	bool changed = false;
+
+	for (auto &entry : opacityChange)
+	{
+		entry.opacity[1] = entry.mesh->opacity;
+		entry.actorOpacity[1] = entry.mesh->actor->GetProperty()->GetOpacity();
+		changed = changed || entry.opacity[1] != entry.opacity[0] || entry.actorOpacity[1] != entry.actorOpacity[0];
+	}
+
+	if (changed)
+		undoStack.push(make_shared<OpacityCommand>(opacityChange));
+
+	opacityChange.clear();
+}
+//-------------------------------------------------------------------------------------
+void aperio::recordSliderChange(QSlider *slider)
+{
+	if (syncingSliders || undoStack.isBusy())
+		return;
+
+	if (slider == ui.opacitySlider)
+	{
+		if (opacityChange.empty() && !selectedMeshes.empty())
+			beginOpacityChange({ selectedMeshes.back() });
+	}
+	else if (explodeChange.empty())
+		beginExplodeChange();
+
+	timer_sliderChange->start();	// Restarted by every change until the value settles
+}
+//-------------------------------------------------------------------------------------
+void aperio::flushSliderChanges()
+{
+	timer_sliderChange->stop();
+
+	endExplodeChange();
+	endOpacityChange();
+}
+//-------------------------------------------------------------------------------------
+void aperio::settleSliders()
+{
+	if (!explodeChange.empty())		// Pending change keeps the values it started from
+		return;
+
+	settledSliderValues[0] = ui.ringSlider->value();
+	settledSliderValues[1] = ui.rodSlider->value();
+	settledSliderValues[2] = ui.hingeSlider->value();
+}
+//-------------------------------------------------------------------------------------
+void aperio::beginExplodeChange()
+{
+	explodeChange.clear();
+
+	for (auto &mesh_wk : selectedMeshes)
+	{
+		auto mesh = mesh_wk.lock();
+		if (!mesh)
+			continue;
+
+		ExplodeCommand::Entry entry;
+		entry.mesh = mesh;
+		entry.capture(0);
+		explodeChange.push_back(entry);
+	}
+}
+//-------------------------------------------------------------------------------------
+void aperio::endExplodeChange()
+{
+	bool changed = false;
+
+	for (auto &entry : explodeChange)
+	{
+		entry.capture(1);
+		changed = changed || entry.changed();
+	}
+
+	if (changed)
+	{
+		QSlider *sliders[3] = { ui.ringSlider, ui.rodSlider, ui.hingeSlider };
+		vector<ExplodeCommand::SliderValue> values;
+
+		for (int i = 0; i < 3; i++)
+		{
+			ExplodeCommand::SliderValue value = { sliders[i], { settledSliderValues[i], sliders[i]->value() } };
+			values.push_back(value);
+		}
+		undoStack.push(make_shared<ExplodeCommand>(explodeChange, values));
+	}
+
+	explodeChange.clear();
+	settleSliders();
+}
+//-------------------------------------------------------------------------------------
+void aperio::slot_undo()
+{
+	flushSliderChanges();	// A change still settling is undone first
+
+	if (undoStack.undo(this))
+	{
+		settleSliders();
+		updateOpacitySliderAndList();
+	}
+}
+//-------------------------------------------------------------------------------------
+void aperio::slot_redo()
+{
+	flushSliderChanges();
+
+	if (undoStack.redo(this))
+	{
+		settleSliders();
+		updateOpacitySliderAndList();
+	}
 }
 //-------------------------------------------------------------------------------------
 void aperio::slot_txtHingeAmount(const QString &string)
@@ -1853,7 +2192,7 @@ void aperio::updateToroidal()
 	{
 		if (toolTip->toolType == CUTTER || toolTip->toolType == KNIFE)
 		{
-			makeOutline(toolTip);
+			makeOutline(toolTip, true);	// Tool may have changed, rebuild outline geometry
 		}
 		else
 		{
@@ -1953,6 +2292,7 @@ void aperio::updateOpacitySliderAndList()
 
 	if (lastSelectedMesh != nullptr)
 	{
+		syncingSliders = true;
 		ui.opacitySlider->setValue(lastSelectedMesh->opacity * 100);
 
 		//-- Update other sliders too (get hinging amount)
@@ -1962,8 +2302,14 @@ void aperio::updateOpacitySliderAndList()
 			float hingeAngle = lastSelectedMesh->hingeAngle;
 
 			ui.txtHingeAmount->setText(QString::number(hingeAmount));
+
+			// Display only (its slot would hinge every selected mesh by this mesh's angle)
+			ui.hingeSlider->blockSignals(true);
 			ui.hingeSlider->setValue((hingeAngle / hingeAmount) * 100.0);
+			ui.hingeSlider->blockSignals(false);
+			settleSliders();
 		}
+		syncingSliders = false;
 
 		// TODO
 		/*if (lastSelectedMesh->path && lastSelectedMesh->pathType == RING)
@@ -2001,8 +2347,10 @@ vtkSmartPointer<vtkTransform> aperio::makeCompositeTransform(MyElem &elem,
 	forward.Normalize();
 	elem.forward = forward;
 
-	// vtk does row-major matrix operations
-	vtkSmartPointer<vtkTransform> transform = vtkSmartPointer<vtkTransform>::New();
+	// vtk does row-major matrix operations (reuse elem's cached transform, SetMatrix below resets it)
+	vtkSmartPointer<vtkTransform> &transform = customScale ? elem.outlinePlacement : elem.placement;
+	if (transform == nullptr)
+		transform = vtkSmartPointer<vtkTransform>::New();
 
 	double elements3[16] = {
 		1, 0, 0, (elem.p1.point.GetX() + elem.p2.point.GetX()) / 2.0f,
@@ -2092,8 +2440,10 @@ vtkSmartPointer<vtkTransform> aperio::makeCompositeTransformFromSinglePoint(MyEl
 	right.Normalize();
 	elem.right = right;
 
-	// vtk does row-major matrix operations
-	vtkSmartPointer<vtkTransform> transform = vtkSmartPointer<vtkTransform>::New();
+	// vtk does row-major matrix operations (reuse elem's cached transform, SetMatrix below resets it)
+	vtkSmartPointer<vtkTransform> &transform = customScale ? elem.outlinePlacement : elem.placement;
+	if (transform == nullptr)
+		transform = vtkSmartPointer<vtkTransform>::New();
 
 	double elements3[16] = {
 		1, 0, 0, elem.p1.point.GetX(),
@@ -2168,6 +2518,7 @@ vtkSmartPointer<vtkTransform> aperio::makeCompositeTransformFromSinglePoint(MyEl
 		spinRight.Normalize();
 
 		// Determine closest obb axis (and sign)
+		selected->ensureOBB();
 		float dotOBB[3];
 		uint closestToRight;
 		dotOBB[0] = abs(spinRight.Dot(selected->axesOBB[0]));
@@ -2407,23 +2758,24 @@ void aperio::createtoolTipElement()
 		superquad->SetThickness(0.04);// this->ui.thicknessSlider->value() / this->thicknessScale);
 		superquad->Update();
 
+		// World space geometry is not generated here (only on demand, see MyElem::getWorldPolyData)
 		vtkSmartPointer<vtkTransformPolyDataFilter> transformFilter = vtkSmartPointer<vtkTransformPolyDataFilter>::New();
 		transformFilter->SetTransform(this->makeCompositeTransformFromSinglePoint(*toolTip));
 		transformFilter->SetInputData(superquad->GetOutput());
-		transformFilter->Update();
 
 		// Remove old actor from renderer (if exists)
 		if (toolTip->actor)
 			renderer->RemoveActor(toolTip->actor);
 
 		// TODO: superquad opacity
+		// Actor renders the source in its local frame, placed by its UserTransform
 		if (toolTip->toolType == RING || toolTip->toolType == ROD)
-			toolTip->actor = Utility::sourceToActor(this, transformFilter->GetOutput(), 1.0, 1.0, 1.0, 1.0);
+			toolTip->actor = Utility::sourceToActor(this, superquad->GetOutput(), 1.0, 1.0, 1.0, 1.0);
 		else
-			toolTip->actor = Utility::sourceToActor(this, transformFilter->GetOutput(), 1.0, 1.0, 1.0, 0.2);
+			toolTip->actor = Utility::sourceToActor(this, superquad->GetOutput(), 1.0, 1.0, 1.0, 0.2);
 
 		toolTip->actor->PickableOff();
-		toolTip->actor->SetUserMatrix(vtkSmartPointer<vtkMatrix4x4>::New());
+		toolTip->actor->SetUserTransform(toolTip->placement);
 		toolTip->source = superquad;
 		toolTip->transformFilter = transformFilter;
 	};
@@ -2485,13 +2837,12 @@ void aperio::createIncisionElement()
 	vtkSmartPointer<vtkTransformPolyDataFilter> transformFilter = vtkSmartPointer<vtkTransformPolyDataFilter>::New();
 	transformFilter->SetTransform(this->makeCompositeTransform(*elem));
 	transformFilter->SetInputData(superquad->GetOutput());
-	transformFilter->Update();
 
 	// TODO: superquad opacity
-	elem->actor = Utility::sourceToActor(this, transformFilter->GetOutput(), 1.0, 1.0, 1.0, 0.2);
+	elem->actor = Utility::sourceToActor(this, superquad->GetOutput(), 1.0, 1.0, 1.0, 0.2);
 	elem->actor->PickableOff();
 
-	elem->actor->SetUserMatrix(vtkSmartPointer<vtkMatrix4x4>::New());
+	elem->actor->SetUserTransform(elem->placement);
 	elem->source = superquad;
 	elem->transformFilter = transformFilter;
 
@@ -2562,6 +2913,10 @@ void aperio::updateSelectedMeshes()
 
 	updateOpacitySliderAndList();
 
+	// Selection changed, explode groups rebuilt on next slide
+	explodePieces.clear();
+	explodePiecesDirty = true;
+
 	showSelected();
 }
 //---------------------------------------------------------------------------------
@@ -2592,20 +2947,35 @@ void aperio::slice()
 	//auto selectedMesh = selectedMeshes.back().lock();
 	vector<string> newselectedmeshes;
 
+	// For undo: cut meshes (moved to parentMeshes) and their pieces
+	vector<shared_ptr<CustomMesh> > parents;
+	vector<shared_ptr<CustomMesh> > pieces;
+
 	for (auto &selectedMesh : selectedMeshes)
 	{
-		string newpiece = sliceInternal(selectedMesh);
+		auto parent = selectedMesh.lock();
+		string newpiece = sliceInternal(selectedMesh, &pieces);
 
 		if (newpiece == "`")	// Error occurred
 		{
 			break;
 		}
+		if (newpiece.empty())	// Mesh no longer exists, nothing was cut
+			continue;
+
 		newselectedmeshes.push_back(newpiece);
+
+		// Only a cut mesh (moved to parentMeshes) is restored by undo
+		if (parent && std::find(parentMeshes.begin(), parentMeshes.end(), parent) != parentMeshes.end())
+			parents.push_back(parent);
 	}
 
 	// Remove superquadric  (From renderer and myelems, including outline)
 	removeElem(elem);
 
+	if (!parents.empty())
+		undoStack.push(make_shared<CutCommand>(parents, pieces, elem));
+
 	// Set selected mesh to newly cut
 	clearSelectedMeshes();
 
@@ -2617,7 +2987,7 @@ void aperio::slice()
 
 }
 //----------------------------------------------------------------------------
-string aperio::sliceInternal(weak_ptr<CustomMesh> selectedMesh_wk)
+string aperio::sliceInternal(weak_ptr<CustomMesh> selectedMesh_wk, vector<shared_ptr<CustomMesh> > *pieces)
 {
 	auto selectedMesh = selectedMesh_wk.lock();
 
@@ -2637,7 +3007,7 @@ string aperio::sliceInternal(weak_ptr<CustomMesh> selectedMesh_wk)
 	vtkSmartPointer<vtkPolyData> meshpoly_r = vtkPolyData::SafeDownCast(selectedMesh->actor->GetMapper()->GetInput());
 	vtkSmartPointer<vtkPolyData> meshpoly = CarveConnector::cleanVtkPolyData(meshpoly_r, true);
 
-	vtkSmartPointer<vtkPolyData> elempoly_r = vtkPolyData::SafeDownCast(elem->actor->GetMapper()->GetInput());
+	vtkSmartPointer<vtkPolyData> elempoly_r = elem->getWorldPolyData();	// Materialize placed elem for CSG
 	vtkSmartPointer<vtkPolyData> elempoly = CarveConnector::cleanVtkPolyData(elempoly_r, true);
 
 	// Make MeshSet from vtkPolyData
@@ -2717,7 +3087,7 @@ string aperio::sliceInternal(weak_ptr<CustomMesh> selectedMesh_wk)
 			
 
 
-/*		vtkSmartPointer<vtkPolyData> obbpoly_r = vtkPolyData::SafeDownCast(selectedMesh->actorOBB->GetMapper()->GetInput());
+/*		vtkSmartPointer<vtkPolyData> obbpoly_r = vtkPolyData::SafeDownCast(selectedMesh->getActorOBB()->GetMapper()->GetInput());
 		vtkSmartPointer<vtkPolyData> obbpoly = obbpoly_r;// CarveConnector::cleanVtkPolyData(obbpoly_r, true);
 		unique_ptr<carve::mesh::MeshSet<3> > obb_carve(CarveConnector::vtkPolyDataToMeshSet(obbpoly_r));
 
@@ -2807,9 +3177,10 @@ string aperio::sliceInternal(weak_ptr<CustomMesh> selectedMesh_wk)
 		}		
 	}
 
-	// Create normals for resulting polydatas
-	vtkSmartPointer<vtkPolyData> dataset = Utility::computeNormals(c_poly);
-	vtkSmartPointer<vtkPolyData> datasetd = Utility::computeNormals(d_poly);
+	// Create normals for resulting polydatas (uncut surface keeps the mesh's normals, only the cut is recomputed).
+	// Normals come from the uncleaned mesh, cleaning merges the split copies of sharp edges
+	vtkSmartPointer<vtkPolyData> dataset = Utility::computeNormalsIncremental(c_poly, meshpoly_r);
+	vtkSmartPointer<vtkPolyData> datasetd = Utility::computeNormalsIncremental(d_poly, meshpoly_r);
 
 	// Run through list and see if name with + already exists, while it exists, add another +
 	// to generate unique name
@@ -2831,10 +3202,7 @@ string aperio::sliceInternal(weak_ptr<CustomMesh> selectedMesh_wk)
 		selectedMesh->color.GetGreen(),
 		selectedMesh->color.GetBlue());
 
-	// Add Meshes
-	vtkSmartPointer<vtkPolyData> finaldata = vtkSmartPointer<vtkPolyData>::New();
-	finaldata->DeepCopy(dataset);
-
+	// Add Meshes (results are new polydatas, no copy needed)
 	auto parent = selectedMesh;
 	
 	// SelectedMesh is NOT the root parent (meaning its parent is NOT nullptr)
@@ -2844,9 +3212,9 @@ string aperio::sliceInternal(weak_ptr<CustomMesh> selectedMesh_wk)
 		// - Doing this every cut ensures every mesh's parentMesh is always root parent.
 		parent = parent->parentMesh.lock();
 	}
-	auto mesh0 = Utility::addMesh(this, finaldata, name, color, 1.0, parent, selectedMesh).lock();
+	auto mesh0 = Utility::addMesh(this, dataset, name, color, 1.0, parent, selectedMesh).lock();
 	
-	/*mesh0->actorOBB->GetProperty()->SetOpacity(0.1);
+	/*mesh0->getActorOBB()->GetProperty()->SetOpacity(0.1);
 	mesh0->actorOBB->VisibilityOn();
 	renderer->AddActor(mesh0->actorOBB);*/
 
@@ -2854,11 +3222,8 @@ string aperio::sliceInternal(weak_ptr<CustomMesh> selectedMesh_wk)
 		std::min(color.GetGreen() + 0.1, 1.0),
 		std::min(color.GetBlue() + 0.1, 1.0));
 
-	vtkSmartPointer<vtkPolyData> finaldata2 = vtkSmartPointer<vtkPolyData>::New();
-	finaldata2->DeepCopy(datasetd);
-
 	// Add second actor (the cut piece) to renderer (as well as to meshes vector)
-	auto mesh = Utility::addMesh(this, finaldata2, name2, color, 1.0, parent, selectedMesh).lock();
+	auto mesh = Utility::addMesh(this, datasetd, name2, color, 1.0, parent, selectedMesh).lock();
 
 	mesh->generated = true;
 
@@ -2890,6 +3255,12 @@ string aperio::sliceInternal(weak_ptr<CustomMesh> selectedMesh_wk)
 	// Also set the hinge pivot point
 	mesh->hingePivot = elem->p1.point;	
 
+	if (pieces)
+	{
+		pieces->push_back(mesh0);
+		pieces->push_back(mesh);
+	}
+
 	// Finally Remove old mesh
 	//Utility::removeMesh(this, selectedMesh);
 	transferToParentMeshes(selectedMesh);
@@ -2903,18 +3274,88 @@ void aperio::transferToParentMeshes(shared_ptr<CustomMesh> mesh)
 
 	// Remove mesh from list, renderer and meshes vector
 	Utility::removeMesh(this, mesh);
+
+	// Parents are only kept for restoring: drop their GPU buffers and acceleration structures
+	mesh->actor->ReleaseGraphicsResources(renderWindow);
+	mesh->releaseAccel();
+
+	if (spillHistory)
+		mesh->spillGeometry();
 }
 //---------------------------------------------------------------------------------
 void aperio::transferToMeshes(shared_ptr<CustomMesh> parent)
 {
+	// Unreadable spill file: parent stays in history (spilled) rather than coming back empty
+	if (!parent->unspillGeometry())
+		return;
+
 	addToList(parent->name);
 	meshes.push_back(parent);
 	renderer->AddActor(parent->actor);
+	registerMeshLocator(parent);
 
 	// Remove from parentMeshes vector
 	removeParentMesh(parent);
 }
 //---------------------------------------------------------------------------------
+void aperio::registerMeshLocator(shared_ptr<CustomMesh> mesh)
+{
+	if (mesh->locatorRegistered)
+		return;
+
+	interactorstyle->cellPicker->AddLocator(mesh->getCellLocator());
+	mesh->locatorRegistered = true;
+}
+//---------------------------------------------------------------------------------
+void aperio::slot_timeout_prebuild()
+{
+	// Still building previous mesh
+	if (prebuildTask.valid())
+	{
+		if (prebuildTask.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			return;
+
+		prebuildTask.get();
+
+		// Picker is only touched on the main thread; mesh may have been cut or removed meanwhile
+		if (getMeshIterator(prebuildMesh) != meshes.end())
+			registerMeshLocator(prebuildMesh);
+
+		prebuildMesh = nullptr;
+	}
+
+	// Only prebuild while idle (no buttons held, i.e. no dragging/cutting in progress)
+	if (pause || QApplication::mouseButtons() != Qt::NoButton)
+		return;
+
+	// Visible meshes first, then hidden ones
+	for (int pass = 0; pass < 2 && !prebuildMesh; pass++)
+	{
+		for (auto &mesh : meshes)
+		{
+			bool visible = mesh->opacity > 0;
+
+			if (visible == (pass == 0) && !mesh->isAccelBuilt())
+			{
+				prebuildMesh = mesh;
+				break;
+			}
+		}
+	}
+
+	if (!prebuildMesh)
+		return;
+
+	// Worker holds its own reference so mesh outlives the build even if removed
+	auto mesh = prebuildMesh;
+	prebuildTask = std::async(std::launch::async, [mesh]()
+	{
+		mesh->getTriangleBVH();
+		mesh->getCellLocator();
+		mesh->ensureOBB();
+	});
+}
+//---------------------------------------------------------------------------------
 void aperio::removeParentMesh(weak_ptr<CustomMesh> it)
 {
 	auto todelete = find_if(parentMeshes.begin(), parentMeshes.end(), [=](shared_ptr<CustomMesh> &c) 
@@ -2991,39 +3432,6 @@ void aperio::addElem(weak_ptr<MyElem> it)
 
 	makeOutline(actualElem);
 
-	auto transformCallback = [=](vtkObject* caller, long unsigned int eventId, void* clientData, void* callData)
-	{
-		aperio *a = static_cast<aperio *>(clientData);
-		vtkTransformPolyDataFilter* trans = vtkTransformPolyDataFilter::SafeDownCast(caller);
-
-		auto elem_it = find_if(a->myelems.begin(), a->myelems.end(), [=](shared_ptr<MyElem> &e)
-		{ return e->transformFilter.GetPointer() == trans; });
-
-		if (elem_it != a->myelems.end())
-		{
-			auto elem = *elem_it;
-			a->makeOutline(elem);
-
-			// Make sure source scale parameters are > 0
-			float minval = 0.025;
-			if (elem->toolType == CUTTER)
-				minval = 0;
-
-			if (elem->scale.GetX() < minval)
-			{
-				elem->scale.SetX(minval);				
-			}
-			if (elem->scale.GetY() < minval)
-			{
-				elem->scale.SetY(minval);
-			}
-			if (elem->scale.GetZ() < minval)
-			{
-				elem->scale.SetZ(minval);
-			}
-		}
-	};
-
 	auto sourceCallback = [=](vtkObject* caller, long unsigned int eventId, void* clientData, void* callData)
 	{
 		aperio *a = static_cast<aperio *>(clientData);
@@ -3035,20 +3443,18 @@ void aperio::addElem(weak_ptr<MyElem> it)
 		if (elem_it != a->myelems.end())
 		{
 			auto elem = *elem_it;
-			a->makeOutline(elem);
+			a->makeOutline(elem, true);	// Source parameters changed, rebuild outline geometry
 		}
 	};
 
-	vtkSmartPointer<vtkCallbackCommand> callback1 = vtkSmartPointer<vtkCallbackCommand>::New();
-	callback1->SetClientData(this);
-	callback1->SetCallback(transformCallback);
-
+	// (Placement changes update the outline in placeElem)
 	vtkSmartPointer<vtkCallbackCommand> callback2 = vtkSmartPointer<vtkCallbackCommand>::New();
 	callback2->SetClientData(this);
 	callback2->SetCallback(sourceCallback);
 
-	actualElem->transformFilter->AddObserver(vtkCommand::ModifiedEvent, callback1);
-	actualElem->source->AddObserver(vtkCommand::ModifiedEvent, callback2);
+	// Only once (elem may be added again by undo/redo)
+	if (!actualElem->source->HasObserver(vtkCommand::ModifiedEvent))
+		actualElem->source->AddObserver(vtkCommand::ModifiedEvent, callback2);
 
 
 
@@ -3069,6 +3475,9 @@ void aperio::removeElem(weak_ptr<MyElem> it)
 
 		// Then erase from vector
 		myelems.erase(todelete);
+
+		explodePieces.clear();		// May reference elem
+		explodePiecesDirty = true;
 	}
 }
 //------------------------------------------------------------------------
@@ -3081,57 +3490,173 @@ void aperio::clearElems()
 	myelems.clear();
 }
 //----------------------------------------------------------------------------------------------
-void aperio::explodeSlide(int value, int leafvalue)
+void aperio::explodeSlide(double value, double leafvalue)
 {
 	if (selectedMeshes.empty())
 		return;
 
-	//int index = 0;
+	if (explodePiecesDirty)
+		buildExplodePieces();
+
+	explodeSlide(explodePieces, value, leafvalue);
+}
+//----------------------------------------------------------------------------------------------
+void aperio::explodeSlide(const vector<ExplodePiece> &pieces, double value, double leafvalue)
+{
+	for (auto &piece : pieces)
+		explodeSlideInternal(value, piece, leafvalue);
+}
+//----------------------------------------------------------------------------------------------
+void aperio::buildExplodePieces()
+{
+	explodePieces.clear();
 
 	std::map< shared_ptr<MyElem>, int> sizes;
-	std::map< shared_ptr<MyElem>, int> indices;
-	sizes.clear();
-	indices.clear();
 
 	for (auto &selectedMesh : selectedMeshes)
 	{
 		auto actualMesh = selectedMesh.lock();
-		auto elem = actualMesh->elem.lock();
+		if (!actualMesh)
+			continue;
 
-		if (elem != nullptr)
-			sizes[elem] = sizes[elem] + 1;
+		auto elem = actualMesh->elem.lock();
+		if (!elem)
+			continue;
+
+		// Index within elem's group (selectedMeshes are in path order after createPath)
+		ExplodePiece piece;
+		piece.mesh = actualMesh;
+		piece.elem = elem;
+		piece.index = sizes[elem]++;
+		explodePieces.push_back(piece);
+
+		if (!actualMesh->explodeTransform)
+			actualMesh->explodeTransform = vtkSmartPointer<vtkTransform>::New();
 	}
 
-	for (auto &selectedMesh : selectedMeshes)
+	for (auto &piece : explodePieces)
+		piece.size = sizes[piece.elem];
+
+	solveExplodeSpacing();
+
+	explodePiecesDirty = false;
+}
+//----------------------------------------------------------------------------------------------
+void aperio::solveExplodeSpacing()
+{
+	const int PARALLEL_THRESHOLD = 64;	// Pieces
+
+	int n = explodePieces.size();
+
+	// ---- Half extent of each piece's OBB along its path tangent (OBBs may still need building, so in parallel)
+	vector<double> halfExtents(n, 0);
+
+	auto computeExtents = [&](int begin, int end)
 	{
-		auto actualMesh = selectedMesh.lock();
-		auto elem = actualMesh->elem.lock();
+		for (int i = begin; i < end; i++)
+		{
+			auto &piece = explodePieces[i];
+			auto &path = piece.elem->path;
+			if (!path)
+				continue;
+
+			piece.mesh->ensureOBB();
+
+			double tangent[3];
+			path->getTangent(piece.mesh->path_order, tangent);
+
+			double h = 0;
+			for (int j = 0; j < 3; j++)
+			{
+				double axis[3] = { piece.mesh->axesOBB[j][0], piece.mesh->axesOBB[j][1], piece.mesh->axesOBB[j][2] };
+				h += fabs(vtkMath::Dot(axis, tangent)) * piece.mesh->extentsOBB[j] * 0.5;
+			}
+			halfExtents[i] = h;
+		}
+	};
+
+	Utility::parallelFor(n, PARALLEL_THRESHOLD, computeExtents);
+
+	// ---- Pieces are in path order: each one goes at least as far as its index spread, and far enough
+	// past the previous piece of its group that their extents along the path no longer overlap (in param units)
+	std::map< shared_ptr<MyElem>, int> previous;
+	std::map< shared_ptr<MyElem>, double> last;
+	vector<double> required(n, 0);		// Minimum spread past the previous piece of the group
+
+	for (int i = 0; i < n; i++)
+	{
+		auto &piece = explodePieces[i];
+		piece.spread = (piece.index + 1) / (double)piece.size;
 
-		if (elem != nullptr)
+		auto &path = piece.elem->path;
+		if (!path || path->getLength() <= 0)
+			continue;
+
+		auto prev = previous.find(piece.elem);
+		if (prev != previous.end())
 		{
-			explodeSlideInternal(value, actualMesh, leafvalue, indices[elem], sizes[elem]);
-			indices[elem] = indices[elem] + 1;
+			auto &prevPiece = explodePieces[prev->second];
+
+			double rest = piece.mesh->path_order - prevPiece.mesh->path_order;
+			double gap = (halfExtents[i] + halfExtents[prev->second]) / path->getLength() - rest;
+
+			required[i] = std::max(0.0, gap);
+			piece.spread = std::max(piece.spread, prevPiece.spread + required[i]);
 		}
-		
-		//index++;
+		previous[piece.elem] = i;
+		last[piece.elem] = piece.spread;
+	}
+
+	// ---- Keep each group on its path (end of rod, before ring wraps around): pieces past the end are
+	// pulled back from the last one, each keeping its required distance to the next, so no overlaps return
+	vector<double> solved(n);
+	std::map< shared_ptr<MyElem>, int> next;
+
+	for (int i = n - 1; i >= 0; i--)
+	{
+		auto &piece = explodePieces[i];
+		solved[i] = piece.spread;
+
+		if (last[piece.elem] <= 1.0)
+			continue;
+
+		auto nextPiece = next.find(piece.elem);
+		double limit = nextPiece != next.end() ? solved[nextPiece->second] - required[nextPiece->second] : 1.0;
+
+		solved[i] = std::min(piece.spread, limit);
+		next[piece.elem] = i;
+	}
+
+	for (int i = 0; i < n; i++)
+	{
+		auto &piece = explodePieces[i];
+		double maxSpread = last[piece.elem];
+
+		if (maxSpread <= 1.0)
+			continue;
+
+		// Path too short for the group's extents (its first piece would have to move backwards): spacing
+		// is best effort there, the whole group is scaled onto the path and pieces may overlap
+		if (solved[next[piece.elem]] < 0)
+			piece.spread = piece.spread / maxSpread;
+		else
+			piece.spread = solved[i];
 	}
 }
 //----------------------------------------------------------------------------------------------
-void aperio::explodeSlideInternal(int value, weak_ptr<CustomMesh> selectedMesh_wk, int leafvalue, int index, int size)
+void aperio::explodeSlideInternal(double value, const ExplodePiece &piece, double leafvalue)
 {
-	auto selectedMesh = selectedMesh_wk.lock();
-	
-	// Make sure elem still exists (not deleted already)
-	auto elem = selectedMesh->elem.lock();
-	if (!elem)	
-		return;
+	auto &selectedMesh = piece.mesh;
+	auto &elem = piece.elem;
+	int index = piece.index;
+	int size = piece.size;
 
 	// If leafing, and currently ring, don't do anything
 	if (leafvalue != NO_LEAFING && elem->toolType == RING)	
 		return;
 
 	// Make sure path generated for selected mesh
-	auto path = elem->path;
+	auto &path = elem->path;
 	if (!path)	
 		return;
 
@@ -3144,87 +3669,55 @@ void aperio::explodeSlideInternal(int value, weak_ptr<CustomMesh> selectedMesh_w
 		percent = (value / 100.0) * RING_PERCENT;
 	}
 
-	if (index != -1 && ui.chkSpread->checkState() == Qt::Checked)	// Using order to compute Spread
+	if (ui.chkSpread->checkState() == Qt::Checked)	// Using order (and piece extents, see solveExplodeSpacing) to compute Spread
 	{
-		percent = ((index + 1) / (double)size) * (value / 100.0);
+		percent = piece.spread * (value / 100.0);
 	}
 
-	int path_numpts = path->GetNumberOfPoints();
-	int idx = selectedMesh->path_pt;
-
-	vtkSmartPointer<vtkFloatArray> pathNormals = vtkFloatArray::SafeDownCast(path->GetPointData()->GetNormals());
-
-	double pt[3];
-	path->GetPoint(idx, pt);
-	double nm[3];
-	pathNormals->GetTuple(idx, nm);
+	// Continuous position on the analytic path (arc length parameter, no quantization)
+	double param = percent;
+	if (leafvalue != NO_LEAFING)		// If leafing, don't translate (keep old position)
+		param = selectedMesh->path_param;
 
-	int nextIdx = percent * path_numpts;
-	if (leafvalue != NO_LEAFING)		// If leafing, don't translate (set new index = old index/position)
-		nextIdx = idx;
-		 
-	if (nextIdx >= path_numpts)
+	if (param >= 1.0)
 	{
 		if (pathType == RING)	// Rings have start == end
-			nextIdx = 0;
+			param = 0;
 		else if (pathType == ROD)
-			nextIdx = path_numpts - 1;
+			param = 1.0;
 	}
 
+	double pt[3];
+	double nm[3];
+	path->evaluate(selectedMesh->path_param, pt, nm);
+
 	double nextpt[3];
-	path->GetPoint(nextIdx, nextpt);
 	double nextnm[3];
-	pathNormals->GetTuple(nextIdx, nextnm);
+	path->evaluate(param, nextpt, nextnm);
 
 	double init_pt[3];
-	path->GetPoint(0, init_pt);
+	double init_nm[3];
+	path->evaluate(0, init_pt, init_nm);
 
-	vtkSmartPointer<vtkTransform> transform = vtkSmartPointer<vtkTransform>::New();
-	transform->PostMultiply();
-	transform->Translate(-init_pt[0], -init_pt[1], -init_pt[2]);
+	// Matrix is composed directly (rotation R about init_pt, then translation to nextpt):
+	// x' = R (x - init) + next, written into the mesh's own transform (no allocation)
+	double matrix[16];
+	bool rotated = false;
 
 	// Rotations
 	if (leafvalue == NO_LEAFING)
 	{
 		if (selectedMesh->pathType == RING)
 		{
-			// Find the angle to change by
-			vtkVector3f nm_vec = vtkVector3f(nm[0], nm[1], nm[2]);
-			nm_vec.Normalize();
-			vtkVector3f nextnm_vec = vtkVector3f(nextnm[0], nextnm[1], nextnm[2]);
-			nextnm_vec.Normalize();
-
-			vtkVector3f tangent_vec = vtkVector3f(nextpt[0] - pt[0], nextpt[1] - pt[1], nextpt[2] - pt[2]);
-			tangent_vec.Normalize();
-
-			vtkVector3f bitangent_vec = nm_vec.Cross(tangent_vec);
-			bitangent_vec.Normalize();
-
-			//float anglechange = vtkMath::DegreesFromRadians(acosf(nm_vec.Dot(nextnm_vec)));
+			// Rotate around ring's axis (normal x tangent) by ratio of path completed
+			double bitangent[3];
+			path->getBinormal(bitangent);
 
-			// Figure out angle given ratio of path completed
-			double newangle = (nextIdx / (double)path_numpts) * 360.0;
+			selectedMesh->path_angle = param * 360.0;
+			selectedMesh->lastBitangent = vtkVector3f(bitangent[0], bitangent[1], bitangent[2]);
 
-			if (nextIdx < idx)
-				newangle = -newangle;
-
-			cout << newangle << "\n";
-			cout << idx << "," << nextIdx << "\n";
-			cout << bitangent_vec.GetX() << "\n";
-
-			if (idx == nextIdx)	// Same index, use last angle and bitangent
-			{
-				transform->RotateWXYZ(selectedMesh->path_angle, selectedMesh->lastBitangent.GetData());
-			}
-			else	// Different index, update angle and bitangent and rotate with new values
-			{
-				selectedMesh->path_angle = newangle;
-				selectedMesh->lastBitangent = bitangent_vec;
-
-				transform->RotateWXYZ(selectedMesh->path_angle, bitangent_vec.GetData());
-			}
-				
-		
+			SetRotationMatrix4x4(matrix, vtkMath::RadiansFromDegrees(selectedMesh->path_angle), selectedMesh->lastBitangent);
+			rotated = true;
 		}
 	}
 	else	// Leafing
@@ -3238,29 +3731,34 @@ void aperio::explodeSlideInternal(int value, weak_ptr<CustomMesh> selectedMesh_w
 
 			// Specific Leafing/Fanning Parameter
 			leafangle = -0.4 * leafpercent * (leafvalue / 100.0) * 360.0f;
-
-			cout << leafpercent << "\n";
 		}
 
 		if (selectedMesh->pathType == ROD)
-			transform->RotateWXYZ(leafangle, nm);
+		{
+			SetRotationMatrix4x4(matrix, vtkMath::RadiansFromDegrees(leafangle), vtkVector3f(nm[0], nm[1], nm[2]));
+			rotated = true;
+		}
 
 		selectedMesh->path_leafangle = leafangle;
 	}
-	transform->Translate(init_pt[0], init_pt[1], init_pt[2]);
-	transform->Translate(nextpt[0] - init_pt[0], nextpt[1] - init_pt[1], nextpt[2] - init_pt[2]);
 
-	if (nextIdx == 0 && leafvalue == NO_LEAFING)	// Reset at origin (only if not leafing)
-		transform->SetMatrix(vtkSmartPointer<vtkMatrix4x4>::New());
+	if (!rotated)
+		vtkMatrix4x4::Identity(matrix);
 
-	// Reset at end (only if its a ring since start == end) but NOT for rods
-	if (selectedMesh->pathType == RING && nextIdx == path_numpts)
-		transform->SetMatrix(vtkSmartPointer<vtkMatrix4x4>::New());
+	for (int r = 0; r < 3; r++)
+	{
+		matrix[r * 4 + 3] = nextpt[r] - (matrix[r * 4 + 0] * init_pt[0] + matrix[r * 4 + 1] * init_pt[1] + matrix[r * 4 + 2] * init_pt[2]);
+	}
+
+	// Reset at origin (only if not leafing), the hinge rotation is kept either way
+	selectedMesh->pathMoved = !(param == 0 && leafvalue == NO_LEAFING);
+	if (selectedMesh->pathMoved)
+		std::copy(matrix, matrix + 16, selectedMesh->pathMatrix);
 
-	selectedMesh->actor->SetUserTransform(transform);
+	applyExplodeTransform(selectedMesh.get());
 
-	// Finally, update path_pt index to nextIdx (for next time)
-	selectedMesh->path_pt = nextIdx;
+	// Finally, update path position (for next time)
+	selectedMesh->path_param = param;
 }
 //------------------------------------------------------------------------
 void aperio::setCursor(bool release)
@@ -3298,417 +3796,230 @@ void aperio::updateButtons(ToolType type)
 		ui.btnRod->setStyleSheet(highlighted_style);
 }
 //----------------------------------------------------------------------------------------------
-void aperio::createPath()
+shared_ptr<ToolPath> aperio::makeRodPath(shared_ptr<MyElem> elem)
 {
-	if (selectedMeshes.empty())	// return if no selectedMeshes
-		return;
-
-	for (auto &selectedMesh_wk : selectedMeshes)
-	{
-		auto selectedMesh = selectedMesh_wk.lock();
+	// Update up vector
+	placeElem(elem, makeCompositeTransformFromSinglePoint(*elem));
 
-		createPathInternal(selectedMesh);
-		// Path_IDs already set
-	}
+	// Need to transform up vector by tilt
+	auto getRodTransform = [](weak_ptr<MyElem> elem_wk) -> vtkSmartPointer<vtkTransform> {
+		auto elem = elem_wk.lock();
 
-	// Sort by ID (index in path polydata)
-	std::sort(selectedMeshes.begin(), selectedMeshes.end(), [](const weak_ptr<CustomMesh>& lhs, const weak_ptr<CustomMesh>& rhs)
-	{
-		return lhs.lock()->path_id < rhs.lock()->path_id;
-	});
+		vtkVector3f right = elem->right;
+		vtkVector3f up = elem->up;
+		vtkVector3f forward = elem->forward;
 
-	//showSelected();	
-}
-//----------------------------------------------------------------------------------------------
-void aperio::createPathInternal(weak_ptr<CustomMesh> selectedMesh_wk)
-{
-	// Always translate mesh to position 0 (at start, since intersection must
-	// be done with mesh at reset/rest position for visualization to be preserved
-	// a->selectedMesh->actor->SetUserTransform(vtkSmartPointer<vtkTransform>::New());
-	// (Actually might not need to) since UserMatrix doesn't affect point positions for polyintersections
+		float s = sin(elem->tilt);
+		float c = cos(elem->tilt);
+		float oc = 1.0 - c;
 
-	//int i = a->myelems.size() - 1;
-	//MyElem &elem = a->myelems.at(i);
-
-	auto toolTip = this->toolTip.lock();
+		double elementsTilt[16] = {
+			oc * right.GetX() * right.GetX() + c, oc * right.GetX() * right.GetY() - right.GetZ() * s, oc * right.GetZ() * right.GetX() + right.GetY() * s, 0,
+			oc * right.GetX() * right.GetY() + right.GetZ() * s, oc * right.GetY() * right.GetY() + c, oc * right.GetY() * right.GetZ() - right.GetX() * s, 0,
+			oc * right.GetZ() * right.GetX() - right.GetY() * s, oc * right.GetY() * right.GetZ() + right.GetX() * s, oc * right.GetZ() * right.GetZ() + c, 0,
+			0, 0, 0, 1
+		};
+		vtkSmartPointer<vtkTransform> transform = vtkSmartPointer<vtkTransform>::New();
+		transform->SetMatrix(elementsTilt);
+		transform->Update();
 
-	MyElem *elem = toolTip.get();
+		return transform;
+	};
 
-	if (elem->source == nullptr)
-		return;
+	// Total vector is norm. up vector (new one) multiplied by superquad's length; 0.5 is default vtkSuperquadric scale 
+	auto superquadlength = elem->scale.GetY();
+	vtkSmartPointer<vtkMatrix4x4> rodTransform = getRodTransform(elem)->GetMatrix();
 
-	auto selectedMesh = selectedMesh_wk.lock();
+	double newup[4] = { elem->up.GetX(), elem->up.GetY(), elem->up.GetZ(), 1};
+	rodTransform->MultiplyPoint(newup, newup);
+	vtkVector3f newup_vec = vtkVector3f(newup[0], newup[1], newup[2]);
 
-	// Make a path (polydata with lines) from points and normals
-	auto makePath = [](vtkSmartPointer<vtkPoints> points,
-		vtkSmartPointer<vtkFloatArray> points_normals) -> vtkSmartPointer < vtkPolyData > {
+	vtkVector3f total = newup_vec * superquadlength * 0.5;
 
-		vtkSmartPointer<vtkPolyData> poly = vtkSmartPointer<vtkPolyData>::New();
-		poly->SetPoints(points);
-		poly->SetLines(Utility::generateLinesFromPoints(points));
-		poly->GetPointData()->SetNormals(points_normals);
+	// Analytic line along the (tilted) up vector, normal is the rod direction
+	vtkVector3f endline = elem->p1.point + total;
 
-		return poly;
-	};
+	double lineP0[3] = { elem->p1.point.GetX(), elem->p1.point.GetY(), elem->p1.point.GetZ() };
+	double lineP1[3] = { endline.GetX(), endline.GetY(), endline.GetZ() };
+	double lineNormal[3] = { newup_vec.GetX(), newup_vec.GetY(), newup_vec.GetZ() };
 
-	// Copy a point at index (with normals) from poly into newPoints and newNormals
-	auto copyPoint = [](vtkSmartPointer<vtkPolyData> poly, int index,
-		vtkSmartPointer<vtkPoints> newPoints, vtkSmartPointer<vtkFloatArray> newNormals)
-	{
-		double pt[3];
-		poly->GetPoints()->GetPoint(index, pt);
+	auto path = make_shared<ToolPath>();
+	path->setLine(lineP0, lineP1, lineNormal);
 
-		double nm[3];
-		poly->GetPointData()->GetNormals()->GetTuple(index, nm);
+	return path;
+}
+//----------------------------------------------------------------------------------------------
+shared_ptr<ToolPath> aperio::makeToolPath(shared_ptr<MyElem> elem, shared_ptr<CustomMesh> snapMesh)
+{
+	if (elem->toolType == ROD)
+		return makeRodPath(elem);
 
-		newPoints->InsertNextPoint(pt);
-		newNormals->InsertNextTuple(nm);
-	};
+	// RING: make composite transform
+	vtkSmartPointer<vtkTransform> newtransform;
 
-	auto createID = [](vtkSmartPointer<vtkPolyData> path, shared_ptr<CustomMesh> selectedMesh)
+	if (snapToBBOX)
 	{
-		// Create IDs
-		vtkSmartPointer<vtkOctreePointLocator> octree = vtkSmartPointer<vtkOctreePointLocator>::New();
-		octree->SetDataSet(path);
-		octree->BuildLocator();
-		octree->Update();
-
-		selectedMesh->path_id = octree->FindClosestPoint(selectedMesh->center);
-	};
+		snapMesh->ensureOBB();
+		newtransform = makeCompositeTransformFromSinglePoint(*elem, snapMesh);
 
-	// --------------------------------------------------------------- ROD ---------------------------
-	if (toolTip->toolType == ROD)
+		placeElem(elem, newtransform);	// Update elem's transform
+	}
+	else
 	{
+		newtransform = makeCompositeTransformFromSinglePoint(*elem);
+	}
 
-		// Update up vector
-		elem->transformFilter->SetTransform(makeCompositeTransformFromSinglePoint(*elem));
-		elem->transformFilter->Update();
+	// Analytic ring (phi = 0 curve of the superquad) placed like the elem
+	auto path = make_shared<ToolPath>();
+	path->setRing(newtransform->GetMatrix(), elem->source->GetThetaRoundness(), elem->inverse);
 
-		// Need to transform up vector by tilt
-		auto getRodTransform = [](weak_ptr<MyElem> elem_wk) -> vtkSmartPointer<vtkTransform> {
-			auto elem = elem_wk.lock();
+	return path;
+}
+//----------------------------------------------------------------------------------------------
+void aperio::createPath()
+{
+	const int PARALLEL_THRESHOLD = 32;	// Meshes
 
-			vtkVector3f right = elem->right;
-			vtkVector3f up = elem->up;
-			vtkVector3f forward = elem->forward;
+	if (selectedMeshes.empty())	// return if no selectedMeshes
+		return;
 
-			float s = sin(elem->tilt);
-			float c = cos(elem->tilt);
-			float oc = 1.0 - c;
+	auto toolTip = this->toolTip.lock();
 
-			double elementsTilt[16] = {
-				oc * right.GetX() * right.GetX() + c, oc * right.GetX() * right.GetY() - right.GetZ() * s, oc * right.GetZ() * right.GetX() + right.GetY() * s, 0,
-				oc * right.GetX() * right.GetY() + right.GetZ() * s, oc * right.GetY() * right.GetY() + c, oc * right.GetY() * right.GetZ() - right.GetX() * s, 0,
-				oc * right.GetZ() * right.GetX() - right.GetY() * s, oc * right.GetY() * right.GetZ() + right.GetX() * s, oc * right.GetZ() * right.GetZ() + c, 0,
-				0, 0, 0, 1
-			};
-			vtkSmartPointer<vtkTransform> transform = vtkSmartPointer<vtkTransform>::New();
-			transform->SetMatrix(elementsTilt);
-			transform->Update();
+	if (!toolTip || !toolTip->source || (toolTip->toolType != ROD && toolTip->toolType != RING))
+		return;
 
-			return transform;
-		};
+	vector<shared_ptr<CustomMesh>> meshes;
+	for (auto &selectedMesh_wk : selectedMeshes)
+	{
+		auto selectedMesh = selectedMesh_wk.lock();
+		if (selectedMesh)
+			meshes.push_back(selectedMesh);
+	}
 
-		// Total vector is norm. up vector (new one) multiplied by superquad's length; 0.5 is default vtkSuperquadric scale 
-		auto superquadlength = elem->scale.GetY();
-		vtkSmartPointer<vtkMatrix4x4> rodTransform = getRodTransform(toolTip)->GetMatrix();
+	if (meshes.empty())
+		return;
 
-		double newup[4] = { elem->up.GetX(), elem->up.GetY(), elem->up.GetZ(), 1};
-		rodTransform->MultiplyPoint(newup, newup);
-		vtkVector3f newup_vec = vtkVector3f(newup[0], newup[1], newup[2]);
+	// ---- Shared stage: one path per tool (ring snaps to the current, last selected, mesh)
+	auto path = makeToolPath(toolTip, meshes.back());
+	toolTip->path = path;
 
-		vtkVector3f total = newup_vec * superquadlength * 0.5;
+	// Rod segment is the same for every mesh: intersect all meshes in one batch (their cached triangle BVHs)
+	vector<SceneBVHHit> hits;
+	if (toolTip->toolType == ROD)
+	{
+		double lineP0[3], lineP1[3], lineNormal[3];
+		path->evaluate(0, lineP0, lineNormal);
+		path->evaluate(1, lineP1, lineNormal);
 
-		/*Utility::plotSphere(this, elem->p1.point.GetX(), elem->p1.point.GetY(), elem->p1.point.GetZ(), 0.05);
-		Utility::plotSphere(this, elem->p1.point.GetX() + total.GetX(),
-		elem->p1.point.GetY() + total.GetY(),
-		elem->p1.point.GetZ() + total.GetZ(),
-		0.05);*/
+		SceneBVH::intersectSegment(meshes, lineP0, lineP1, hits);
+	}
 
-		// Generate 360 points for line (and normals, same as Ring Code)
-		vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+	// ---- Per-mesh stage (path is only read), in parallel for large selections
+	vector<double> entries(meshes.size());
 
-		vtkSmartPointer<vtkFloatArray> points_normals = vtkSmartPointer<vtkFloatArray>::New();
-		points_normals->SetNumberOfComponents(3);
+	Utility::parallelFor(meshes.size(), PARALLEL_THRESHOLD, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+			entries[i] = createPathInternal(meshes[i], toolTip, *path, hits.empty() ? nullptr : &hits[i]);
+	});
 
-		int path_numpts = 360;
+	// Ring starts where the current mesh enters it (start is moved, nothing is resampled), orders follow it
+	if (path->isClosed())
+	{
+		double start = entries.back();
+		path->setStart(start);
 
-		for (int i = 0; i < path_numpts; i++)
+		for (auto &mesh : meshes)
 		{
-			float percent = (i / (float)path_numpts);
-
-			vtkVector3f newPos = elem->p1.point + (total * percent);
-			vtkVector3f newNorm = newup_vec;
-
-			points->InsertNextPoint(newPos.GetData());
-			points_normals->InsertNextTuple(newNorm.GetData());
+			double order = mesh->path_order - start;
+			mesh->path_order = order - floor(order);
 		}
+	}
 
-		auto firstPath = makePath(points, points_normals);
-
-		elem->path = firstPath;
-
-		createID(elem->path, selectedMesh);
-
-		// Get intersection
-		vtkSmartPointer<vtkOBBTree> tree = vtkSmartPointer<vtkOBBTree>::New();
-		tree->SetDataSet(vtkPolyData::SafeDownCast(selectedMesh->actor->GetMapper()->GetInput()));
-		tree->BuildLocator();
-
-		// Intersect the locator with the line
-		vtkVector3f endline = elem->p1.point + total;
-
-		double lineP0[3] = { elem->p1.point.GetX(), elem->p1.point.GetY(), elem->p1.point.GetZ() };
-		double lineP1[3] = { endline.GetX(), endline.GetY(), endline.GetZ() };
-
-		vtkSmartPointer<vtkPoints> intersectPoints = vtkSmartPointer<vtkPoints>::New();
-		tree->IntersectWithLine(lineP0, lineP1, intersectPoints, nullptr);		
-
-		double center[3];
-		vtkIdType id;
+	// Sort by order (path parameter closest to each mesh's center), keys precomputed
+	vector<std::pair<double, shared_ptr<CustomMesh>>> keys;
+	keys.reserve(meshes.size());
 
-		if (intersectPoints->GetNumberOfPoints() > 0)	// Intersection
-		{
-			std::cout << "intersects";
-
-			intersectPoints->GetPoint(0, center);
+	for (auto &mesh : meshes)
+		keys.push_back(std::make_pair(mesh->path_order, mesh));
 
-			// Find nearest point to center of mass on path
-			vtkSmartPointer<vtkOctreePointLocator> octree = vtkSmartPointer<vtkOctreePointLocator>::New();
-			octree->SetDataSet(elem->path);
-			octree->BuildLocator();
+	std::stable_sort(keys.begin(), keys.end(), [](const std::pair<double, shared_ptr<CustomMesh>> &lhs, const std::pair<double, shared_ptr<CustomMesh>> &rhs)
+	{
+		return lhs.first < rhs.first;
+	});
 
-			id = octree->FindClosestPoint(center);
+	selectedMeshes.clear();
+	for (auto &key : keys)
+		selectedMeshes.push_back(key.second);
 
-			// Found initial point point (id), Generate new points array with reordered points 
-			// from previous point data (normals and points in previous poly)
+	// Elem groups and spread indices (in path order), so sliding doesn't recompute them
+	buildExplodePieces();
 
-			// (Transfer every point in poly AFTER id first, THEN transfer ones BEFORE id) 
-			// This means id is first point in new points array
-			vtkSmartPointer<vtkPoints> newPoints = vtkSmartPointer<vtkPoints>::New();
-			vtkSmartPointer<vtkFloatArray> newPoints_normals = vtkSmartPointer<vtkFloatArray>::New();
-			newPoints_normals->SetNumberOfComponents(3);
+	//showSelected();	
+}
+//----------------------------------------------------------------------------------------------
+double aperio::createPathInternal(shared_ptr<CustomMesh> selectedMesh, shared_ptr<MyElem> elem, const ToolPath &path, const SceneBVHHit *rodHit)
+{
+	// Always translate mesh to position 0 (at start, since intersection must
+	// be done with mesh at reset/rest position for visualization to be preserved
+	// (Actually might not need to) since UserMatrix doesn't affect point positions for polyintersections
 
-			for (int i = id; i < points->GetNumberOfPoints(); i++)
-				copyPoint(elem->path, i, newPoints, newPoints_normals);
-			for (int i = 0; i < id; i++)
-				copyPoint(elem->path, i, newPoints, newPoints_normals);
+	// Path uses mesh's OBB center/representation (built on first use)
+	selectedMesh->ensureOBB();
 
-			//for (int i = 0; i < points->GetNumberOfPoints(); i++)
-//				copyPoint(elem->path, i, newPoints, newPoints_normals);
+	selectedMesh->path_order = path.closestParameter(selectedMesh->center);
 
-			// Regenerate path (using new points) and Update elem's path and create actor 
-			//elem->path = makePath(newPoints, newPoints_normals);
-			elem->pathActor = Utility::sourceToActor(this, elem->path, 1, 1, 1, 1);
+	double center[3] = { 0, 0, 0 };
 
-			//renderer->AddActor(elem->pathActor);
+	// --------------------------------------------------------------- ROD ---------------------------
+	if (!path.isClosed())
+	{
+		// First intersection along the rod (computed in a batch by createPath), otherwise rod's start
+		if (rodHit && rodHit->hit)
+		{
+			std::copy(rodHit->point, rodHit->point + 3, center);
 		}
-		else	// No intersection
-		{			
+		else
+		{
+			double normal[3];
+			path.evaluate(0, center, normal);
 		}
-		//selectedMesh->path = elem->path;	// Reference/connect selectedMesh to path defined by elem
-		selectedMesh->path_pt = 0;
 
-		selectedMesh->path_initpt_exact = vtkVector3f(center[0], center[1], center[2]);
-		selectedMesh->path_angle = 0;
 		selectedMesh->pathType = ROD;
-
-		selectedMesh->elem = toolTip;
-		selectedMesh->elem.lock()->path = elem->path;
 	}
 	// --------------------------------------------------------------- RING ---------------------------
-	// TODO
-	else if (toolTip->toolType == RING)
+	else
 	{
-		float pi = vtkMath::Pi();
-		float step = pi / 180.0;
-
-		double dims[3] = { 0.5, 0.5, 0.5 };
-
-		vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
-
-		vtkSmartPointer<vtkFloatArray> points_normals = vtkSmartPointer<vtkFloatArray>::New();
-		points_normals->SetNumberOfComponents(3);
-
-		float t = -pi;
-		
-		if (elem->inverse)
-			t = pi;
-
-		for (int i = 0; i < 360; i++)
+		// Where the ring crosses the mesh's OBB (analytic clip of the path against the box)
+		double corner[3] = { selectedMesh->cornerOBB.GetX(), selectedMesh->cornerOBB.GetY(), selectedMesh->cornerOBB.GetZ() };
+		double extents[3] = { selectedMesh->extentsOBB.GetX(), selectedMesh->extentsOBB.GetY(), selectedMesh->extentsOBB.GetZ() };
+		double axes[3][3];
+		for (int i = 0; i < 3; i++)
 		{
-			if (elem->inverse)
-				t -= step;
-			else
-				t += step;
-
-			double pt[3];
-			double nm[3];
-
-			evalSuperquadric(t, 0.0, 0.0, 0.0, elem->source->GetThetaRoundness(),
-				elem->source->GetPhiRoundness(), dims, 0.0, pt, nm);
-
-			// Axis of symmetry is Y (evalsuperquad gives it in Z, so must swap Y and Z):
-			// Getting Y-Axis Of Symmetry
-			double tmp = pt[1];
-			pt[1] = pt[2];
-			pt[2] = tmp;
-			pt[0] = -pt[0];
-
-			tmp = nm[1];
-			nm[1] = nm[2];
-			nm[2] = tmp;
-			nm[0] = -nm[0];
-			
-			points->InsertNextPoint(pt[0], pt[1], pt[2]);
-			points_normals->InsertNextTuple(nm);
+			axes[i][0] = selectedMesh->axesOBB[i].GetX();
+			axes[i][1] = selectedMesh->axesOBB[i].GetY();
+			axes[i][2] = selectedMesh->axesOBB[i].GetZ();
 		}
 
-		auto firstPath = makePath(points, points_normals);
-
-		// Make composite transform
-		vtkSmartPointer<vtkTransform> newtransform;
-		
-		if (snapToBBOX)
-		{
-			newtransform = makeCompositeTransformFromSinglePoint(*elem, selectedMesh);
-
-			elem->transformFilter->SetTransform(newtransform);
-			elem->transformFilter->Update();	// Update elem's transform
-		}
-		else
+		if (path.intersectOBB(corner, axes, extents, center) == 0)	// No intersection, start nearest to center of OBB
 		{
-			newtransform = makeCompositeTransformFromSinglePoint(*elem);
-		}		
-		vtkSmartPointer<vtkTransformPolyDataFilter> transformFilter = vtkSmartPointer<vtkTransformPolyDataFilter>::New();
-		transformFilter->SetInputData(firstPath);
-		transformFilter->SetTransform(newtransform);
-		transformFilter->Update();
-
-		elem->path = transformFilter->GetOutput();
-		createID(elem->path, selectedMesh);
-
-		// Make tube version of path (simplified path for intersection test)
-		vtkSmartPointer<vtkTubeFilter> pathTube = vtkSmartPointer<vtkTubeFilter>::New();
-		pathTube->SetInputData(elem->path);
-		pathTube->SetRadius(0.01); //default is .5
-		pathTube->SetNumberOfSides(3);
-		pathTube->Update();
-
-		// Get intersection
-		vtkSmartPointer<vtkTriangleFilter> firstitem = vtkSmartPointer<vtkTriangleFilter>::New();
-		//firstitem->SetInputData(vtkPolyData::SafeDownCast(selectedMesh->actor->GetMapper()->GetInput()));
-		firstitem->SetInputData(vtkPolyData::SafeDownCast(selectedMesh->actorOBB->GetMapper()->GetInput()));
-		firstitem->Update();
-
-		vtkSmartPointer<vtkTriangleFilter> seconditem = vtkSmartPointer<vtkTriangleFilter>::New();
-		seconditem->SetInputData(vtkPolyData::SafeDownCast(pathTube->GetOutput()));
-		//seconditem->SetInputData(vtkPolyData::SafeDownCast(elem->transformFilter->GetOutput()));
-		seconditem->Update();
-
-		vtkSmartPointer<vtkIntersectionPolyDataFilter> inters = vtkSmartPointer<vtkIntersectionPolyDataFilter>::New();
-		inters->SetSplitFirstOutput(false);
-		inters->SetSplitSecondOutput(false);
-		inters->GlobalWarningDisplayOff();	// jacobi error (suppressing)
-		inters->SetInputData(0, firstitem->GetOutput());
-		inters->SetInputData(1, seconditem->GetOutput());
-		inters->Update();
-		inters->GlobalWarningDisplayOn();
-
-		vtkSmartPointer<vtkPolyData> intersection = inters->GetOutput();
-
-		double center[3] = {0, 0, 0};
-		vtkIdType id;
-
-		if (intersection->GetNumberOfPoints() > 0)	// Intersection
-		{
-			vtkSmartPointer<vtkCenterOfMass> centerOfMassFilter = vtkSmartPointer<vtkCenterOfMass>::New();
-			centerOfMassFilter->SetInputData(inters->GetOutput());
-			centerOfMassFilter->SetUseScalarsAsWeights(false);
-			centerOfMassFilter->Update();
-
-			centerOfMassFilter->GetCenter(center);
-
-			// Find nearest point to center of mass on path
-			vtkSmartPointer<vtkOctreePointLocator> octree = vtkSmartPointer<vtkOctreePointLocator>::New();
-			octree->SetDataSet(elem->path);
-			octree->BuildLocator();
-
-			id = octree->FindClosestPoint(center);
-
-			// Found initial point point (id), Generate new points array with reordered points 
-			// from previous point data (normals and points in previous poly)
-
-			// (Transfer every point in poly AFTER id first, THEN transfer ones BEFORE id) 
-			// This means id is first point in new points array
-			vtkSmartPointer<vtkPoints> newPoints = vtkSmartPointer<vtkPoints>::New();
-			vtkSmartPointer<vtkFloatArray> newPoints_normals = vtkSmartPointer<vtkFloatArray>::New();
-			newPoints_normals->SetNumberOfComponents(3);
-
-			for (int i = id; i < points->GetNumberOfPoints(); i++)
-				copyPoint(elem->path, i, newPoints, newPoints_normals);
-			for (int i = 0; i < id; i++)
-				copyPoint(elem->path, i, newPoints, newPoints_normals);
-
-			// Regenerate path (using new points) and Update elem's path and create actor 
-			elem->path = makePath(newPoints, newPoints_normals);
-			elem->pathActor = Utility::sourceToActor(this, elem->path, 1, 1, 1, 1);
-
-			//renderer->AddActor(elem->pathActor);
-			cout << "intersects";
-		}
-		else	// No intersection
-		{
-			cout << "No intersection\n";
-
-			// Find nearest point to (center of OBB?) on path
-			vtkSmartPointer<vtkOctreePointLocator> octree = vtkSmartPointer<vtkOctreePointLocator>::New();
-			octree->SetDataSet(elem->path);
-			octree->BuildLocator();
-
 			center[0] = selectedMesh->center[0];
 			center[1] = selectedMesh->center[1];
 			center[2] = selectedMesh->center[2];
-
-			id = octree->FindClosestPoint(center);
-
-			// Found initial point point (id), Generate new points array with reordered points 
-			// from previous point data (normals and points in previous poly)
-
-			// (Transfer every point in poly AFTER id first, THEN transfer ones BEFORE id) 
-			// This means id is first point in new points array
-			vtkSmartPointer<vtkPoints> newPoints = vtkSmartPointer<vtkPoints>::New();
-			vtkSmartPointer<vtkFloatArray> newPoints_normals = vtkSmartPointer<vtkFloatArray>::New();
-			newPoints_normals->SetNumberOfComponents(3);
-
-			for (int i = id; i < points->GetNumberOfPoints(); i++)
-				copyPoint(elem->path, i, newPoints, newPoints_normals);
-			for (int i = 0; i < id; i++)
-				copyPoint(elem->path, i, newPoints, newPoints_normals);
-
-			// Regenerate path (using new points) and Update elem's path and create actor 
-			elem->path = makePath(newPoints, newPoints_normals);
-			elem->pathActor = Utility::sourceToActor(this, elem->path, 1, 1, 1, 1);
-			//selectedMesh->path_initpt_exact = vtkVector3f()
 		}
 
-		selectedMesh->path_pt = 0;
-		
-		// Find nearest point to center of mass on path
-		//vtkSmartPointer<vtkOctreePointLocator> octree = vtkSmartPointer<vtkOctreePointLocator>::New();
-		//octree->SetDataSet(elem->path);
-		//octree->BuildLocator();
+		selectedMesh->pathType = RING;
+	}
 
-		//id = octree->FindClosestPoint(center);
-	
+	selectedMesh->path_param = 0;
 
-		selectedMesh->path_initpt_exact = vtkVector3f(center[0], center[1], center[2]);
-		selectedMesh->path_angle = 0;
-		selectedMesh->pathType = RING;
+	selectedMesh->path_initpt_exact = vtkVector3f(center[0], center[1], center[2]);
+	selectedMesh->path_angle = 0;
 
-		selectedMesh->elem = toolTip;
-		selectedMesh->elem.lock()->path = elem->path;
-	}
+	selectedMesh->elem = elem;
+
+	// Entry point on the path (ring's start is moved here for the current mesh)
+	return path.closestParameter(center);
 }
 //-----------------------------------------------------------------------------------
 void aperio::setWidgetSelectMode(bool mode)
@@ -3826,6 +4137,36 @@ void aperio::setWidgetSelectMode(bool mode)
 	//elem->outline = elem->actor;
 }*/
 
+//-------------------------------------------------------------------------------------------
+void aperio::placeElem(shared_ptr<MyElem> elem, vtkTransform *transform)
+{
+	// Only the actor's matrix changes, the tessellated source stays in its local frame
+	if (elem->actor && elem->actor->GetUserTransform() != transform)
+		elem->actor->SetUserTransform(transform);
+
+	// World space geometry is regenerated lazily (MyElem::getWorldPolyData)
+	elem->transformFilter->SetTransform(transform);
+
+	makeOutline(elem);
+
+	// Make sure source scale parameters are > 0
+	float minval = 0.025;
+	if (elem->toolType == CUTTER)
+		minval = 0;
+
+	if (elem->scale.GetX() < minval)
+	{
+		elem->scale.SetX(minval);
+	}
+	if (elem->scale.GetY() < minval)
+	{
+		elem->scale.SetY(minval);
+	}
+	if (elem->scale.GetZ() < minval)
+	{
+		elem->scale.SetZ(minval);
+	}
+}
 //-------------------------------------------------------------------------------------------
 void aperio::makeOutline(weak_ptr<MyElem> elem_wk, bool update)
 {
@@ -3834,48 +4175,52 @@ void aperio::makeOutline(weak_ptr<MyElem> elem_wk, bool update)
 	if (elem->toolType != CUTTER && elem->toolType != KNIFE)
 		return;
 
-	vtkSmartPointer<MySuperquadricSource> source = vtkSmartPointer<MySuperquadricSource>::New();
-	source->SetToroidal(true);
-	source->SetThickness(0.01);
-	source->SetThetaResolution(elem->source->GetThetaResolution());
-	source->SetPhiResolution(elem->source->GetPhiResolution());
-	source->SetThetaRoundness(elem->source->GetThetaRoundness());
-	source->SetPhiRoundness(elem->source->GetPhiRoundness());
+	// Outline geometry only rebuilt when elem's source changes (update), otherwise just re-placed
+	if (elem->outlineSource == nullptr || update)
+	{
+		if (elem->outlineSource == nullptr)
+			elem->outlineSource = vtkSmartPointer<MySuperquadricSource>::New();
 
-	if (elem->toolType == KNIFE || elem->toolType == CUTTER)
-		source->SetTaper(elem->source->GetTaper());
-	
-	source->Update();
+		vtkSmartPointer<MySuperquadricSource> source = elem->outlineSource;
+		source->SetToroidal(true);
+		source->SetThickness(0.01);
+		source->SetThetaResolution(elem->source->GetThetaResolution());
+		source->SetPhiResolution(elem->source->GetPhiResolution());
+		source->SetThetaRoundness(elem->source->GetThetaRoundness());
+		source->SetPhiRoundness(elem->source->GetPhiRoundness());
 
-	// Make composite transform
-	vtkSmartPointer<vtkTransformPolyDataFilter> transformFilter = vtkSmartPointer<vtkTransformPolyDataFilter>::New();
-	transformFilter->SetInputData(source->GetOutput());
+		if (elem->toolType == KNIFE || elem->toolType == CUTTER)
+			source->SetTaper(elem->source->GetTaper());
+
+		source->Update();
 
+		if (elem->outline)
+			elem->outline->GetMapper()->SetInputDataObject(source->GetOutput());
+	}
+
+	// Make composite transform (refills elem's outlinePlacement)
 	float Y = 15.0;
 
 	if (elem->toolType == CUTTER)
-		transformFilter->SetTransform(makeCompositeTransformFromSinglePoint(*elem, nullptr, true,
-		elem->scale.GetX(), Y, elem->scale.GetZ()));
+		makeCompositeTransformFromSinglePoint(*elem, nullptr, true,
+		elem->scale.GetX(), Y, elem->scale.GetZ());
 	else if (elem->toolType == KNIFE)
-		transformFilter->SetTransform(makeCompositeTransform(*elem, true,
-		elem->scale.GetX(), Y, elem->scale.GetZ()));
-
-	transformFilter->Update();
+		makeCompositeTransform(*elem, true,
+		elem->scale.GetX(), Y, elem->scale.GetZ());
 
 	if (elem->outline == nullptr)
 	{
-		elem->outline = Utility::sourceToActor(this, transformFilter->GetOutput());
+		elem->outline = Utility::sourceToActor(this, elem->outlineSource->GetOutput());
 		elem->outline->PickableOff();
+		elem->outline->SetUserTransform(elem->outlinePlacement);
 		renderer->AddActor(elem->outline);
-	}
-	else
-		elem->outline->GetMapper()->SetInputDataObject(transformFilter->GetOutput());
 
-	// Add outline key so shader knows
-	vtkSmartPointer<vtkInformation> information = vtkSmartPointer<vtkInformation>::New();
-	information->Set(vtkMyBasePass::OUTLINEKEY(), 0);	// dummy value
-	elem->outline->SetPropertyKeys(information);
-	elem->outline->GetProperty()->SetLineWidth(2.5);
+		// Add outline key so shader knows
+		vtkSmartPointer<vtkInformation> information = vtkSmartPointer<vtkInformation>::New();
+		information->Set(vtkMyBasePass::OUTLINEKEY(), 0);	// dummy value
+		elem->outline->SetPropertyKeys(information);
+		elem->outline->GetProperty()->SetLineWidth(2.5);
+	}
 }
 //-------------------------------------------------------------------------------------------
 void aperio::removeOutline(weak_ptr<MyElem> elem_wk)
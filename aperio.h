@@ -22,12 +22,22 @@ class vtkMyDepthPeelingPass;
 #include "Utility.h"
 #include "vtkMyShaderPass.h"
 #include "vtkMyPrePass.h"
+#include "vtkMyImageProcessingPass.h"
 #include "CarveConnector.h"
 #include "MySuperquadricSource.h"
+#include "SceneBVH.h"
+#include "VisibilityCuller.h"
+#include "UniformBlocks.h"
+#include "DrawList.h"
+#include "ToolPath.h"
+#include "ExplodeAnimation.h"
+#include "UndoStack.h"
 
 // QT Includes
 #include <QMessageBox>
 #include <QColorDialog>
+#include <QShortcut>
+#include <QTemporaryFile>
 
 // VTK Includes
 #include <QVTKWidget.h>
@@ -48,6 +58,9 @@ public:
 // Tool types
 typedef enum { CUTTER, KNIFE, ROD, RING, HINGE } ToolType;
 
+// SSAO resolution (reduced resolutions accumulate over frames)
+typedef enum { SSAO_FULL, SSAO_HALF, SSAO_QUARTER } SSAOQuality;
+
 
 
 ///-------------------------------------------------------------------------------------------
@@ -82,20 +95,38 @@ public:
 	 
 	vtkSmartPointer<vtkActor> actor;								// Superquadric actor
 	vtkSmartPointer<vtkActor> outline;								// Superquadric actor
-	vtkSmartPointer<MySuperquadricSource> source;					// the superquadric source
-	vtkSmartPointer<vtkTransformPolyDataFilter> transformFilter;	// the transform filter
+	vtkSmartPointer<MySuperquadricSource> source;					// the superquadric source (local frame, actor's input)
+	vtkSmartPointer<vtkTransformPolyDataFilter> transformFilter;	// world space geometry, only updated on demand (getWorldPolyData)
+
+	/// <summary> Placement (actor's UserTransform), refilled in place by makeCompositeTransform* </summary>
+	vtkSmartPointer<vtkTransform> placement;
+	/// <summary> Outline placement (custom scale) and its source (rebuilt only when source parameters change) </summary>
+	vtkSmartPointer<vtkTransform> outlinePlacement;
+	vtkSmartPointer<MySuperquadricSource> outlineSource;
 
 	vtkSmartPointer<vtkPlaneSource> planeSource;					// used to pick on when positioning elem in world
 	vtkSmartPointer<vtkActor> planeActor;
 
-	/// <summary> Superquad Path (on phi = 0) </summary>
-	vtkSmartPointer<vtkPolyData> path;
-	vtkSmartPointer<vtkActor> pathActor;
+	/// <summary> Superquad Path (on phi = 0), analytic line (ROD) or ring (RING) </summary>
+	shared_ptr<ToolPath> path;
+
+	/// <summary> Placement at last plant (for undo), null until first planted </summary>
+	shared_ptr<ElemState> plantedState;
 
 	/// <summary> Elem's CellLocator? (do we need it?) For speeding up raycast/picking (BuildLocator must be called with new Widget)_</summary>
 	vtkSmartPointer<vtkCellLocator> cellLocator;
 
 	vtkVector3f avgnormal;	// Average normals of sampled points?
+
+	//--------------------------------------------------------------------------------------------------
+	/// <summary> World space geometry (source with placement applied), for CSG and path operations.
+	/// Only re-executes when the source or placement changed since the last call
+	/// </summary>
+	vtkPolyData *getWorldPolyData()
+	{
+		transformFilter->Update();
+		return transformFilter->GetOutput();
+	}
 };
 
 ///---------------------------------------------------------------------------------------------
@@ -112,10 +143,10 @@ public:
 	vtkColor3f color;
 	/// <summary> Mesh's actor, contains Mapper->GetOutput() - vtkPolyData </summary>
 	vtkSmartPointer<vtkActor> actor;
-	/// <summary> Mesh's CellLocator, Important for speeding up raycast/picking (BuildLocator must be called with new CustomMesh)_</summary>
+	/// <summary> Mesh's CellLocator, Important for speeding up raycast/picking (built lazily, use getCellLocator)_</summary>
 	vtkSmartPointer<vtkCellLocator> cellLocator;
 
-	// Mesh's dimensions
+	// Mesh's dimensions (built lazily, call ensureOBB before reading)
 	double size[3];
 	double center[3];
 
@@ -128,9 +159,9 @@ public:
 	vtkVector3f hingePivot; // Superquadric initial position is hinge
 	
 	vtkVector3f path_initpt_exact;
-	int path_id;		// Sort by this (index in path polydata for closest intersection point)
+	double path_order;	// Sort by this (path parameter closest to mesh center)
 
-	int path_pt;		// Current point on path (index)
+	double path_param;	// Current position on path (arc length parameter, 0..1)
 	float path_angle = 0;
 	float path_leafangle = 0;
 	//vtkSmartPointer<vtkPolyData> path;	// Path mesh is connected to
@@ -140,7 +171,72 @@ public:
 	float hingeAmount;
 
 	vtkVector3f cornerOBB, axesOBB[3], sizeOBB;
-	vtkSmartPointer<vtkActor> actorOBB;
+	vtkVector3f extentsOBB;		// OBB edge lengths along (unit) axesOBB (sizeOBB holds the eigenvalues)
+	vtkSmartPointer<vtkActor> actorOBB;		// Made on first use, see getActorOBB
+	shared_ptr<MeshBVH> triangleBVH;		// Used by aperio's SceneBVH for picking
+
+	// ---- Lazily built acceleration structures (locator, OBB, center of mass)
+	// Geometry is only read here; building may happen on the main thread (first use) or on
+	// the idle prebuild thread, accelMutex guarantees each structure is built exactly once.
+
+	/// <summary> Geometry the acceleration structures are built from (set in Utility::addMesh) </summary>
+	vtkSmartPointer<vtkPolyData> accelSource;
+	std::mutex accelMutex;
+	bool locatorBuilt = false;
+	bool locatorRegistered = false;		// Added to the interactor's cellPicker (main thread only)
+	std::atomic<bool> obbBuilt{ false };	// Set last (after the OBB fields), read without the lock
+
+	//-------------------------------------------------------------------------------------------
+	/// <summary> Builds cell locator on first use (thread-safe), returns it </summary>
+	vtkSmartPointer<vtkCellLocator> getCellLocator();
+
+	//-------------------------------------------------------------------------------------------
+	/// <summary> Builds OBB (corner, axes, size) and center on first use (thread-safe) </summary>
+	void ensureOBB();
+
+	//-------------------------------------------------------------------------------------------
+	/// <summary> OBB as a (hidden, never added) actor, made on first use. Main thread only </summary>
+	vtkSmartPointer<vtkActor> getActorOBB();
+
+	//-------------------------------------------------------------------------------------------
+	/// <summary> Builds triangle BVH (local space) on first use (thread-safe), returns it </summary>
+	shared_ptr<MeshBVH> getTriangleBVH();
+
+	//-------------------------------------------------------------------------------------------
+	/// <summary> Drops locator, BVHs and OBB actor (rebuilt lazily if the mesh is used again) </summary>
+	void releaseAccel();
+
+	// ---- History (parent meshes): geometry can be spilled to a temp file until restored
+
+	/// <summary> Spilled geometry (file is removed with the mesh) </summary>
+	unique_ptr<QTemporaryFile> spillFile;
+	bool spilled = false;
+
+	//-------------------------------------------------------------------------------------------
+	/// <summary> Writes geometry (points, cells, point data) to a temp file and empties the polydata.
+	/// False (polydata untouched, no file kept) if any write fails </summary>
+	bool spillGeometry();
+
+	//-------------------------------------------------------------------------------------------
+	/// <summary> Reads spilled geometry back into the same polydata (no-op if not spilled).
+	/// False if the file can't be read back, the mesh then stays spilled </summary>
+	bool unspillGeometry();
+
+	//-------------------------------------------------------------------------------------------
+	/// <summary> Whether the OBB has been built (for readers that must not build it, e.g. culling).
+	/// Doesn't wait for a build running on the prebuild thread </summary>
+	bool isOBBBuilt() const
+	{
+		return obbBuilt.load(std::memory_order_acquire);
+	}
+
+	//-------------------------------------------------------------------------------------------
+	/// <summary> Whether all acceleration structures have been built (nothing left to prebuild) </summary>
+	bool isAccelBuilt()
+	{
+		std::lock_guard<std::mutex> lock(accelMutex);
+		return locatorBuilt && obbBuilt && triangleBVH;
+	}
 
 	// Reference to element
 	weak_ptr<MyElem> elem;
@@ -151,6 +247,12 @@ public:
 
 	vtkVector3f lastBitangent;
 
+	/// <summary> User transform written in place by explode and hinge (allocated once, see buildExplodePieces).
+	/// It is pathMatrix * hinge rotation, see aperio::applyExplodeTransform </summary>
+	vtkSmartPointer<vtkTransform> explodeTransform;
+	double pathMatrix[16];		// Explode/leaf part (valid if pathMoved, identity otherwise)
+	bool pathMoved = false;
+
 	// Custom properties
 	bool selected;
 };
@@ -172,6 +274,18 @@ public:
 	bool alreadygenerated = false;
 };
 
+//-----------------------------------------------------------------------------------------
+/// <summary> Selected mesh with a path, and its spread order within its elem's group (built by createPath)
+/// </summary>
+struct ExplodePiece
+{
+	shared_ptr<CustomMesh> mesh;
+	shared_ptr<MyElem> elem;
+	int index;		// Order along the elem's path (0..size-1)
+	int size;		// Number of selected meshes sharing the elem
+	double spread;	// Path parameter at full explode with spread (pieces' OBBs don't overlap along the path)
+};
+
 // ----------------------------------------------------------------------------------------
 /// <summary> Main window class
 /// </summary>
@@ -220,6 +334,9 @@ public:
 
 	vtkSmartPointer<vtkMyPrePass> preP;
 	vtkSmartPointer<vtkMyShaderPass> mainP;
+	vtkSmartPointer<vtkMyImageProcessingPass> postP;
+
+	SSAOQuality ssaoQuality = SSAO_HALF;
 
 	CustomTexture matcap;	
 
@@ -256,14 +373,56 @@ public:
 	/// <summary> Interactor style </summary>
 	vtkSmartPointer<MyInteractorStyle> interactorstyle;
 
+	/// <summary> Two-level BVH over meshes, used for mouse-move picking </summary>
+	SceneBVH sceneBVH;
+
+	/// <summary> Frustum/occlusion culling of meshes (updated once per frame by the shader pass) </summary>
+	VisibilityCuller culler;
+
+	/// <summary> Frame state and planted tools for the shaders (uploaded once per frame by the shader pass) </summary>
+	UniformBlocks uniformBlocks;
+
+	/// <summary> What each mesh/elem actor is this frame (rebuilt once per frame by the shader pass) </summary>
+	DrawList drawList;
+
 	/// <summary> Vector of CustomMesh objects </summary>
 	vector<shared_ptr<CustomMesh> > meshes;
 
 	/// <summary> Vector of Element objects </summary>
 	vector<shared_ptr<MyElem> > myelems;
 
-	/// <summary> Temporary area for placement of parent meshes </summary>
+	/// <summary> Temporary area for placement of parent meshes (kept without GPU/locator state, see transferToParentMeshes) </summary>
 	vector<shared_ptr<CustomMesh> > parentMeshes;
+	/// <summary> Whether parent meshes' geometry is spilled to temp files until restored </summary>
+	bool spillHistory = true;
+
+	/// <summary> Undo/redo of cuts, plants, explode and opacity (Ctrl+Z, Ctrl+Y) </summary>
+	UndoStack undoStack;
+	void slot_undo();
+	void slot_redo();
+
+	// Slider changes are recorded as one command, from the first value change until it settles
+	// (no change for SLIDER_SETTLE_MS, or slider released)
+	static const int SLIDER_SETTLE_MS = 500;
+	QTimer* timer_sliderChange;
+	bool syncingSliders = false;		// Sliders set to match the selection (not a change)
+	int settledSliderValues[3];			// Explode, leaf, hinge before the pending change
+	vector<ExplodeCommand::Entry> explodeChange;
+	vector<OpacityCommand::Entry> opacityChange;
+
+	/// <summary> Called by slider slots before they apply their value: starts recording a change </summary>
+	void recordSliderChange(QSlider *slider);
+	/// <summary> Pushes pending slider changes (explode, opacity) </summary>
+	void flushSliderChanges();
+	/// <summary> Explode/leaf/hinge slider values the next change starts from </summary>
+	void settleSliders();
+
+	/// <summary> Records selected meshes' path state before a change, endExplodeChange pushes the command </summary>
+	void beginExplodeChange();
+	void endExplodeChange();
+	/// <summary> Records meshes' opacity before a change, endOpacityChange pushes the command </summary>
+	void beginOpacityChange(const vector<weak_ptr<CustomMesh> > &changed);
+	void endOpacityChange();
 
 	/// <summary> Vector of SelectedMeshes objects (weak pointers - no ownership) </summary>
 	vector<weak_ptr<CustomMesh> > selectedMeshes;
@@ -285,6 +444,11 @@ public:
 	QTimer* timer_highlight;
 	clock_t timer_highlight_start;
 
+	// Idle prebuild of mesh acceleration structures (one mesh at a time on a worker thread)
+	QTimer* timer_prebuild;
+	std::future<void> prebuildTask;
+	shared_ptr<CustomMesh> prebuildMesh;
+
 	vtkSmartPointer<vtkTexture> texture;
 	bool texturedbackground = false;		// Will be toggled on first run
 
@@ -317,6 +481,32 @@ private:
 	/// <summary> Label located inside the statusbar </summary>
 	QLabel* status_label;
 
+	/// <summary> Profiler label (permanent, right side of statusbar), see updateProfiler </summary>
+	QLabel* profiler_label;
+	int profiler_frames = 0;
+
+	/// <summary> Updates profiler label with interaction stats (called every frame, refreshes about once a second) </summary>
+	void updateProfiler();
+
+	/// <summary> Keyframed explode/leaf/hinge animation (k: add keyframe from sliders, p: play/stop, l: clear) </summary>
+	ExplodeAnimation animation;
+	/// <summary> Pieces/hinged meshes the keyframes animate (selection at first keyframe, so playback doesn't follow later selection) </summary>
+	vector<ExplodePiece> animationPieces;
+	vector<shared_ptr<CustomMesh> > animationMeshes;
+	/// <summary> Seconds between keyframes added from the sliders </summary>
+	static double KEYFRAME_SPACING;
+
+	/// <summary> Applies current animation values to all pieces in one pass (called every frame) </summary>
+	void updateAnimation();
+	/// <summary> Adds keyframe with current slider values, after the last one </summary>
+	void addAnimationKeyframe();
+	void toggleAnimation();
+	/// <summary> Clears keyframes and the animated piece set </summary>
+	void clearAnimation();
+
+	/// <summary> Sets SSAO resolution (9 key cycles through them) </summary>
+	void setSSAOQuality(SSAOQuality quality);
+
 	/// Frame rate (frames per second)
 	float fps;
 
@@ -632,10 +822,15 @@ private:
 		// Update Shaders Periodically (so we can make real-time changes to shaders and reload) [Debugging Purposes!]
 		// Disable if graphics card heats up
 		//Utility::updateShader(pgm, "shader_water.vert", "shader.frag");
-		Utility::updateShader(preP->Program1, "shader_water.vert", "shader0.frag");
-		Utility::updateShader(mainP->Program1, "shader_water.vert", "shader.frag");
+		preP->reloadShaderFiles();
+		mainP->reloadShaderFiles();
 	}
 
+	// ------------------------------------------------------------------------
+	/// <summary> Slot called periodically, prebuilds one mesh's locator/OBB in the background while idle
+	/// </summary>
+	void slot_timeout_prebuild();
+
 	// ------------------------------------------------------------------------
 	/// <summary> Slot called as a thread to perform explosion (fps rate)
 	/// </summary>
@@ -759,6 +954,8 @@ private:
 		if (selectedMeshes.size() == 0)
 			return;
 
+		recordSliderChange(ui.opacitySlider);
+
 		//for (auto &selectedMesh_wk : selectedMeshes)
 		//{
 			//auto selectedMesh = selectedMesh_wk.lock();
@@ -810,7 +1007,8 @@ private:
 	// Public Methods ----------------------------------------------------------------------------------------------
 public:
 
-	/// <summary> Make composite transform matrix (translate, rotate, scale) from elem's points, normals and scale
+	/// <summary> Make composite transform matrix (translate, rotate, scale) from elem's points, normals and scale.
+	/// Refills and returns elem's cached placement (outlinePlacement if customScale), no allocation per call
 	/// </summary>
 	vtkSmartPointer<vtkTransform> makeCompositeTransform(MyElem &elem,
 		bool customScale = false,
@@ -833,6 +1031,11 @@ public:
 	float customScaleZ = 0);
 
 	
+	//--------------------------------------------------------------------------------------------------
+	/// <summary> Places elem with transform (actor matrix, no geometry is transformed), updates its outline
+	/// </summary>
+	void placeElem(shared_ptr<MyElem> elem, vtkTransform *transform);
+
 	void SetMatrix4x4(double *matrix4x4, vtkVector3f v0, vtkVector3f v1, vtkVector3f v2);
 	void SetRotationMatrix4x4(double *matrix4x4, float angle, vtkVector3f axis);
 	
@@ -1040,7 +1243,7 @@ public:
 	/// <summary> Slice element into two
 	/// </summary>
 	void slice();
-	string sliceInternal(weak_ptr<CustomMesh> selectedMesh_wk);	// Returns name of sliced elem in list
+	string sliceInternal(weak_ptr<CustomMesh> selectedMesh_wk, vector<shared_ptr<CustomMesh> > *pieces = nullptr);	// Returns name of sliced elem in list (and both pieces)
 
 	// ------------------------------------------------------------------------
 	/// <summary> Updates toroidal or not for the tooltip
@@ -1073,6 +1276,9 @@ public:
 	void removeElem(weak_ptr<MyElem> it);	// weak_ptr to item (can also be shared_ptr)
 	void clearElems();
 
+	// Builds mesh's cell locator (if needed) and adds it to the interactor's cellPicker (main thread only)
+	void registerMeshLocator(shared_ptr<CustomMesh> mesh);
+
 	// Forward key events from Aperio to QVTKWidget
 	virtual void keyPressEvent(QKeyEvent *) override;
 
@@ -1081,8 +1287,23 @@ public:
 	static double DEFAULT_TAPER;
 	static double DEFAULT_RODSIZE;
 
-	void explodeSlide(int value, int leafvalue = NO_LEAFING);
-	void explodeSlideInternal(int value, weak_ptr<CustomMesh> selectedMesh_wk, int leafvalue = NO_LEAFING, int index = -1, int size = -1);
+	// Values are percentages (continuous, so animation can evaluate in between slider steps)
+	void explodeSlide(double value, double leafvalue = NO_LEAFING);
+	void explodeSlide(const vector<ExplodePiece> &pieces, double value, double leafvalue = NO_LEAFING);
+	void explodeSlideInternal(double value, const ExplodePiece &piece, double leafvalue = NO_LEAFING);
+	/// <summary> Rotates selected generated meshes around their hinge (value: percent of hinge amount) </summary>
+	void hingeSlide(double value);
+	/// <summary> Rotates given generated meshes by value percent of their own hinge amount </summary>
+	void hingeSlide(const vector<shared_ptr<CustomMesh> > &meshes, double value);
+	/// <summary> Writes mesh's explodeTransform: hinge rotation (at rest position), then its path matrix </summary>
+	void applyExplodeTransform(CustomMesh *mesh);
+
+	/// <summary> Selected meshes in path order with their elem group index/size (rebuilt lazily when dirty) </summary>
+	vector<ExplodePiece> explodePieces;
+	bool explodePiecesDirty = true;
+	void buildExplodePieces();
+	/// <summary> Spread parameters of explodePieces: index spread, pushed apart by each piece's OBB extent along the path </summary>
+	void solveExplodeSpacing();
 
 	void setCursor(bool release);
 
@@ -1097,8 +1318,16 @@ public:
 	}
 	void updateButtons(ToolType type);
 
+	/// <summary> Builds the tool's path once, then each selected mesh's entry point and order (in parallel) </summary>
 	void createPath();
-	void createPathInternal(weak_ptr<CustomMesh> selectedMesh_wk);
+	/// <summary> Path of the tool (shared by all meshes), RING snaps to snapMesh if snapToBBOX </summary>
+	shared_ptr<ToolPath> makeToolPath(shared_ptr<MyElem> elem, shared_ptr<CustomMesh> snapMesh);
+	/// <summary> Per-mesh stage of createPath (thread-safe, path is only read). rodHit: ROD intersection computed in a batch
+	/// </summary>
+	/// <returns> Path parameter where the path enters the mesh </returns>
+	double createPathInternal(shared_ptr<CustomMesh> selectedMesh, shared_ptr<MyElem> elem, const ToolPath &path, const SceneBVHHit *rodHit);
+	/// <summary> Places ROD elem and returns its path (line along the tilted up vector) </summary>
+	shared_ptr<ToolPath> makeRodPath(shared_ptr<MyElem> elem);
 
 	void setWidgetSelectMode(bool mode);
 	void makeOutline(weak_ptr<MyElem> elem_wk, bool update = false);
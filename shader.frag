@@ -15,72 +15,84 @@ in vec4 vTexCoord;
 // Outputs
 layout(location = 0) out vec4 oColor;
 layout(location = 1) out vec4 oNormal;
-layout(location = 2) out vec4 oDepth;
-layout(location = 3) out vec4 oCapMask;
+layout(location = 2) out vec4 oCapMask;		// (Depth comes from the depth attachment)
 
 //--- Uniforms
 uniform vec2 frameBufSize = vec2(800, 600);
+uniform vec2 clipping = vec2(1, 100);		// Camera clipping range (near, far)
 
 //--- Shader variables
-uniform sampler2D depthSelectedF;
+uniform sampler2D depthSelectedF;		// Window depth (float, r), 1 = selected back face in front
 uniform sampler2D depthSelected;
 uniform sampler2D depthSQ;
 uniform sampler2D selectedColours;
 uniform sampler2D matcap;
 
-uniform bool toolTipOn = false;
-uniform bool cap = true;
-
-uniform bool active_elem = false;
-
+//--- Material/tool state: constants in specialized variants (defined per draw by vtkMyBasePass), else uniforms
+#ifdef SPECIALIZED
+const bool outline = OUTLINE;
+const bool iselem = ISELEM;
+const bool selected = SELECTED;
+const bool cutter = CUTTER;
+const int shadingnum = SHADINGNUM;
+#else
 uniform bool outline = false;
 uniform bool iselem = false;
-
 uniform bool selected = false;
-uniform bool previewer = true;
-uniform bool difftrans = true;
-
-uniform vec3 selectedColor = vec3(0.5, 0.5, 0.5);
-
-uniform vec3 mouse = vec3(0, 0, 0);
-uniform float mouseSize = 1.0;
-uniform float brushSize = 1.5;
-
-uniform int shadingnum = 0;
-uniform int shininess = 128;
-uniform float darkness = 1.0;
-
-uniform float time = 0.0;
-
-//--- Superquad data
-uniform vec3 pos1 = vec3(0, 0, 0);
-uniform vec3 pos2 = vec3(0, 0, 0);
-uniform vec3 norm1 = vec3(0, 0, 0);
-uniform vec3 norm2 = vec3(0, 0, 0);
-uniform vec3 scale = vec3(0, 0, 0);
-
-uniform vec3 right = vec3(0, 0, 0);
-uniform vec3 up      = vec3(0, 0, 0);
-uniform vec3 forward = vec3(0, 0, 0);
-uniform float angle = 0.0;
-uniform float tilt = 0.0;
-
-uniform float phi = 0.0;
-uniform float theta = 0.0;
-uniform float thickness = 0.4;
-uniform float taper = 0.0;
-
-uniform bool toroid = false;
 uniform bool cutter = true;
+uniform int shadingnum = 0;
+#endif
 
-uniform bool  ribbons         = false;
-uniform bool  frontRibbons    = true;
-uniform float ribbonWidth     = 0.2;
-uniform int   ribbonFrequency = 5;
-uniform float   ribbonTilt 	  = 0.1;
+//--- Frame state and planted tools (std140, same layout as UniformBlocks' FrameBlock/ToolBlock)
+layout(std140, binding = 0) uniform FrameState
+{
+	vec3 mouse;
+	float mouseSize;
+	vec3 selectedColor;
+	float brushSize;
+	float darkness;
+	float time;
+	int elemssize;			// Number of tools
+	int shininess;
+	bool previewer;
+	bool cap;
+	bool toolTipOn;
+	bool difftrans;
+};
+
+const int MAX_TOOLS = 64;
+
+struct Tool
+{
+	vec3 pos1;		float phi;
+	vec3 pos2;		float theta;
+	vec3 norm1;		float thickness;
+	vec3 norm2;		float taper;
+	vec3 scale;		float angle;
+	vec3 right;		float tilt;
+	vec3 up;		float ribbonWidth;
+	vec3 forward;	float ribbonTilt;
+	int ribbonFrequency;
+	bool cutter;
+	bool ribbons;
+	bool frontRibbons;
+	bool toroid;
+};
+
+layout(std140, binding = 1) uniform Tools
+{
+	Tool tools[MAX_TOOLS];
+};
 
+//--- Order independent transparency (translucent geometry only, same values as vtkMyShaderPass's OITStage)
+const int OIT_WEIGHTED = 1;
+const int OIT_DUAL_PEEL = 2;
 
-uniform int elemssize;
+uniform int oitMode = 0;			// 0 = blended in draw order
+uniform int peelPass = 0;			// Dual depth peeling pass (0 only finds the depth range)
+uniform sampler2D peelDepth;		// Previous pass: (-nearest, farthest) depth left to peel
+uniform sampler2D peelFront;		// Previous pass: front layers so far (premultiplied, a = coverage)
+uniform sampler2D opaqueDepth;		// Peeling has no depth test
 
 //--- Constant Light parameters
 const vec4 light_ambient = vec4(0.2, 0.2, 0.2, 1);
@@ -106,30 +118,18 @@ vec3 minnaert(vec3 L, vec3 n, float k, vec3 light_color)
 	float ndotl = max(0.0, dot(L, n));
 	return  light_color * pow(ndotl, k);
 }
-//------------------------------------------------
+//------------ Window depth to eye distance --------------
 float linearizeDepth(const in float depth) 
 {
-	float zNear = 1.0f;
-	float zFar = 100.0f;
-	//float zNear = 0.1f;
-	//float zFar = 1000.0f;
-	return (2.0 * zNear) / (zFar + zNear - depth * (zFar - zNear));
-}
-//------------------------------------------------
-vec3 PackFloat8bitRGB(float val) {
-    vec3 pack = vec3(1.0, 255.0, 65025.0) * val;
-    pack = fract(pack);
-    pack -= vec3(pack.yz / 255.0, 0.0);
-    return pack;
-}
-//------------------------------------------------
-float UnpackFloat8bitRGB(vec3 pack) {
-    return dot(pack, vec3(1.0, 1.0 / 255.0, 1.0 / 65025.0));
+	float zNear = clipping.x;
+	float zFar = clipping.y;
+	float z = depth * 2.0 - 1.0;
+	return (2.0 * zNear * zFar) / (zFar + zNear - z * (zFar - zNear));
 }
 //------------------------------------------------
 float getDepth(sampler2D sampler, vec2 uv)
 {
-	return linearizeDepth(UnpackFloat8bitRGB(texture(sampler, uv).rgb));
+	return linearizeDepth(texture(sampler, uv).r);
 }
 //---------------- Phong lighting (Directional) ----------------------
 void phongLighting(vec3 n, int shininess)
@@ -337,66 +337,69 @@ mat3 rotationMatrix(float angle, vec3 axis)
               oc * axis.z * axis.x - axis.y * s, oc * axis.y * axis.z + axis.x * s, oc * axis.z * axis.z + c); 
 }
 
-//---------------- Draw Superquad (Discard) ------------------------
-void superquad()
+//---------------- Cut by a Superquad tool (Discard) ---------------
+void superquad(const in Tool t)
 {
-	float dist = distance(pos1, pos2);
-	vec3  poss = original_v - (pos1 + pos2) / 2.0;
+	float dist = distance(t.pos1, t.pos2);
+	vec3  poss = original_v - (t.pos1 + t.pos2) / 2.0;
 	
-	mat3  rotMat = mat3(right, up, forward);
-	mat3  spinMat = rotationMatrix(-angle,up);
-	mat3  pitchMat = rotationMatrix(-tilt,right);
+	mat3  rotMat = mat3(t.right, t.up, t.forward);
+	mat3  spinMat = rotationMatrix(-t.angle,t.up);
+	mat3  pitchMat = rotationMatrix(-t.tilt,t.right);
 
-	vec3 forwardSpin = spinMat * forward;
-	mat3 tiltMat = rotationMatrix(ribbonTilt,forwardSpin);
-	vec3 rightspin1 = spinMat * right;
+	vec3 forwardSpin = spinMat * t.forward;
+	mat3 tiltMat = rotationMatrix(t.ribbonTilt,forwardSpin);
+	vec3 rightspin1 = spinMat * t.right;
 	vec3 rightspin = tiltMat * rightspin1;
 			
-    vec3 cp = (pos1+pos2)/2.0;
+    vec3 cp = (t.pos1+t.pos2)/2.0;
 	
 	//mat3 rotMat = rotMati * spinMat;
 
 	float val = 0;
 	
-	if (cutter)
-	{
-		poss = inverse(spinMat) * poss;
-		poss = inverse(rotMat) * poss;
-		poss = poss / (scale * 0.5);
+	poss = inverse(spinMat) * poss;
+	poss = inverse(rotMat) * poss;
+	poss = poss / (t.scale * 0.5);
+
+	//poss =  inverse(rotMat) *( poss) / (scale * 0.5);
+	val = pow((pow(abs(poss.z), 2.0/t.theta) + pow(abs(poss.x), 2.0/t.theta)), t.theta/t.phi) + pow(abs(poss.y),2.0/t.phi) - 1.0;
 	
-	    //poss =  inverse(rotMat) *( poss) / (scale * 0.5);
-		val = pow((pow(abs(poss.z), 2.0/theta) + pow(abs(poss.x), 2.0/theta)), theta/phi) + pow(abs(poss.y),2.0/phi) - 1.0;
-		
-		if (selected)	// if selected
+	if (val < 0)
+	{			
+	    if (t.ribbons)
 		{
-			//final_color = vec4(1, 1, 1, 1);
-
-			//final_color = vec4(1, 1, 1, 1);
-			if (val < 0 && elemssize > 0)
-			{			
-			    if (ribbons)
+			if (fract(dot((original_v-cp), rightspin)*t.ribbonFrequency) - t.ribbonWidth < 0)
+			{
+				if (!gl_FrontFacing)
 				{
-					if (fract(dot((original_v-cp), rightspin)*ribbonFrequency) - ribbonWidth < 0)
-					{
-						if (!gl_FrontFacing)
-						{
-							if (frontRibbons)
-								final_color.rgb = final_color.rgb;
-							else
-								discard;
-						}
-						else
-							final_color.rgb = final_color.rgb * 1.25;
-					}
+					if (t.frontRibbons)
+						final_color.rgb = final_color.rgb;
 					else
 						discard;
 				}
-				else if (previewer)
-					discard;
 				else
-					final_color = final_color * 1.5;
+					final_color.rgb = final_color.rgb * 1.25;
 			}
+			else
+				discard;
 		}
+		else if (previewer)
+			discard;
+		else
+			final_color = final_color * 1.5;
+	}
+}
+//---------------- Selected meshes are cut by all cutters ----------
+void superquad()
+{
+	if (!selected)
+		return;
+
+	for (int i = 0; i < elemssize; i++)
+	{
+		if (tools[i].cutter)
+			superquad(tools[i]);
 	}
 }
 void RimLight()
@@ -441,9 +444,87 @@ void SEM()
 	oColor = vec4(final, 1.0);
 }
 
+//**************** Dual depth peeling (before shading) *************
+// Outputs are max blended: oColor = depth range for the next pass,
+// oNormal = front layers, oCapMask = back layer. True if not shaded this pass
+vec4 peelFrontColour;
+float peelNearest, peelFarthest;
+
+bool peel()
+{
+	vec2 texpos = vec2(gl_FragCoord.x / frameBufSize.x, gl_FragCoord.y / frameBufSize.y);
+	float z = gl_FragCoord.z;
+
+	if (z >= texture(opaqueDepth, texpos).r)
+		discard;
+
+	oColor = vec4(-1, -1, 0, 0);
+	oNormal = vec4(0);
+	oCapMask = vec4(0);
+
+	if (peelPass == 0)
+	{
+		oColor = vec4(-z, z, 0, 0);
+		return true;
+	}
+
+	vec2 range = texture(peelDepth, texpos).rg;
+	peelNearest = -range.x;
+	peelFarthest = range.y;
+
+	peelFrontColour = texture(peelFront, texpos);
+	oNormal = peelFrontColour;
+
+	if (z < peelNearest || z > peelFarthest)		// Peeled already
+		return true;
+
+	if (z > peelNearest && z < peelFarthest)		// Later pass
+	{
+		oColor = vec4(-z, z, 0, 0);
+		return true;
+	}
+	return false;
+}
+
+//**************** Dual depth peeling (after shading) **************
+void peelOutput()
+{
+	vec4 colour = oColor;
+
+	oColor = vec4(-1, -1, 0, 0);
+	oNormal = peelFrontColour;
+	oCapMask = vec4(0);
+
+	if (gl_FragCoord.z == peelNearest)		// Front to back under the front layers
+	{
+		float alphaMultiplier = 1.0 - peelFrontColour.a;
+
+		oNormal.rgb += colour.rgb * colour.a * alphaMultiplier;
+		oNormal.a = 1.0 - alphaMultiplier * (1.0 - colour.a);
+	}
+	else									// Farthest, blended back to front by the shader pass
+		oCapMask = colour;
+}
+
+//**************** Weighted blended OIT (McGuire & Bavoil) *********
+// oColor = weighted premultiplied colour (summed), oNormal = alpha (revealage *= 1 - alpha)
+void weightedOutput()
+{
+	float alpha = oColor.a;
+	float z = gl_FragCoord.z;
+	float w = clamp(pow(min(1.0, alpha * 10.0) + 0.01, 3.0) * 1e8 * pow(1.0 - z * 0.9, 3.0), 1e-2, 3e3);
+
+	oColor = vec4(oColor.rgb * alpha, alpha) * w;
+	oNormal = vec4(alpha);
+	oCapMask = vec4(0);
+}
+
 //******************* Main **************************************
 void main()
 {
+	if (oitMode == OIT_DUAL_PEEL && peel())
+		return;
+
 	newN = n;
 	
 	if (!gl_FrontFacing)
@@ -504,6 +585,9 @@ void main()
 	// Encode normals to second texture (sourceNormal)
 	vec3 encodedN = newN * 0.5 + 0.5;
 	oNormal = vec4(encodedN, 1);
-	
-	oDepth = vec4(PackFloat8bitRGB(gl_FragCoord.z), 1);
+
+	if (oitMode == OIT_WEIGHTED)
+		weightedOutput();
+	else if (oitMode == OIT_DUAL_PEEL)
+		peelOutput();
 }
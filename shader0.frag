@@ -10,7 +10,7 @@ smooth in vec3 n;
 smooth in vec3 v;
 smooth in vec3 original_v;
 
-// Output fragments
+// Output fragments (depths are written unpacked, attachments are single channel float)
 layout(location = 0) out vec4 o_depthSelectedF;
 layout(location = 1) out vec4 o_depthSelected;
 layout(location = 2) out vec4 o_depthSQ;
@@ -19,51 +19,57 @@ layout(location = 3) out vec4 o_selectedColours;
 // Uniforms
 uniform vec2 frameBufSize;
 
+// Constants in specialized variants (defined per draw by vtkMyBasePass), else uniforms
+#ifdef SPECIALIZED
+const bool selected = SELECTED;
+const bool iselem = ISELEM;
+const bool cutter = CUTTER;
+#else
 uniform bool selected = false;
 uniform bool iselem = false;
-
-// Superquad data
-uniform vec3 pos1 = vec3(0, 0, 0);
-uniform vec3 pos2 = vec3(0, 0, 0);
-uniform vec3 norm1 = vec3(0, 0, 0);
-uniform vec3 norm2 = vec3(0, 0, 0);
-uniform vec3 scale = vec3(0, 0, 0);
-
-uniform vec3 right = vec3(0, 0, 0);
-uniform vec3 up      = vec3(0, 0, 0);
-uniform vec3 forward = vec3(0, 0, 0);
-uniform float angle = 0.0;
-uniform float tilt = 0.0;
-
-uniform float phi = 0.0;
-uniform float theta = 0.0;
-uniform float thickness = 0.4;
-uniform bool toroid = false;
 uniform bool cutter = true;
+#endif
 
-uniform int elemssize;
-
-//------------------------------------------------
-vec3 PackFloat8bitRGB(float val) {
-    vec3 pack = vec3(1.0, 255.0, 65025.0) * val;
-    pack = fract(pack);
-    pack -= vec3(pack.yz / 255.0, 0.0);
-    return pack;
-}
-//------------------------------------------------
-float UnpackFloat8bitRGB(vec3 pack) {
-    return dot(pack, vec3(1.0, 1.0 / 255.0, 1.0 / 65025.0));
-}
-//------------ Linearize Depth ------------------------
-float LinearizeDepth(float depth)
+//--- Frame state and planted tools (std140, same layout as UniformBlocks' FrameBlock/ToolBlock)
+layout(std140, binding = 0) uniform FrameState
 {
-  float n = 1.0; // camera z near
-  float f = 100.0; // camera z far
-  //float n = 0.1; // camera z near
-  //float f = 1000.0; // camera z far
-  float z = depth;
-  return (2.0 * n) / (f + n - z * (f - n));	
-}
+	vec3 mouse;
+	float mouseSize;
+	vec3 selectedColor;
+	float brushSize;
+	float darkness;
+	float time;
+	int elemssize;			// Number of tools
+	int shininess;
+	bool previewer;
+	bool cap;
+	bool toolTipOn;
+	bool difftrans;
+};
+
+const int MAX_TOOLS = 64;
+
+struct Tool
+{
+	vec3 pos1;		float phi;
+	vec3 pos2;		float theta;
+	vec3 norm1;		float thickness;
+	vec3 norm2;		float taper;
+	vec3 scale;		float angle;
+	vec3 right;		float tilt;
+	vec3 up;		float ribbonWidth;
+	vec3 forward;	float ribbonTilt;
+	int ribbonFrequency;
+	bool cutter;
+	bool ribbons;
+	bool frontRibbons;
+	bool toroid;
+};
+
+layout(std140, binding = 1) uniform Tools
+{
+	Tool tools[MAX_TOOLS];
+};
 
 mat3 rotationMatrix(float angle, vec3 axis)
 {
@@ -76,59 +82,37 @@ mat3 rotationMatrix(float angle, vec3 axis)
               oc * axis.z * axis.x - axis.y * s, oc * axis.y * axis.z + axis.x * s, oc * axis.z * axis.z + c); 
 }
 
-//------------ Draw Superquad (discard) -----------------
-void superquad()
+//------------ Cut by a Superquad tool (discard) --------
+void superquad(const in Tool t)
 {
-	float dist = distance(pos1, pos2);
-	vec3 poss = original_v - (pos1 + pos2) / 2.0;
-	
-	/*vec3 p1 = (pos1 + pos2)/2.0 + 0.1 * scale.y * right;
-	vec3 p2 = (pos1 + pos2)/2.0 - 0.1 * scale.y * right;
+	float dist = distance(t.pos1, t.pos2);
+	vec3 poss = original_v - (t.pos1 + t.pos2) / 2.0;
 	
-	if (selected && dot((original_v-p1), right) < 0.0 && dot((original_v-p2), right) > 0.0)
-		return;
-	*/
-	// Rotation matrix
-	//vec3 right = normalize(pos2 - pos1);	
-	//vec3 forward = normalize((norm1 + norm2) / 2.0);
-	//vec3 up = normalize(cross(forward, right));
-
-	//vec3 up = normalize((norm1 + norm2) / 2.0);
-	///vec3 forward = normalize(cross(right, up));
-
-	mat3 rotMat = mat3(right, up, forward);
+	mat3 rotMat = mat3(t.right, t.up, t.forward);
 		
-	mat3 spinMat = rotationMatrix(-angle,up);
+	mat3 spinMat = rotationMatrix(-t.angle,t.up);
 
 	float val = 0;
 	
-/* if (toroid)
-	{
-		float alpha = 1.0 / thickness;		
-		vec3 newscale = scale / (alpha + 1.0);
-		
-		poss =  inverse(rotMat) *( poss) / (newscale * 0.5);
-
-		float tval = pow((pow(abs(poss.z), 2.0/theta) + pow(abs(poss.x), 2.0/theta)), theta/2.0);
-		val  = pow(abs(tval - alpha), 2.0/phi) + pow(abs(poss.y), 2.0/phi) - 1.0;
-	} */
+	poss = inverse(spinMat) * poss;
+	poss = inverse(rotMat) * poss;
+	poss = poss / (t.scale * 0.5);
+	//poss =  inverse(rotMat) *( poss) / (scale * 0.5);
+	val = pow((pow(abs(poss.z), 2.0/t.theta) + pow(abs(poss.x), 2.0/t.theta)), t.theta/t.phi) + pow(abs(poss.y),2.0/t.phi) - 1.0;
+
+	if (val < 0)
+		discard;
+}
+//------------ Selected meshes are cut by all cutters ---
+void superquad()
+{
+	if (!selected)
+		return;
 
-	if (cutter)
+	for (int i = 0; i < elemssize; i++)
 	{
-		poss = inverse(spinMat) * poss;
-		poss = inverse(rotMat) * poss;
-		poss = poss / (scale * 0.5);
-		//poss =  inverse(rotMat) *( poss) / (scale * 0.5);
-		val = pow((pow(abs(poss.z), 2.0/theta) + pow(abs(poss.x), 2.0/theta)), theta/phi) + pow(abs(poss.y),2.0/phi) - 1.0;
-	
-	
-		if (selected)	// if selected
-		{
-			if (val < 0 && elemssize > 0)
-			{
-				discard;
-			}
-		}
+		if (tools[i].cutter)
+			superquad(tools[i]);
 	}
 }
 
@@ -140,8 +124,7 @@ void main()
 	if (!gl_FrontFacing)
 		newN = -newN;
 
-	//float d = gl_FragCoord.z;
-	vec3 d = PackFloat8bitRGB(gl_FragCoord.z);
+	vec3 d = vec3(gl_FragCoord.z);
 	superquad();
 	
 	if (selected)
@@ -1,6 +1,8 @@
 /*******************************************************************
 	Fragment
 	Bloom Shader : Bloom Post-Process filter
+	(Blurred bright pass only, rendered at reduced resolution and
+	 added to the image by the final FXAA stage)
 *******************************************************************/
 
 #version 420 compatibility
@@ -45,5 +47,5 @@ void main(void)
 		}
 	}
     col /= ((KERNEL_SIZE+KERNEL_SIZE)-1.0)*((KERNEL_SIZE+KERNEL_SIZE)-1.0);
-    oColor = col + texture2D(source, vTexCoord.st);
+    oColor = col;
 }
\ No newline at end of file
@@ -1046,6 +1046,7 @@ layout(location = 0) out vec4 oColor;
 
 // Uniform variables
 uniform sampler2D source;
+uniform sampler2D bloom;		// Bloom stage output (reduced resolution, same texture coordinates)
 uniform vec2 frameBufSize;
 
 vec2 RCPFrame = vec2(1.0 / frameBufSize.x, 1.0 / frameBufSize.y);
@@ -1069,4 +1070,6 @@ void main(void)
         0.0f,									// FxaaFloat fxaaConsoleEdgeThresholdMin,
         FxaaFloat4(0.0f, 0.0f, 0.0f, 0.0f)		// FxaaFloat fxaaConsole360ConstDir,
     );	
+	
+    oColor += texture(bloom, vTexCoord.st);
 }
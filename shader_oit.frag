@@ -0,0 +1,56 @@
+/*******************************************************************
+	Fragment
+	Translucency Shader : Composites order independent transparency
+	layers (weighted blended or dual depth peeling)
+*******************************************************************/
+
+#version 420 compatibility
+
+in vec4 vTexCoord;
+
+layout(location = 0) out vec4 oColor;
+
+// Same values as vtkMyShaderPass's OITStage
+const int OIT_WEIGHTED = 1;
+const int OIT_DUAL_PEEL = 2;
+const int OIT_BACK_BLEND = 3;
+
+uniform int mode = OIT_WEIGHTED;
+
+uniform sampler2D oitAccum;			// Weighted premultiplied colour sum, a = weighted alpha sum
+uniform sampler2D oitReveal;		// Product of (1 - alpha)
+uniform sampler2D peelFront;		// Front layers (premultiplied)
+uniform sampler2D peelBack;			// Back layers (blended back to front)
+uniform sampler2D peelBackTemp;		// Back layer of the last peel pass
+
+//******************* Main **************************************
+// Resolves give (translucent colour, transmittance), blended (ONE, SRC_ALPHA) over the opaque colour
+void main()
+{
+	vec2 uv = vTexCoord.st;
+
+	if (mode == OIT_WEIGHTED)
+	{
+		float revealage = texture(oitReveal, uv).r;
+		if (revealage >= 1.0)
+			discard;
+
+		vec4 accum = texture(oitAccum, uv);
+		vec3 average = accum.rgb / clamp(accum.a, 1e-4, 5e4);
+
+		oColor = vec4(average * (1.0 - revealage), revealage);
+	}
+	else if (mode == OIT_DUAL_PEEL)
+	{
+		vec4 front = texture(peelFront, uv);
+		vec4 back = texture(peelBack, uv);
+
+		oColor = vec4(front.rgb + (1.0 - front.a) * back.rgb, (1.0 - front.a) * (1.0 - back.a));
+	}
+	else
+	{
+		oColor = texture(peelBackTemp, uv);
+		if (oColor.a <= 0)
+			discard;
+	}
+}
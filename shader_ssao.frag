@@ -3,6 +3,10 @@
 * Edited by David Tran
 * Adapted from:
 * http://blog.evoserv.at/index.php/2012/12/hemispherical-screen-space-ambient-occlusion-ssao-for-deferred-renderers-using-openglglsl/
+*
+* Output: r = ambient occlusion, g = eye distance (for bilateral
+* upsampling and history rejection). Runs at reduced resolution;
+* shader_ssao_upsample.frag applies it to the image.
 ******************************************************************/
 
 #version 420 compatibility
@@ -15,28 +19,31 @@ vec2 vUv = vTexCoord.st;
 layout(location = 0) out vec4 oColor;
 
 //---- Uniforms
-uniform sampler2D source;
 uniform sampler2D sourceNormal;
 uniform sampler2D sourceDepth;
-uniform sampler2D sourceCap;
+uniform sampler2D aoHistory;		// Previous frame's output (temporal)
 uniform vec2 frameBufSize;
 
-//uniform vec2 clipping = vec2(0.1, 800);
+uniform bool temporal = false;
+uniform bool historyValid = false;
+uniform int frameIndex = 0;
+
+uniform vec2 clipping = vec2(0.1, 800);	// Camera clipping range (near, far)
 
 uniform mat4 projMat;
 mat4 iprojMat = inverse(projMat);
 
-bool onlyAO =false;
-
-float zNear = 0.001;
-float zFar = 2;
-//float zNear = 0.1 ;
-//float zFar = 200;
+uniform mat4 reprojView;		// Current eye space to previous eye space
+uniform mat4 prevProjMat;
 
-float cameraCoef = 2;
+// Occluders further than this (eye space) fade out, relative to the depth range so it is scene size independent
+float distanceThreshold = 0.02 * (clipping.y - clipping.x);
+vec2 gbufferSize = vec2(textureSize(sourceDepth, 0));		// Radius is in full resolution pixels
+vec2 filterRadius = vec2(10.0 / gbufferSize.x, 10.0 / gbufferSize.y);
 
-float distanceThreshold = 5;
-vec2 filterRadius = vec2(10.0 / frameBufSize.x, 10.0 / frameBufSize.y);
+// History weight (1 - blend of new frame) and relative eye distance difference that rejects it
+const float historyWeight = 0.8;
+const float historyTolerance = 0.05;
 
 const int sample_count = 16;			// 40 is good (16 won't slow)
 const vec2 poisson16[] = vec2[](    // These are the Poisson Disk Samples
@@ -58,24 +65,10 @@ vec2(-0.8977579f, -0.2314493f),
 vec2(0.7986656f, -0.4338621f)
 );
 
-float linearizeDepth(const in float depth) 
-{
-	return (cameraCoef * zNear) / (zFar + zNear - depth * (zFar - zNear));
-}
-
-float UnpackFloat8bitRGB(vec3 pack) {
-    return dot(pack, vec3(1.0, 1.0 / 255.0, 1.0 / 65025.0));
-}
-
 vec3 calculatePosition(const in vec2 coord)
 {
-	vec4 d = texture(sourceDepth, coord);
-	
-	float depth = UnpackFloat8bitRGB(d.rgb);	
-	depth = linearizeDepth(depth);
-  
-	if (d.a <= 0)
-    depth = 1.0;
+	// Depth attachment (window depth, background is cleared to the far plane)
+	float depth = texture(sourceDepth, coord).r;
 
 	vec4 pos = iprojMat * vec4(coord.x * 2 - 1, coord.y * 2 - 1, depth * 2 - 1, 1);	
 	pos /= pos.w;
@@ -93,6 +86,21 @@ vec3 calculateNormal(const in vec2 coord)
 		return normal.xyz * 2.0 - 1.0;
 }
 
+//------ Rotation of the disk for this pixel (4x4 interleaved, and changes every frame when temporal)
+mat2 sampleRotation()
+{
+	ivec2 p = ivec2(gl_FragCoord.xy) & 3;
+	float index = float(p.x * 4 + p.y);		// Interleaved over 4x4 pixel blocks
+
+	if (temporal)
+		index += float(frameIndex & 7) * 0.618034 * 16.0;	// Golden ratio steps
+
+	float a = index * (6.283185 / 16.0);
+	float c = cos(a);
+	float s = sin(a);
+	return mat2(c, s, -s, c);
+}
+
 void main()
 {
 	// reconstruct position from depth
@@ -101,12 +109,27 @@ void main()
 	// get the view space normal
 	vec3 viewNormal = calculateNormal(vUv);
 
+	float eyeDistance = length(viewPos);
+
+	// Background (far plane), no occlusion
+	if (texture(sourceDepth, vUv).r >= 1.0)
+	{
+		oColor = vec4(1, eyeDistance, 0, 1);
+		return;
+	}
+
+	mat2 rotation = sampleRotation();
+
+	// Half the samples per frame when accumulating (history makes up for them)
+	int count = temporal ? sample_count / 2 : sample_count;
+	int first = temporal ? (frameIndex & 1) * count : 0;
+
     float ambientOcclusion = 0;
     // perform AO
-    for (int i = 0; i < sample_count; ++i)
+    for (int i = first; i < first + count; ++i)
     {
         // sample at an offset specified by the current Poisson-Disk sample and scale it by a radius (has to be in Texture-Space)
-        vec2 sampleTexCoord = vUv + (poisson16[i] * (filterRadius));
+        vec2 sampleTexCoord = vUv + (rotation * poisson16[i]) * filterRadius;
 		
         vec3 samplePos = calculatePosition(sampleTexCoord);
         vec3 sampleDir = normalize(samplePos - viewPos);
@@ -123,19 +146,24 @@ void main()
 
         ambientOcclusion += (a * b);
     }
-	float ao = 1.0 - (ambientOcclusion / sample_count);	
-	
-	const vec4 onlyAOColor = vec4( 1.0, 0.7, 0.5, 1);		
+	float ao = 1.0 - (ambientOcclusion / count);	
 
-	if (onlyAO)
-		oColor = onlyAOColor * vec4(ao, ao, ao, 1);
-	else
+	// Temporal accumulation: reproject into the previous frame, reject history from other surfaces
+	if (temporal && historyValid)
 	{
-		oColor = texture(source, vUv) * vec4(ao, ao, ao, 1);			
-		
-		// No AO on Capping Mask texture
-		if (texture2D(sourceCap, vUv).r >= 1) 
-			oColor = texture(source, vUv);
-	}	
-	//oColor = texture(source, vUv);			
-}
\ No newline at end of file
+		vec4 prevPos = reprojView * vec4(viewPos, 1);
+		vec4 prevClip = prevProjMat * prevPos;
+		vec2 prevUv = prevClip.xy / prevClip.w * 0.5 + 0.5;
+
+		if (all(greaterThanEqual(prevUv, vec2(0))) && all(lessThanEqual(prevUv, vec2(1))))
+		{
+			vec4 history = texture(aoHistory, prevUv);
+			float prevDistance = length(prevPos.xyz);
+
+			if (abs(history.g - prevDistance) < historyTolerance * prevDistance)
+				ao = mix(ao, history.r, historyWeight);
+		}
+	}
+
+	oColor = vec4(ao, eyeDistance, 0, 1);
+}
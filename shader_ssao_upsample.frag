@@ -0,0 +1,62 @@
+/******************************************************************
+* Fragment Shader - SSAO bilateral upsampling
+* Applies the (reduced resolution) ambient occlusion to the image.
+* Bilinear weights of the 4 nearest AO texels are scaled down where
+* their eye distance differs from this pixel's (no halos at edges)
+******************************************************************/
+
+#version 420 compatibility
+
+// Input from vs
+smooth in vec4 vTexCoord;
+vec2 vUv = vTexCoord.st;
+
+// Output 
+layout(location = 0) out vec4 oColor;
+
+//---- Uniforms
+uniform sampler2D source;
+uniform sampler2D sourceDepth;
+uniform sampler2D sourceCap;
+uniform sampler2D ao;			// r = occlusion, g = eye distance
+
+uniform mat4 projMat;
+mat4 iprojMat = inverse(projMat);
+
+const float depthSharpness = 20.0;	// Higher rejects more across depth edges
+
+float calculateDistance(const in vec2 coord)
+{
+	float depth = texture(sourceDepth, coord).r;
+
+	vec4 pos = iprojMat * vec4(coord.x * 2 - 1, coord.y * 2 - 1, depth * 2 - 1, 1);	
+	return length(pos.xyz / pos.w);
+}
+
+void main()
+{
+	vec4 colour = texture(source, vUv);
+
+	// No AO on Capping Mask texture
+	if (texture(sourceCap, vUv).r >= 1)
+	{
+		oColor = colour;
+		return;
+	}
+
+	float d = calculateDistance(vUv);
+
+	// Gather order: (0,1), (1,1), (1,0), (0,0)
+	vec2 f = fract(vUv * vec2(textureSize(ao, 0)) - 0.5);
+	vec4 bilinear = vec4((1 - f.x) * f.y, f.x * f.y, f.x * (1 - f.y), (1 - f.x) * (1 - f.y));
+
+	vec4 occlusion = textureGather(ao, vUv, 0);
+	vec4 distances = textureGather(ao, vUv, 1);
+
+	vec4 weights = bilinear / (1e-3 + depthSharpness * abs(distances - d) / max(d, 1e-6));
+	float total = dot(weights, vec4(1));
+
+	float a = total > 0 ? dot(weights, occlusion) / total : 1.0;
+
+	oColor = colour * vec4(a, a, a, 1);
+}
@@ -13,22 +13,57 @@ out vec3 original_v;
 out vec4 vTexCoord;
 
 //--- Uniforms
-uniform float time = 0.0;
+// Constants in specialized variants (defined per draw by vtkMyBasePass), else uniforms
+#ifdef SPECIALIZED
+const bool selected = SELECTED;
+const bool iselem = ISELEM;
+const bool wiggle = WIGGLE;
+#else
 uniform bool selected = false;
 uniform bool iselem = false;
 uniform bool wiggle = false;
+#endif
 
-//--- Superquad data
-uniform vec3 pos1 = vec3(0, 0, 0);
-uniform vec3 pos2 = vec3(0, 0, 0);
-uniform vec3 norm1 = vec3(0, 0, 0);
-uniform vec3 norm2 = vec3(0, 0, 0);
-uniform vec3 scale = vec3(0, 0, 0);
+//--- Frame state and planted tools (std140, same layout as UniformBlocks' FrameBlock/ToolBlock)
+layout(std140, binding = 0) uniform FrameState
+{
+	vec3 mouse;
+	float mouseSize;
+	vec3 selectedColor;
+	float brushSize;
+	float darkness;
+	float time;
+	int elemssize;			// Number of tools
+	int shininess;
+	bool previewer;
+	bool cap;
+	bool toolTipOn;
+	bool difftrans;
+};
+
+const int MAX_TOOLS = 64;
 
-uniform float phi = 0.0;
-uniform float theta = 0.0;
-uniform float thickness = 0.4;
-uniform bool toroid = false;
+struct Tool
+{
+	vec3 pos1;		float phi;
+	vec3 pos2;		float theta;
+	vec3 norm1;		float thickness;
+	vec3 norm2;		float taper;
+	vec3 scale;		float angle;
+	vec3 right;		float tilt;
+	vec3 up;		float ribbonWidth;
+	vec3 forward;	float ribbonTilt;
+	int ribbonFrequency;
+	bool cutter;
+	bool ribbons;
+	bool frontRibbons;
+	bool toroid;
+};
+
+layout(std140, binding = 1) uniform Tools
+{
+	Tool tools[MAX_TOOLS];
+};
 
 //--- Wave Parameters
 const float pi = 3.141592653;
@@ -93,20 +128,20 @@ vec4 Distort(vec4 p)
     return p;
 }
 
-vec3 opCheapBend( vec3 p )
+vec3 opCheapBend( vec3 p, const in Tool t )
 {
 	if (!iselem)
 		return p;
 		
-	float dist = distance(pos1, pos2);
-	vec3 poss = (pos1 + pos2) / 2.0;
+	float dist = distance(t.pos1, t.pos2);
+	vec3 poss = (t.pos1 + t.pos2) / 2.0;
 		
 	// Rotation matrix
-	vec3 right = normalize(pos2 - pos1);	
-	//vec3 forward = normalize((norm1 + norm2) / 2.0);
+	vec3 right = normalize(t.pos2 - t.pos1);	
+	//vec3 forward = normalize((t.norm1 + t.norm2) / 2.0);
 	//vec3 up = normalize(cross(forward, right));
 
-	vec3 up = normalize((norm1 + norm2) / 2.0);
+	vec3 up = normalize((t.norm1 + t.norm2) / 2.0);
 	vec3 forward = normalize(cross(right, up));
 
 	mat3 rotMat = mat3(
@@ -154,20 +189,20 @@ vec3 opTwist( vec3 p )
     return q;
 }
 
-vec3 bend(vec3 p)
+vec3 bend(vec3 p, const in Tool t)
 {
 	if (!iselem)
 		return p;
 	
-	float dist = distance(pos1, pos2);
-	vec3 poss = (pos1 + pos2) / 2.0;
+	float dist = distance(t.pos1, t.pos2);
+	vec3 poss = (t.pos1 + t.pos2) / 2.0;
 		
 	// Rotation matrix
-	vec3 right = normalize(pos2 - pos1);	
-	//vec3 forward = normalize((norm1 + norm2) / 2.0);
+	vec3 right = normalize(t.pos2 - t.pos1);	
+	//vec3 forward = normalize((t.norm1 + t.norm2) / 2.0);
 	//vec3 up = normalize(cross(forward, right));
 
-	vec3 up = normalize((norm1 + norm2) / 2.0);
+	vec3 up = normalize((t.norm1 + t.norm2) / 2.0);
 	vec3 forward = normalize(cross(right, up));
 
 	mat3 rotMat = mat3(
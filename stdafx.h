@@ -16,6 +16,10 @@
 #include <memory>
 #include <sstream>
 #include <iostream>
+#include <mutex>
+#include <atomic>
+#include <future>
+#include <thread>
 
 using std::cout;
 using std::string;
@@ -23,6 +23,11 @@ PURPOSE.  See the above copyright notice for more information.
 #include <vtkRenderState.h>
 #include <vtkProp.h>
 #include <vtkRenderer.h>
+#include <vtkTextureObject.h>
+#include <vtkTextureUnitManager.h>
+#include <vtkFrameBufferObject.h>
+
+#include <algorithm>
 
 #include "aperio.h"
 
@@ -64,6 +69,23 @@ void vtkMyBasePass::Render(const vtkRenderState *s)
 	this->RenderGeometry(s, false);	// Opaque pass first
 	this->RenderGeometry(s, true);	// Transparent pass
 }
+// ----------------------------------------------------------------------------
+// Description:
+// Release graphics resources (context loss), everything persistent is recreated on next render.
+// \pre w_exists: w!=0
+void vtkMyBasePass::ReleaseGraphicsResources(vtkWindow *w)
+{
+	assert("pre: w_exists" && w != 0);
+
+	this->Superclass::ReleaseGraphicsResources(w);
+
+	Program1 = nullptr;
+	variants.clear();
+
+	supportedWindow = nullptr;
+	DelegateCamera = nullptr;
+	copiedCamera = nullptr;
+}
 
 // ----------------------------------------------------------------------------
 // Description:
@@ -77,104 +99,86 @@ void vtkMyBasePass::RenderGeometry(const vtkRenderState *s, bool translucent)
 	int i = 0;
 	
 	// Need this line!! (Enables alpha blending & depth testing)
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	glEnable(GL_DEPTH_TEST);
+	SetBlendState(translucent);
+
+	variantBuilt = false;
 
 	setGlobalUniforms();
 
-	auto renderProp = [=](bool onlyelem, int i)
+	// Draw list of this pass (one walk over the props): elements first, then everything else
+	elemDraws.clear();
+	otherDraws.clear();
+
+	for (i = 0; i < c; i++)
 	{
 		vtkProp *p = s->GetPropArray()[i];
-		if (p->HasKeys(s->GetRequiredKeys()))
-		{
-			auto it = a->getElemByActorRaw(vtkActor::SafeDownCast(p));
 
-			if (onlyelem)
-			{
-				if (it.lock())	// it is an element, continue
-					;
-				else			// Not an element, don't render
-					return;
-			}
-			else	// Everything else
-			{
-				if (it.lock())	// it is an element, don't render
-					return;
-				else			// Not an element, go ahead
-					;
-			}
-				
-			// Use shaders to draw into FBO colour attachments
+		if (!a->culler.isVisible(p) || !p->HasKeys(s->GetRequiredKeys()))	// Culled this frame, or not for this pass
+			continue;
 
-			if (this->Program1 == nullptr)
-			{
-				this->Program1 = vtkSmartPointer<vtkShaderProgram2>::New();
-				this->Program1->SetContext(s->GetRenderer()->GetRenderWindow());
-
-				if (bufferV.str().size() > 0)
-				{
-					vtkSmartPointer<vtkShader2> shader = vtkSmartPointer<vtkShader2>::New();
-					shader->SetType(VTK_SHADER_TYPE_VERTEX);
-					shader->SetSourceCode(bufferV.str().c_str());
-					shader->SetContext(this->Program1->GetContext());
-
-					this->Program1->GetShaders()->AddItem(shader);
-				}
-
-				if (bufferF.str().size() > 0)
-				{
-					vtkSmartPointer<vtkShader2> shader2 = vtkSmartPointer<vtkShader2>::New();
-					shader2->SetType(VTK_SHADER_TYPE_FRAGMENT);
-					shader2->SetSourceCode(bufferF.str().c_str());
-					shader2->SetContext(this->Program1->GetContext());
-
-					this->Program1->GetShaders()->AddItem(shader2);
-				}
-			}
-			this->Program1->Build();
+		const DrawList::Item *item = a->drawList.find(p);
 
-			if (this->Program1->GetLastBuildStatus() != VTK_SHADER_PROGRAM2_LINK_SUCCEEDED)
-			{
-				vtkErrorMacro("Couldn't build the shader program. At this point , it can be an error in a shader or a driver bug.");
+		if (!IsDrawn(item))
+			continue;
 
-				// restore some state.
-				vtkgl::ActiveTexture(vtkgl::TEXTURE0);
-				return;
-			}
+		if (item != nullptr && item->elem != nullptr)
+			elemDraws.push_back(std::make_pair(p, item));
+		else
+			otherDraws.push_back(std::make_pair(p, item));
+	}
+
+	auto renderProp = [=](vtkProp *p, const DrawList::Item *item)
+	{
+		// Use shaders to draw into FBO colour attachments
+		setPropUniforms(p, item);
 
-			setPropUniforms(p);
+		vtkShaderProgram2 *program = GetProgram(s->GetRenderer(), variantKey);
 
-			this->Program1->SetUniformVariables(uniforms);
-			this->Program1->Use();
-			if (!this->Program1->IsValid())
-				vtkErrorMacro(<< this->Program1->GetLastValidateLog());
+		if (program == nullptr)
+		{
+			// restore some state.
+			vtkgl::ActiveTexture(vtkgl::TEXTURE0);
+			return;
+		}
 
-			int rendered = RenderProp(p, s, translucent);
+		bool generic = (program == Program1.GetPointer());
 
-			this->Program1->Restore();
+		if (generic)
+			setVariantUniforms(variantKey);
 
-			this->NumberOfRenderedProps += rendered;
-		}
+		program->SetUniformVariables(uniforms);
+		program->Use();
+		if (!program->IsValid())
+			vtkErrorMacro(<< program->GetLastValidateLog());
+
+		int rendered = RenderProp(p, s, translucent);
+
+		program->Restore();
+
+		if (generic)
+			clearVariantUniforms();
+
+		this->NumberOfRenderedProps += rendered;
 	};
 
-	while (i < c)
-	{
-		renderProp(true, i);
-		++i;
-	}
-	i = 0;
-	while (i < c)
-	{
-		renderProp(false, i);
-		++i;
-	}
+	for (auto &draw : elemDraws)
+		renderProp(draw.first, draw.second);
+
+	for (auto &draw : otherDraws)
+		renderProp(draw.first, draw.second);
 
 	// Need this line!! (Enables alpha blending & depth testing)
 	glDisable(GL_BLEND);
 	glDisable(GL_DEPTH_TEST);
 }
 //------------------------------------------------------------------
+void vtkMyBasePass::SetBlendState(bool translucent)
+{
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glEnable(GL_DEPTH_TEST);
+}
+//------------------------------------------------------------------
 int vtkMyBasePass::RenderProp(vtkProp *p, const vtkRenderState *s, bool translucent)
 {
 	int rendered = 0;
@@ -210,203 +214,364 @@ void vtkMyBasePass::setShaderFile(string filename, bool frag)
 	//bufferV.str("");
 
 	if (frag)
-		bufferF << file1.rdbuf();		
+	{
+		bufferF << file1.rdbuf();
+		fragFile = filename;
+	}
 	else
+	{
 		bufferV << file1.rdbuf();
+		vertFile = filename;
+	}
+}
+//--------------------------------------------------------------------------------------------------
+void vtkMyBasePass::reloadShaderFiles()
+{
+	ifstream fileV(vertFile), fileF(fragFile);
+
+	if (!fileV || !fileF)
+		return;
+
+	stringstream sourceV, sourceF;
+	sourceV << fileV.rdbuf();
+	sourceF << fileF.rdbuf();
+
+	if (sourceV.str() == bufferV.str() && sourceF.str() == bufferF.str())
+		return;
+
+	bufferV.str(sourceV.str());
+	bufferF.str(sourceF.str());
+
+	// Rebuilt on next draw
+	Program1 = nullptr;
+	variants.clear();
 }
 //-----------------------------------------------------------------------------
 void vtkMyBasePass::setGlobalUniforms()
 {
-	float myalpha = 0;
-	uniforms->SetUniformf("myalpha", 1, &myalpha);
-
-	// Set global uniform variables
-	float mousepos[3] = { a->mouse[0], a->mouse[1], a->mouse[2] };
-	int source = 0;		// potential source texture
-	int sourceBump = 1;		// potential source texture
-
-	uniforms->SetUniformit("wiggle", 1, &a->wiggle);
-	uniforms->SetUniformf("mouse", 3, mousepos);
-	uniforms->SetUniformf("mouseSize", 1, &a->mouseSize);
-	uniforms->SetUniformf("brushSize", 1, &a->brushSize);
-	uniforms->SetUniformit("previewer", 1, &a->previewer);
-	uniforms->SetUniformit("cap", 1, &a->cap);
-	uniforms->SetUniformi("shadingnum", 1, &a->shadingnum);
-	uniforms->SetUniformi("source", 1, &source);
-	uniforms->SetUniformi("sourceBump", 1, &sourceBump);
+	// Frame state and tools are in the uniform blocks (aperio's uniformBlocks), only samplers are left
 	uniforms->SetUniformi("matcap", 1, &a->matcap.unit);
-	uniforms->SetUniformit("toolTipOn", 1, &a->toolTipOn);
-
-	uniforms->SetUniformf("selectedColor", 3, a->selectedColor);	// Access any time previous color
-
-	int elemssize = a->myelems.size();
+}
+//-----------------------------------------------------------------------------
+void vtkMyBasePass::setPropUniforms(vtkProp *p, const DrawList::Item *item)
+{
+	bool outline = false;
+	bool iselem = false;
+	bool selected = false;
 
-	auto toolTip = a->toolTip.lock();
+	cutter = false;
 
-	if (toolTip)
+	// Mesh
+	if (item != nullptr && item->mesh != nullptr)
 	{
-		// Set to last element's properties (because that is the active one when planted/picked up)
-		//auto elem = toolTip;
-		//setElemUniforms(elem);
-
-		/*if (a->toolTipOn && !(toolTip->toolType == KNIFE && a->myelems.size() > 0))
+		// Found the CustomMesh object mapped to this actor (actor is a subclass of prop)
+		selected = item->mesh->selected;
+	}
+	else
+	{
+		if (item != nullptr && item->elem != nullptr)
 		{
-			elemssize = 1;
-			uniforms->SetUniformf("pos1", 3, toolTip->p1.point.GetData());
-			uniforms->SetUniformf("pos2", 3, toolTip->p2.point.GetData());
-			uniforms->SetUniformf("norm1", 3, toolTip->p1.normal.GetData());
-			uniforms->SetUniformf("norm2", 3, toolTip->p1.normal.GetData());
-			uniforms->SetUniformf("scale", 3, toolTip->scale.GetData());
-			uniforms->SetUniformf("right", 3, toolTip->right.GetData());
-			uniforms->SetUniformf("up", 3, toolTip->up.GetData());
-			uniforms->SetUniformf("forward", 3, toolTip->forward.GetData());
-			uniforms->SetUniformf("angle", 1, &toolTip->spinAngle);
-			uniforms->SetUniformit("ribbons", 1, &toolTip->ribbons);
-			uniforms->SetUniformit("frontRibbons", 1, &toolTip->frontRibbons);
-			uniforms->SetUniformf("ribbonWidth", 1, &toolTip->ribbonWidth);
-			uniforms->SetUniformi("ribbonFrequency", 1, &toolTip->ribbonFrequency);
+			// It's an element! 
+			iselem = true;
+			setElemUniforms(item->elem);
 		}
-		else if (a->myelems.size() > 0)
+		else
+		{
+			// Else,
+			// Not found the CustomMesh object, must be extra objects (The outliner, UI widgets, etc)
+			outline = p->GetPropertyKeys() && p->GetPropertyKeys()->Has(vtkMyBasePass::OUTLINEKEY());
+		}
+	}
+
+	// Variant of this draw (set as uniforms only if it falls back to the generic program)
+	variantKey = (iselem ? VARIANT_ELEM : 0) |
+		(cutter ? VARIANT_CUTTER : 0) |
+		(selected ? VARIANT_SELECTED : 0) |
+		(outline ? VARIANT_OUTLINE : 0) |
+		(a->wiggle ? VARIANT_WIGGLE : 0) |
+		(a->shadingnum != 0 ? VARIANT_TOON : 0);
+}
+//--------------------------------------------------------------------------
+void vtkMyBasePass::setElemUniforms(MyElem *elem)
+{
+	// Everything else of the elem is its entry in the Tools block
+	cutter = ((elem->toolType == CUTTER) || (elem->toolType == KNIFE));
+}
+//-----------------------------------------------------------------------------
+void vtkMyBasePass::setVariantUniforms(int key)
+{
+	int outline = (key & VARIANT_OUTLINE) != 0;
+	int iselem = (key & VARIANT_ELEM) != 0;
+	int selected = (key & VARIANT_SELECTED) != 0;
+	int cutter = (key & VARIANT_CUTTER) != 0;
+	int wiggle = (key & VARIANT_WIGGLE) != 0;
+
+	uniforms->SetUniformi("outline", 1, &outline);
+	uniforms->SetUniformi("iselem", 1, &iselem);
+	uniforms->SetUniformi("selected", 1, &selected);
+	uniforms->SetUniformi("cutter", 1, &cutter);
+	uniforms->SetUniformi("wiggle", 1, &wiggle);
+	uniforms->SetUniformi("shadingnum", 1, &a->shadingnum);
+}
+//-----------------------------------------------------------------------------
+void vtkMyBasePass::clearVariantUniforms()
+{
+	// Specialized programs don't have them (no lookups for names they don't use)
+	uniforms->RemoveUniform("outline");
+	uniforms->RemoveUniform("iselem");
+	uniforms->RemoveUniform("selected");
+	uniforms->RemoveUniform("cutter");
+	uniforms->RemoveUniform("wiggle");
+	uniforms->RemoveUniform("shadingnum");
+}
+//-----------------------------------------------------------------------------
+bool vtkMyBasePass::BuildProgram(vtkSmartPointer<vtkShaderProgram2> &program, vtkRenderer *r, const string &vert, const string &frag)
+{
+	if (program == nullptr)
+	{
+		program = vtkSmartPointer<vtkShaderProgram2>::New();
+		program->SetContext(static_cast<vtkOpenGLRenderWindow *>(r->GetRenderWindow()));
+
+		if (vert.size() > 0)
 		{
-			auto elem = a->myelems.at(a->myelems.size() - 1);
+			vtkSmartPointer<vtkShader2> shader = vtkSmartPointer<vtkShader2>::New();
+			shader->SetType(VTK_SHADER_TYPE_VERTEX);
+			shader->SetSourceCode(vert.c_str());
+			shader->SetContext(program->GetContext());
 
-			uniforms->SetUniformf("pos1", 3, elem->p1.point.GetData());
-			uniforms->SetUniformf("pos2", 3, elem->p2.point.GetData());
+			program->GetShaders()->AddItem(shader);
+		}
 
-			uniforms->SetUniformf("norm1", 3, elem->p1.normal.GetData());
-			uniforms->SetUniformf("norm2", 3, elem->p2.normal.GetData());
+		if (frag.size() > 0)
+		{
+			vtkSmartPointer<vtkShader2> shader2 = vtkSmartPointer<vtkShader2>::New();
+			shader2->SetType(VTK_SHADER_TYPE_FRAGMENT);
+			shader2->SetSourceCode(frag.c_str());
+			shader2->SetContext(program->GetContext());
 
-			uniforms->SetUniformf("scale", 3, elem->scale.GetData());
-			uniforms->SetUniformf("right", 3, elem->right.GetData());
-			uniforms->SetUniformf("up", 3, elem->up.GetData());
-			uniforms->SetUniformf("forward", 3, elem->forward.GetData());
-			uniforms->SetUniformf("angle", 1, &toolTip->spinAngle);
-		}*/
+			program->GetShaders()->AddItem(shader2);
+		}
+	}
+	program->Build();
 
-		//bool toroid = a->getUI().chkToroid->isChecked();
+	if (program->GetLastBuildStatus() != VTK_SHADER_PROGRAM2_LINK_SUCCEEDED)
+	{
+		vtkErrorMacro("Couldn't build the shader program. At this point , it can be an error in a shader or a driver bug.");
+		return false;
 	}
+	return true;
+}
+//-----------------------------------------------------------------------------
+void vtkMyBasePass::BindTextures(vtkRenderer *r, const vector<vtkMyTextureObject *> &textures, vtkUniformVariables *var, bool linear)
+{
+	vtkTextureUnitManager *tu = static_cast<vtkOpenGLRenderWindow *>(r->GetRenderWindow())->GetTextureUnitManager();
 
-	uniforms->SetUniformi("elemssize", 1, &elemssize);
+	for (auto t : textures)
+	{
+		if (t->id < 0)
+		{
+			t->id = tu->Allocate();
 
-	//float phi = a->getUI().phiSlider->value() / a->roundnessScale;
-	//float theta = a->getUI().thetaSlider->value() / a->roundnessScale;
-	//float thickness = a->getUI().thicknessSlider->value() / a->thicknessScale;
+			if (t->id < 0)
+			{
+				vtkErrorMacro(<< "No texture unit left for " << t->name);
+				continue;
+			}
+		}
 
-	//uniforms->SetUniformf("phi", 1, &phi);
-	//uniforms->SetUniformf("theta", 1, &theta);
-	//uniforms->SetUniformf("thickness", 1, &thickness);
+		// Texture object's parameters, sent by Bind only when they change (not per frame)
+		t->texture->SetMinificationFilter(linear ? vtkTextureObject::Linear : vtkTextureObject::Nearest);
+		t->texture->SetLinearMagnification(linear);
+		t->texture->SetWrapS(vtkTextureObject::ClampToEdge);
+		t->texture->SetWrapT(vtkTextureObject::ClampToEdge);
+		t->texture->SetDepthTextureCompare(false);	// Ignored by colour textures
 
-	uniforms->SetUniformit("difftrans", 1, &a->difftrans);
+		vtkgl::ActiveTexture(vtkgl::TEXTURE0 + t->id);
+		t->texture->Bind();
 
-	uniforms->SetUniformi("shininess", 1, &a->shininess);
-	uniforms->SetUniformf("darkness", 1, &a->darkness);
+		var->SetUniformi(t->name.c_str(), 1, &t->id);
+	}
 
-	uniforms->SetUniformf("time", 1, &a->wavetime);
+	vtkgl::ActiveTexture(vtkgl::TEXTURE0);
 }
 //-----------------------------------------------------------------------------
-void vtkMyBasePass::setPropUniforms(vtkProp *p)
+void vtkMyBasePass::FreeTextures(vtkWindow *w, const vector<vtkMyTextureObject *> &textures)
 {
-	// Find actor inside CustomMesh vector (using lambda to compare CustomMesh's actor pointer with vtkActor's pointer)
-	auto it = a->getMeshByActorRaw(vtkActor::SafeDownCast(p)).lock();
-
-	// Default uniforms
-	bool outline = false;
-	uniforms->SetUniformit("outline", 1, &outline);
+	vtkOpenGLRenderWindow *window = vtkOpenGLRenderWindow::SafeDownCast(w);
+	vtkTextureUnitManager *tu = window ? window->GetTextureUnitManager() : nullptr;
 
-	bool iselem = false;
-	uniforms->SetUniformit("iselem", 1, &iselem);			// False default (not an element)
+	for (auto t : textures)
+	{
+		if (tu && t->id >= 0 && tu->IsAllocated(t->id))
+			tu->Free(t->id);
 
-	bool selected = false;
-	uniforms->SetUniformit("selected", 1, &selected);
+		t->id = -1;
+	}
+}
+//-----------------------------------------------------------------------------
+bool vtkMyBasePass::IsSupported(vtkRenderer *r)
+{
+	vtkRenderWindow *w = r->GetRenderWindow();
 
-	bool active_elem = false;
-	uniforms->SetUniformit("active_elem", 1, &active_elem);			// False default (not an element)
+	if (supportedWindow == w)
+		return supported;
 
-	auto toolTip = a->toolTip.lock();
+	supportedWindow = w;
+	supported = vtkFrameBufferObject::IsSupported(w);
 
-	// Mesh
-	if (it != nullptr)
+	if (!supported)
 	{
-		// Found the CustomMesh object mapped to this actor (actor is a subclass of prop)
-		uniforms->SetUniformit("selected", 1, &it->selected);
+		vtkErrorMacro("FBOs are not supported by the context. Cannot post-process.");
 	}
-	/*else if (a->toolTipOn && toolTip && toolTip->actor.GetPointer() == vtkActor::SafeDownCast(p))
-	{
-		iselem = true;
-		uniforms->SetUniformit("iselem", 1, &iselem);
-	}*/
-	else
+	if (supported)
 	{
-		// Do another find here to see if mesh is part of widget elements
-		auto it2 = a->getElemByActorRaw(vtkActor::SafeDownCast(p)).lock();
+		supported = vtkTextureObject::IsSupported(w);
+		if (!supported)
+		{
+			vtkErrorMacro("Texture Objects are not supported by the context. Cannot post-process.");
+		}
+	}
 
-		if (it2 != nullptr)
+	if (supported)
+	{
+		supported = vtkShaderProgram2::IsSupported(static_cast<vtkOpenGLRenderWindow *>(w));
+		if (!supported)
 		{
-			// Actor belongs to our Elements array (myelems)
-			iselem = true;
-			uniforms->SetUniformit("iselem", 1, &iselem);
+			vtkErrorMacro("GLSL is not supported by the context. Cannot post-process.");
+		}
+	}
+	return supported;
+}
+//-----------------------------------------------------------------------------
+void vtkMyBasePass::BeginDelegateCamera(vtkRenderer *r, int width, int height, int newWidth, int newHeight)
+{
+	SavedCamera = r->GetActiveCamera();
+	SavedCamera->Register(this);
 
-			if (toolTip == it2)	// The Active element
-			{
-				bool active_elem = true;
-				uniforms->SetUniformit("active_elem", 1, &active_elem);			// False default (not an element)
-			}
+	if (DelegateCamera == nullptr)
+	{
+		DelegateCamera = vtkSmartPointer<vtkCamera>::New();
+		copiedCamera = nullptr;
+	}
 
-			// It's an element! 
-			auto elem = it2;
-			setElemUniforms(elem);
+	int sizes[4] = { width, height, newWidth, newHeight };
+
+	// Camera only changes on interaction (and its clipping range when the scene does)
+	if (copiedCamera != SavedCamera || copiedCameraTime != SavedCamera->GetMTime() ||
+		!std::equal(sizes, sizes + 4, copiedSizes))
+	{
+		vtkCamera *newCamera = DelegateCamera;
+		newCamera->DeepCopy(SavedCamera);
+
+		if (newCamera->GetParallelProjection())
+		{
+			newCamera->SetParallelScale(
+				newCamera->GetParallelScale()*newHeight / static_cast<double>(height));
 		}
 		else
 		{
-			// Else,
-			// Not found the CustomMesh object, must be extra objects (The outliner, UI widgets, etc)
-
-			if (p->GetPropertyKeys() && p->GetPropertyKeys()->Has(vtkMyBasePass::OUTLINEKEY()))
+			double large;
+			double small;
+			if (newCamera->GetUseHorizontalViewAngle())
 			{
-				outline = true;
-				uniforms->SetUniformit("outline", 1, &outline);
-				//glPointSize(100);
-				//glEnable(GL_LINE_SMOOTH);
-
-				//glDisable(GL_DEPTH_TEST);
+				large = newWidth;
+				small = width;
+			}
+			else
+			{
+				large = newHeight;
+				small = height;
 			}
+			double angle = vtkMath::RadiansFromDegrees(newCamera->GetViewAngle());
+
+			angle = 2.0*atan(tan(angle / 2.0)*large / static_cast<double>(small));
+
+			newCamera->SetViewAngle(vtkMath::DegreesFromRadians(angle));
 		}
+
+		copiedCamera = SavedCamera;
+		copiedCameraTime = SavedCamera->GetMTime();
+		std::copy(sizes, sizes + 4, copiedSizes);
 	}
+
+	r->SetActiveCamera(DelegateCamera);
 }
-//--------------------------------------------------------------------------
-void vtkMyBasePass::setElemUniforms(weak_ptr<MyElem> elem_wk)
+//-----------------------------------------------------------------------------
+void vtkMyBasePass::EndDelegateCamera(vtkRenderer *r)
 {
-	auto elem = elem_wk.lock();
-
-	uniforms->SetUniformf("pos1", 3, elem->p1.point.GetData());
-	uniforms->SetUniformf("pos2", 3, elem->p2.point.GetData());
-	uniforms->SetUniformf("norm1", 3, elem->p1.normal.GetData());
-	uniforms->SetUniformf("norm2", 3, elem->p1.normal.GetData());
-	uniforms->SetUniformf("scale", 3, elem->scale.GetData());
-	uniforms->SetUniformf("right", 3, elem->right.GetData());
-	uniforms->SetUniformf("up", 3, elem->up.GetData());
-	uniforms->SetUniformf("forward", 3, elem->forward.GetData());
-	uniforms->SetUniformf("angle", 1, &elem->spinAngle);
-	uniforms->SetUniformit("ribbons", 1, &elem->ribbons);
-	uniforms->SetUniformit("frontRibbons", 1, &elem->frontRibbons);
-	uniforms->SetUniformf("ribbonWidth", 1, &elem->ribbonWidth);
-	uniforms->SetUniformi("ribbonFrequency", 1, &elem->ribbonFrequency);
-	uniforms->SetUniformf("ribbonTilt", 1, &elem->ribbonTilt);
-	uniforms->SetUniformf("tilt", 1, &elem->tilt);
-
-	bool toroid = (elem->toolType == RING);
-	bool cutter = ((elem->toolType == CUTTER) || (elem->toolType == KNIFE));
-
-	uniforms->SetUniformit("toroid", 1, &toroid);
-	uniforms->SetUniformit("cutter", 1, &cutter);
-
-	float phi = elem->source->GetPhiRoundness();//a->getUI().phiSlider->value() / a->roundnessScale;
-	float theta = elem->source->GetThetaRoundness(); //a->getUI().thetaSlider->value() / a->roundnessScale;
-	float thickness = elem->source->GetThickness(); //a->getUI().thicknessSlider->value() / a->thicknessScale;
-	float taper = elem->source->GetTaper();
-
-	uniforms->SetUniformf("phi", 1, &phi);
-	uniforms->SetUniformf("theta", 1, &theta);
-	uniforms->SetUniformf("thickness", 1, &thickness);
-	uniforms->SetUniformf("taper", 1, &taper);
+	r->SetActiveCamera(SavedCamera);
+	SavedCamera->UnRegister(this);
+	SavedCamera = nullptr;
 }
+//-----------------------------------------------------------------------------
+void vtkMyBasePass::AttachTargets(vtkFrameBufferObject *fbo, vector<vtkMyTextureObject> &targets, vtkTextureObject *depth)
+{
+	assert("pre: max_targets" && targets.size() <= MAX_TARGETS);
+
+	unsigned int indices[MAX_TARGETS];	// { 0, 1, 2, etc }
+	int count = targets.size();
+
+	fbo->SetNumberOfRenderTargets(count);
+	fbo->SetDepthBuffer(depth);
+	fbo->SetDepthBufferNeeded(true);
+
+	for (int i = 0; i < count; i++)
+	{
+		fbo->SetColorBuffer(i, targets[i].texture);
+		indices[i] = i;
+	}
+
+	fbo->SetActiveBuffers(count, indices);
+}
+//-----------------------------------------------------------------------------
+vtkShaderProgram2 *vtkMyBasePass::GetProgram(vtkRenderer *r, int key)
+{
+	auto it = variants.find(key);
+
+	// Compiled on first use, one per geometry pass so a new state doesn't stall a frame
+	if (it == variants.end() && !variantBuilt)
+	{
+		variantBuilt = true;
+
+		vtkSmartPointer<vtkShaderProgram2> program;
+		if (!BuildProgram(program, r, Specialize(bufferV.str(), key), Specialize(bufferF.str(), key)))
+			program = nullptr;
+
+		it = variants.insert(std::make_pair(key, program)).first;
+	}
+
+	if (it != variants.end() && it->second != nullptr)
+		return it->second;
+
+	// Generic program meanwhile (or if the variant failed)
+	if (!BuildProgram(Program1, r, bufferV.str(), bufferF.str()))
+		return nullptr;
+
+	return Program1;
+}
+//-----------------------------------------------------------------------------
+string vtkMyBasePass::Specialize(const string &source, int key)
+{
+	if (source.empty())
+		return source;
+
+	auto flag = [key](int f) { return (key & f) ? "true" : "false"; };
+
+	stringstream defines;
+	defines << "#define SPECIALIZED\n"
+		<< "#define ISELEM " << flag(VARIANT_ELEM) << "\n"
+		<< "#define CUTTER " << flag(VARIANT_CUTTER) << "\n"
+		<< "#define SELECTED " << flag(VARIANT_SELECTED) << "\n"
+		<< "#define OUTLINE " << flag(VARIANT_OUTLINE) << "\n"
+		<< "#define WIGGLE " << flag(VARIANT_WIGGLE) << "\n"
+		<< "#define SHADINGNUM " << ((key & VARIANT_TOON) ? 1 : 0) << "\n";
+
+	// #version must stay the first statement
+	size_t version = source.find("#version");
+	size_t line = (version != string::npos) ? source.find('\n', version) : string::npos;
+
+	if (line == string::npos)
+		return defines.str() + source;
+
+	return source.substr(0, line + 1) + defines.str() + source.substr(line + 1);
+}
\ No newline at end of file
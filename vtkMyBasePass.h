@@ -26,6 +26,10 @@ PURPOSE.  See the above copyright notice for more information.
 
 #include "vtkInformationIntegerKey.h"
 
+#include "DrawList.h"
+
+#include <map>
+
 class vtkOpenGLRenderWindow;
 class vtkDefaultPassLayerList; // Pimpl
 class vtkProp;
@@ -33,6 +37,9 @@ class aperio;
 class MyElem;
 
 class vtkTextureObject;
+class vtkFrameBufferObject;
+class vtkRenderer;
+class vtkCamera;
 
 // Override vtkOpenGLProperty to show front/back faces
 class vtkMyOpenGLProperty : public vtkOpenGLProperty
@@ -55,12 +62,15 @@ public:
 	}
 };
 
-// --- Hold texture objects (vtk object, name and OpenGL id)
+// --- Hold texture objects (vtk object, name and OpenGL id) and their format when used as attachment
 struct vtkMyTextureObject
 {
 	vtkSmartPointer<vtkTextureObject> texture;
 	string name;
-	int id;
+	int id = -1;		// Texture unit, allocated on first bind and kept (see BindTextures)
+
+	int components = 4;
+	int type = VTK_UNSIGNED_CHAR;
 };
 
 // ---- Base Shader Pass
@@ -84,18 +94,37 @@ public:
 	virtual void Render(const vtkRenderState *s);
 	//ETX
 
+	// Description:
+	// Release graphics resources (context loss), everything persistent is recreated on next render.
+	// \pre w_exists: w!=0
+	virtual void ReleaseGraphicsResources(vtkWindow *w);
+
 	// Virtual methods to override in subclasses!!!
 	virtual void setGlobalUniforms();
-	virtual void setPropUniforms(vtkProp *p);
+	virtual void setPropUniforms(vtkProp *p, const DrawList::Item *item);
 	virtual int RenderProp(vtkProp *p, const vtkRenderState *s, bool translucent);
 
 	// Custom methods
 	void initialize(aperio *a);
 	void setShaderFile(string filename, bool frag);	// Must have a shader file set!
 
-	void setElemUniforms(weak_ptr<MyElem> elem_wk);
+	void setElemUniforms(MyElem *elem);
+
+	///<summary> Re-reads the shader files, programs are rebuilt only if they changed [Debugging] </summary>
+	void reloadShaderFiles();
 
-	vtkSmartPointer<vtkShaderProgram2> Program1;
+	// --- Shader variants: material/tool state the shaders define as constants (#ifdef SPECIALIZED)
+	enum VariantFlags
+	{
+		VARIANT_ELEM = 1,
+		VARIANT_CUTTER = 2,
+		VARIANT_SELECTED = 4,
+		VARIANT_OUTLINE = 8,
+		VARIANT_WIGGLE = 16,
+		VARIANT_TOON = 32
+	};
+
+	vtkSmartPointer<vtkShaderProgram2> Program1;	// Generic (uniform branching), draws until a variant is built
 	vtkSmartPointer<vtkUniformVariables> uniforms;
 	stringstream bufferV;	// Vertex  shader stringstream
 	stringstream bufferF;	// Fragment shader stringstream
@@ -116,6 +145,66 @@ protected:
 	// \pre s_exists: s!=0
 	virtual void RenderGeometry(const vtkRenderState *s, bool translucent);
 
+	///<summary> Blending and depth state for the opaque/translucent geometry (alpha blending, depth tested) </summary>
+	virtual void SetBlendState(bool translucent);
+
+	///<summary> Whether this pass draws the prop (item is its draw list entry, null if not a mesh/elem) </summary>
+	virtual bool IsDrawn(const DrawList::Item *item) { return true; }
+
+	///<summary> Builds program from vertex/fragment source (once), false on failure </summary>
+	bool BuildProgram(vtkSmartPointer<vtkShaderProgram2> &program, vtkRenderer *r, const string &vert, const string &frag);
+
+	///<summary> Binds textures to their units (allocated on first bind, kept until FreeTextures) and sets their
+	/// samplers (by name) in var. No mipmaps, depth textures give depth values (no comparison) </summary>
+	void BindTextures(vtkRenderer *r, const vector<vtkMyTextureObject *> &textures, vtkUniformVariables *var, bool linear = true);
+
+	///<summary> Frees the textures' units (only when releasing graphics resources) </summary>
+	void FreeTextures(vtkWindow *w, const vector<vtkMyTextureObject *> &textures);
+
+	///<summary> FBO, texture object and GLSL support of r's window (checked once per window/context) </summary>
+	bool IsSupported(vtkRenderer *r);
+
+	///<summary> Replaces r's camera with a copy for a newWidth x newHeight target (wider view angle or parallel
+	/// scale). The copy is kept, and only copied again when the camera or the sizes change </summary>
+	void BeginDelegateCamera(vtkRenderer *r, int width, int height, int newWidth, int newHeight);
+	void EndDelegateCamera(vtkRenderer *r);
+
+	///<summary> Sets targets as fbo's colour attachments 0..n (all drawn to) and depth as its depth buffer.
+	/// Attachments are kept by the fbo, so this is only needed when targets are (re)created </summary>
+	static void AttachTargets(vtkFrameBufferObject *fbo, vector<vtkMyTextureObject> &targets, vtkTextureObject *depth);
+
+	static const int MAX_TARGETS = 8;	// Colour attachments of one fbo
+
+	///<summary> Program specialized for key (built lazily, one per geometry pass), else generic Program1 </summary>
+	vtkShaderProgram2 *GetProgram(vtkRenderer *r, int key);
+
+	///<summary> Source with the variant's #defines after its #version line </summary>
+	static string Specialize(const string &source, int key);
+
+	///<summary> Variant state as uniforms, for draws with the generic program (removed again after the draw) </summary>
+	void setVariantUniforms(int key);
+	void clearVariantUniforms();
+
+	std::map<int, vtkSmartPointer<vtkShaderProgram2> > variants;	// By key, null if it failed to build
+	bool variantBuilt = false;		// This geometry pass already built one
+
+	vector<std::pair<vtkProp *, const DrawList::Item *> > elemDraws;		// This geometry pass' props (reused)
+	vector<std::pair<vtkProp *, const DrawList::Item *> > otherDraws;
+
+	int variantKey = 0;				// Variant of the prop being drawn (set by setPropUniforms)
+	bool cutter = false;			// Prop being drawn is a cutting elem (set by setElemUniforms)
+
+	vtkRenderWindow *supportedWindow = nullptr;		// Window IsSupported last checked (null: check again)
+	bool supported = false;
+
+	vtkSmartPointer<vtkCamera> DelegateCamera;		// Copy of the camera (BeginDelegateCamera)
+	vtkCamera *SavedCamera = nullptr;
+	vtkCamera *copiedCamera = nullptr;				// Camera, time and sizes of the last copy
+	unsigned long copiedCameraTime = 0;
+	int copiedSizes[4];
+
+	string vertFile, fragFile;
+
 private:
 	vtkMyBasePass(const vtkMyBasePass&);  // Not implemented.
 	void operator=(const vtkMyBasePass&);  // Not implemented.
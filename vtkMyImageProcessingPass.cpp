@@ -31,6 +31,8 @@ PURPOSE.  See the above copyright notice for more information.
 #include <vtkOpenGLRenderWindow.h>
 #include <vtkTextureUnitManager.h>
 
+#include <algorithm>
+
 vtkStandardNewMacro(vtkMyImageProcessingPass);
 
 vtkCxxSetObjectMacro(vtkMyImageProcessingPass, DelegatePass, vtkRenderPass);
@@ -45,18 +47,22 @@ vtkMyImageProcessingPass::vtkMyImageProcessingPass()
 	vtkMyTextureObject NormalTexture;
 	NormalTexture.name = "sourceNormal";
 
-	vtkMyTextureObject depthTexture;
-	depthTexture.name = "sourceDepth";
-
 	vtkMyTextureObject capTexture;
 	capTexture.name = "sourceCap";
 
 	// Order matters (Index of COLOR_ATTACHMENT)
 	textures.push_back(ColourTexture);
 	textures.push_back(NormalTexture);
-	textures.push_back(depthTexture);
 	textures.push_back(capTexture);
 
+	// Depth is sampled straight from the depth attachment
+	DepthInput.name = "sourceDepth";
+
+	vtkMatrix4x4::Identity(projMatrix);
+	vtkMatrix4x4::Identity(viewMatrix);
+	vtkMatrix4x4::Identity(prevProjMatrix);
+	vtkMatrix4x4::Identity(prevViewMatrix);
+
 	this->DelegatePass = 0;
 }
 // ----------------------------------------------------------------------------
@@ -86,32 +92,8 @@ void vtkMyImageProcessingPass::Render(const vtkRenderState *s)
 	{
 		vtkRenderer *r = s->GetRenderer();
 
-		// Test for Hardware support. If not supported, just render the delegate.
-		bool supported = vtkFrameBufferObject::IsSupported(r->GetRenderWindow());
-
-		if (!supported)
-		{
-			vtkErrorMacro("FBOs are not supported by the context. Cannot post-process.");
-		}
-		if (supported)
-		{
-			supported = vtkTextureObject::IsSupported(r->GetRenderWindow());
-			if (!supported)
-			{
-				vtkErrorMacro("Texture Objects are not supported by the context. Cannot post-process.");
-			}
-		}
-
-		if (supported)
-		{
-			supported = vtkShaderProgram2::IsSupported(static_cast<vtkOpenGLRenderWindow *>(r->GetRenderWindow()));
-			if (!supported)
-			{
-				vtkErrorMacro("GLSL is not supported by the context. Cannot post-process.");
-			}
-		}
-
-		if (!supported)
+		// Test for Hardware support (once per context). If not supported, just render the delegate.
+		if (!this->IsSupported(r))
 		{
 			this->DelegatePass->Render(s);
 			this->NumberOfRenderedProps +=
@@ -131,10 +113,17 @@ void vtkMyImageProcessingPass::Render(const vtkRenderState *s)
 		width = size[0];
 		height = size[1];
 
+		// Internal resolution (dynamic resolution scale), the final shader upscales it to the window
+		double scale = resolution.update();
+		int renderWidth = std::max(1, static_cast<int>(width * scale + 0.5));
+		int renderHeight = std::max(1, static_cast<int>(height * scale + 0.5));
+
 		const int extraPixels = 1; // one on each side
 
-		int w = width + 2 * extraPixels;
-		int h = height + 2 * extraPixels;
+		int w = renderWidth + 2 * extraPixels;
+		int h = renderHeight + 2 * extraPixels;
+
+		resolution.beginFrame();	// GPU time of the whole pass chain
 
 		for (auto &t : textures)
 		{
@@ -150,6 +139,7 @@ void vtkMyImageProcessingPass::Render(const vtkRenderState *s)
 		{
 			this->DepthTexture = vtkSmartPointer<vtkTextureObject>::New();
 			this->DepthTexture->SetContext(r->GetRenderWindow());
+			this->DepthInput.texture = this->DepthTexture;
 		}
 
 		if (this->FrameBufferObject == nullptr)
@@ -159,154 +149,329 @@ void vtkMyImageProcessingPass::Render(const vtkRenderState *s)
 		}
 
 		// Render to FrameBufferObject (Set up texture attachments too)
-		this->MyRenderDelegate(s, width, height, w, h);
+		this->MyRenderDelegate(s, renderWidth, renderHeight, w, h);
 
 		// Unbind the framebuffer so we can draw to screen
 		this->FrameBufferObject->UnBind();
 
-		glDrawBuffer(savedDrawBuffer);
-
-		if (this->Program1 == nullptr)
-		{
-			this->Program1 = vtkSmartPointer<vtkShaderProgram2>::New();
-			this->Program1->SetContext(static_cast<vtkOpenGLRenderWindow *>(this->FrameBufferObject->GetContext()));
-
-			if (bufferV.str().size() > 0)
-			{
-				vtkSmartPointer<vtkShader2> shader = vtkSmartPointer<vtkShader2>::New();
-				shader->SetType(VTK_SHADER_TYPE_VERTEX);
-				shader->SetSourceCode(bufferV.str().c_str());
-				shader->SetContext(this->Program1->GetContext());
+		this->UpdateCameraMatrices(r);
 
-				this->Program1->GetShaders()->AddItem(shader);
-			}
+		// Prepare blitting
+		glDisable(GL_ALPHA_TEST);
+		glDisable(GL_BLEND);
+		glDisable(GL_DEPTH_TEST);
+		glDisable(GL_LIGHTING);
+		glDisable(GL_SCISSOR_TEST);
 
-			if (bufferF.str().size() > 0)
-			{
-				vtkSmartPointer<vtkShader2> shader2 = vtkSmartPointer<vtkShader2>::New();
-				shader2->SetType(VTK_SHADER_TYPE_FRAGMENT);
-				shader2->SetSourceCode(bufferF.str().c_str());
-				shader2->SetContext(this->Program1->GetContext());
+		// Intermediate stages (each into its own texture, G-buffer is shared)
+		for (int i = 0; i < stages.size(); i++)
+			this->RenderStage(r, i, w, h);
 
-				this->Program1->GetShaders()->AddItem(shader2);
-			}
-		}
-		this->Program1->Build();
+		glDrawBuffer(savedDrawBuffer);
 
-		if (this->Program1->GetLastBuildStatus() != VTK_SHADER_PROGRAM2_LINK_SUCCEEDED)
+		if (!this->BuildProgram(this->Program1, r, bufferV.str(), bufferF.str()))
 		{
-			vtkErrorMacro("Couldn't build the shader program. At this point , it can be an error in a shader or a driver bug.");
-
 			// restore some state.
 			vtkgl::ActiveTexture(vtkgl::TEXTURE0);
+			resolution.endFrame();
 			return;
 		}
 
-		vtkTextureUnitManager *tu = static_cast<vtkOpenGLRenderWindow *>(r->GetRenderWindow())->GetTextureUnitManager();
+		vtkUniformVariables *var = this->Program1->GetUniformVariables();
 
-		auto texEnvParams = []()
-		{
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-		};
+		this->BindInputs(r, var, stages.size());
 
-		for (auto &t : textures)
+		float fsize[2] = { w, h };
+		var->SetUniformf("frameBufSize", 2, fsize);
+
+		this->SetCameraUniforms(r, var);
+
+		// Start using program
+		this->Program1->Use();
+
+		if (!this->Program1->IsValid())
 		{
-			t.id = tu->Allocate();
+			vtkErrorMacro(<< this->Program1->GetLastValidateLog());
+		}
+
+		// Trigger a draw on a TextureObject (Draws Quad - could be called on any texture object)
+		if (renderWidth == width && renderHeight == height)
+			textures[0].texture->CopyToFrameBuffer(extraPixels, extraPixels, w - 1 - extraPixels, h - 1 - extraPixels, 0, 0, width, height);
+		else
+			this->DrawUpscaled(extraPixels, w, h, width, height);
+
+		// Cleanup
+		textures[0].texture->UnBind();
+
+		this->Program1->Restore();
 
-			vtkgl::ActiveTexture(vtkgl::TEXTURE0 + t.id);		
-			t.texture->Bind();
-			texEnvParams();
+		// This frame's outputs become the temporal stages' history
+		for (auto &stage : stages)
+		{
+			if (stage.temporal && stage.output.texture != nullptr && stage.history.texture != nullptr)
+			{
+				std::swap(stage.output.texture, stage.history.texture);
+				stage.historyValid = true;
+			}
 		}
 
-		int id0 = tu->Allocate();	// For depth
+		std::copy(projMatrix, projMatrix + 16, prevProjMatrix);
+		std::copy(viewMatrix, viewMatrix + 16, prevViewMatrix);
+		frameIndex++;
 
-		vtkgl::ActiveTexture(vtkgl::TEXTURE0 + id0);
-		this->DepthTexture->Bind();
-		texEnvParams();
+		resolution.endFrame();
+	}
+	else
+	{
+		vtkWarningMacro(<< " no delegate.");
+	}
+}
 
-		vtkgl::ActiveTexture(vtkgl::TEXTURE0);
+// ----------------------------------------------------------------------------
+void vtkMyImageProcessingPass::addStage(string name, string vertFile, string fragFile, int downsample, int type)
+{
+	Stage stage;
+	stage.output.name = name;
+	stage.output.type = type;
+	stage.history.name = name + "History";
+	stage.history.type = type;
+	stage.downsample = std::max(1, downsample);
 
-		vtkUniformVariables *var = this->Program1->GetUniformVariables();
+	ifstream vert(vertFile);
+	ifstream frag(fragFile);
 
-		float fsize[2] = { w, h };
-		var->SetUniformf("frameBufSize", 2, fsize);
+	stringstream v, f;
+	v << vert.rdbuf();
+	f << frag.rdbuf();
 
-		for (auto &t : textures)
-			var->SetUniformi(t.name.c_str(), 1, &t.id);
+	stage.vertSource = v.str();
+	stage.fragSource = f.str();
 
-		//var->SetUniformi("sourceDepth", 1, &textures[textures.size() - 2].id);
+	stages.push_back(stage);
+}
+// ----------------------------------------------------------------------------
+void vtkMyImageProcessingPass::setDynamicResolution(bool enabled, double targetFrameRate, double minScale, double maxScale)
+{
+	resolution.setTargetFrameRate(targetFrameRate);
+	resolution.setBounds(minScale, maxScale);
+	resolution.setEnabled(enabled);
+}
+// ----------------------------------------------------------------------------
+vtkMyImageProcessingPass::Stage *vtkMyImageProcessingPass::GetStage(const string &name)
+{
+	for (auto &stage : stages)
+	{
+		if (stage.output.name == name)
+			return &stage;
+	}
+	return nullptr;
+}
+// ----------------------------------------------------------------------------
+void vtkMyImageProcessingPass::setStageDownsample(string name, int downsample)
+{
+	Stage *stage = GetStage(name);
 
-		float d[2];
-		d[0] = r->GetActiveCamera()->GetClippingRange()[0];
-		d[1] = r->GetActiveCamera()->GetClippingRange()[1];
-		var->SetUniformf("clipping", 2, d);
+	if (stage && stage->downsample != downsample)
+	{
+		stage->downsample = std::max(1, downsample);
+		stage->historyValid = false;
+	}
+}
+// ----------------------------------------------------------------------------
+void vtkMyImageProcessingPass::setStageTemporal(string name, bool temporal)
+{
+	Stage *stage = GetStage(name);
 
-		// --- Get projection matrix (for accurate eye positions in SSAO)
-		double aspect[2];
-		int  lowerLeft[2];
-		int usize, vsize;
-		vtkMatrix4x4 *matrix = vtkMatrix4x4::New();
+	if (stage && stage->temporal != temporal)
+	{
+		stage->temporal = temporal;
+		stage->historyValid = false;
+	}
+}
+// ----------------------------------------------------------------------------
+void vtkMyImageProcessingPass::BindInputs(vtkRenderer *r, vtkUniformVariables *var, int stage)
+{
+	inputs.clear();
 
-		r->GetTiledSizeAndOrigin(&usize, &vsize, lowerLeft, lowerLeft + 1);
+	for (auto &t : textures)
+		inputs.push_back(&t);
 
-		// Projection Matrix uniform
-		r->ComputeAspect();
-		r->GetAspect(aspect);
-		double aspect2[2];
-		r->vtkViewport::ComputeAspect();
-		r->vtkViewport::GetAspect(aspect2);
-		double aspectModification = aspect[0] * aspect2[1] / (aspect[1] * aspect2[0]);
+	inputs.push_back(&DepthInput);
 
-		if (usize && vsize)
-		{
-			matrix->DeepCopy(r->GetActiveCamera()->GetProjectionTransformMatrix(aspectModification * usize / vsize, -1, 1));
-			matrix->Transpose();
+	// Outputs of earlier stages (replace a G-buffer input with the same name)
+	for (int i = 0; i < stage; i++)
+	{
+		auto &output = stages[i].output;
+		auto it = std::find_if(inputs.begin(), inputs.end(), [&](vtkMyTextureObject *t) { return t->name == output.name; });
 
-			float projMat[16];
-			int z = 0;
-			for (int i = 0; i < 4; i++)
-				for (int j = 0; j < 4; j++)
-					projMat[z++] = matrix->GetElement(i, j);
+		if (it != inputs.end())
+			*it = &output;
+		else
+			inputs.push_back(&output);
+	}
 
-			var->SetUniformMatrix("projMat", 4, 4, projMat);
-		}
+	// Own previous output
+	if (stage < stages.size() && stages[stage].temporal)
+		inputs.push_back(&stages[stage].history);
 
-		// Start using program
-		this->Program1->Use();
+	// No mipmaps anywhere: every stage samples its inputs at (or, when downsampled, between) texel centres
+	this->BindTextures(r, inputs, var);
+}
+// ----------------------------------------------------------------------------
+void vtkMyImageProcessingPass::UpdateCameraMatrices(vtkRenderer *r)
+{
+	// --- Get projection matrix (for accurate eye positions in SSAO)
+	double aspect[2];
+	int  lowerLeft[2];
+	int usize, vsize;
 
-		if (!this->Program1->IsValid())
+	r->GetTiledSizeAndOrigin(&usize, &vsize, lowerLeft, lowerLeft + 1);
+
+	r->ComputeAspect();
+	r->GetAspect(aspect);
+	double aspect2[2];
+	r->vtkViewport::ComputeAspect();
+	r->vtkViewport::GetAspect(aspect2);
+	double aspectModification = aspect[0] * aspect2[1] / (aspect[1] * aspect2[0]);
+
+	if (usize && vsize)
+		vtkMatrix4x4::DeepCopy(projMatrix, r->GetActiveCamera()->GetProjectionTransformMatrix(aspectModification * usize / vsize, -1, 1));
+
+	vtkMatrix4x4::DeepCopy(viewMatrix, r->GetActiveCamera()->GetViewTransformMatrix());
+}
+// ----------------------------------------------------------------------------
+void vtkMyImageProcessingPass::SetCameraUniforms(vtkRenderer *r, vtkUniformVariables *var)
+{
+	float d[2];
+	d[0] = r->GetActiveCamera()->GetClippingRange()[0];
+	d[1] = r->GetActiveCamera()->GetClippingRange()[1];
+	var->SetUniformf("clipping", 2, d);
+
+	// Matrix uniforms are column major (transpose of vtk's row major)
+	auto setMatrix = [&](const char *name, const double m[16])
+	{
+		float values[16];
+		int z = 0;
+		for (int i = 0; i < 4; i++)
+			for (int j = 0; j < 4; j++)
+				values[z++] = m[j * 4 + i];
+
+		var->SetUniformMatrix(name, 4, 4, values);
+	};
+
+	setMatrix("projMat", projMatrix);
+	setMatrix("prevProjMat", prevProjMatrix);
+
+	// Current eye space to previous eye space (for reprojecting into history)
+	double inverseView[16], reprojView[16];
+	vtkMatrix4x4::Invert(viewMatrix, inverseView);
+	vtkMatrix4x4::Multiply4x4(prevViewMatrix, inverseView, reprojView);
+
+	setMatrix("reprojView", reprojView);
+
+	var->SetUniformi("frameIndex", 1, &frameIndex);
+}
+// ----------------------------------------------------------------------------
+void vtkMyImageProcessingPass::DrawUpscaled(int border, int w, int h, int width, int height)
+{
+	// Texel edges of the interior (CopyToFrameBuffer's texture coordinates), sampled bilinearly
+	float s0 = border / static_cast<float>(w);
+	float s1 = (w - border) / static_cast<float>(w);
+	float t0 = border / static_cast<float>(h);
+	float t1 = (h - border) / static_cast<float>(h);
+
+	glViewport(0, 0, width, height);
+
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+
+	glBegin(GL_QUADS);
+	glTexCoord2f(s0, t0); glVertex2f(-1, -1);
+	glTexCoord2f(s1, t0); glVertex2f(1, -1);
+	glTexCoord2f(s1, t1); glVertex2f(1, 1);
+	glTexCoord2f(s0, t1); glVertex2f(-1, 1);
+	glEnd();
+
+	glPopMatrix();
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+}
+// ----------------------------------------------------------------------------
+void vtkMyImageProcessingPass::RenderStage(vtkRenderer *r, int index, int w, int h)
+{
+	Stage &stage = stages[index];
+
+	int sw = std::max(1, w / stage.downsample);
+	int sh = std::max(1, h / stage.downsample);
+
+	auto createTarget = [&](vtkMyTextureObject &t)
+	{
+		if (t.texture == nullptr)
 		{
-			vtkErrorMacro(<< this->Program1->GetLastValidateLog());
+			t.texture = vtkSmartPointer<vtkTextureObject>::New();
+			t.texture->SetContext(r->GetRenderWindow());
 		}
 
-		// Prepare blitting
-		glDisable(GL_ALPHA_TEST);
-		glDisable(GL_BLEND);
-		glDisable(GL_DEPTH_TEST);
-		glDisable(GL_LIGHTING);
-		glDisable(GL_SCISSOR_TEST);
+		if (t.texture->GetWidth() != static_cast<unsigned int>(sw) ||
+			t.texture->GetHeight() != static_cast<unsigned int>(sh))
+		{
+			t.texture->SetGenerateMipmap(false);
+			t.texture->Create2D(sw, sh, t.components, t.type, false);
 
-		// Trigger a draw on a TextureObject (Draws Quad - could be called on any texture object)
-		textures[0].texture->CopyToFrameBuffer(extraPixels, extraPixels, w - 1 - extraPixels, h - 1 - extraPixels, 0, 0, width, height);
+			stage.historyValid = false;		// Resized, history no longer matches
+		}
+	};
 
-		// Cleanup
-		textures[0].texture->UnBind();
-		vtkgl::ActiveTexture(vtkgl::TEXTURE0);
+	createTarget(stage.output);
 
-		for (auto &t : textures)
-			tu->Free(t.id);
+	if (stage.temporal)
+		createTarget(stage.history);
 
-		tu->Free(id0);
+	if (!this->BuildProgram(stage.program, r, stage.vertSource, stage.fragSource))
+		return;
 
-		this->Program1->Restore();
+	if (this->StageFrameBufferObject == nullptr)
+	{
+		this->StageFrameBufferObject = vtkSmartPointer<vtkFrameBufferObject>::New();
+		this->StageFrameBufferObject->SetContext(r->GetRenderWindow());
 	}
-	else
+
+	vtkFrameBufferObject *fbo = this->StageFrameBufferObject;
+	fbo->SetNumberOfRenderTargets(1);
+	fbo->SetColorBuffer(0, stage.output.texture);
+	fbo->SetActiveBuffer(0);
+	fbo->SetDepthBufferNeeded(false);
+	fbo->Start(sw, sh, false);		// Binds, sets viewport and orthographic projection
+
+	vtkUniformVariables *var = stage.program->GetUniformVariables();
+
+	this->BindInputs(r, var, index);
+
+	float fsize[2] = { sw, sh };
+	var->SetUniformf("frameBufSize", 2, fsize);
+
+	this->SetCameraUniforms(r, var);
+
+	var->SetUniformit("temporal", 1, &stage.temporal);
+	var->SetUniformit("historyValid", 1, &stage.historyValid);
+
+	stage.program->Use();
+
+	if (!stage.program->IsValid())
 	{
-		vtkWarningMacro(<< " no delegate.");
+		vtkErrorMacro(<< stage.program->GetLastValidateLog());
 	}
+
+	fbo->RenderQuad(0, sw - 1, 0, sh - 1);
+
+	stage.program->Restore();
+
+	fbo->UnBind();
 }
 
 // ----------------------------------------------------------------------------
@@ -335,50 +500,20 @@ void vtkMyImageProcessingPass::MyRenderDelegate(const vtkRenderState *s,
 	s2.SetPropArrayAndCount(s->GetPropArray(), s->GetPropArrayCount());
 
 	// Adapt camera to new window size
-	vtkCamera *savedCamera = r->GetActiveCamera();
-	savedCamera->Register(this);
-	vtkCamera *newCamera = vtkCamera::New();
-	newCamera->DeepCopy(savedCamera);
-
-	r->SetActiveCamera(newCamera);
-
-	if (newCamera->GetParallelProjection())
-	{
-		newCamera->SetParallelScale(
-			newCamera->GetParallelScale()*newHeight / static_cast<double>(height));
-	}
-	else
-	{
-		double large;
-		double small;
-		if (newCamera->GetUseHorizontalViewAngle())
-		{
-			large = newWidth;
-			small = width;
-		}
-		else
-		{
-			large = newHeight;
-			small = height;
-		}
-		double angle = vtkMath::RadiansFromDegrees(newCamera->GetViewAngle());
-
-		//angle = atan(tan(angle)*large / static_cast<double>(small));
-		angle = 2.0*atan(tan(angle / 2.0)*large / static_cast<double>(small));
-
-		newCamera->SetViewAngle(vtkMath::DegreesFromRadians(angle));
-	}
+	this->BeginDelegateCamera(r, width, height, newWidth, newHeight);
 
 	s2.SetFrameBuffer(FrameBufferObject);
 
+	bool resized = false;
+
 	for (auto &t : textures)
 	{
 		if (t.texture->GetWidth() != static_cast<unsigned int>(newWidth) ||
 			t.texture->GetHeight() != static_cast<unsigned int>(newHeight))
 		{
-			t.texture->SetGenerateMipmap(true);
+			t.texture->SetGenerateMipmap(false);	// No stage samples mip levels
 			t.texture->Create2D(newWidth, newHeight, 4, VTK_UNSIGNED_CHAR, false);
-			
+			resized = true;
 		}
 	}
 
@@ -389,32 +524,15 @@ void vtkMyImageProcessingPass::MyRenderDelegate(const vtkRenderState *s,
 		DepthTexture->SetRequireDepthBufferFloat(true);
 		DepthTexture->SetRequireTextureFloat(true);
 
-		DepthTexture->SetGenerateMipmap(true);
+		DepthTexture->SetGenerateMipmap(false);
 		DepthTexture->Create2D(newWidth, newHeight, 1, VTK_VOID, false);
+		resized = true;
 	}
 
-	// Set color attachments
-	FrameBufferObject->SetNumberOfRenderTargets(textures.size());
-	FrameBufferObject->SetDepthBuffer(DepthTexture);
+	// Set color attachments (render into all of them), kept by the FBO until targets are resized/recreated
+	if (resized)
+		AttachTargets(FrameBufferObject, textures, DepthTexture);
 
-	int num_textures = textures.size();
-	for (int i = 0; i < num_textures; i++)
-		FrameBufferObject->SetColorBuffer(i, textures[i].texture);
-
-	// Render into n attachments (indices)
-	unsigned int *indices = new unsigned int[num_textures];	// Make {0, 1, 2, etc }
-	for (int i = 0; i < num_textures; i++)
-		indices[i] = i;
-
-	FrameBufferObject->SetActiveBuffers(textures.size(), indices);
-	delete[] indices;
-
-	// because the same FBO can be used in another pass but with several color
-	// buffers, force this pass to use 1, to avoid side effects from the
-	// render of the previous frame.
-	//fbo->SetActiveBuffer(0);
-
-	FrameBufferObject->SetDepthBufferNeeded(true);
 	FrameBufferObject->StartNonOrtho(newWidth, newHeight, false);
 	glViewport(0, 0, newWidth, newHeight);
 	glScissor(0, 0, newWidth, newHeight);
@@ -424,9 +542,7 @@ void vtkMyImageProcessingPass::MyRenderDelegate(const vtkRenderState *s,
 	this->NumberOfRenderedProps +=
 		this->DelegatePass->GetNumberOfRenderedProps();
 
-	newCamera->Delete();
-	r->SetActiveCamera(savedCamera);
-	savedCamera->UnRegister(this);
+	this->EndDelegateCamera(r);
 }
 // ----------------------------------------------------------------------------
 // Description:
@@ -438,4 +554,35 @@ void vtkMyImageProcessingPass::ReleaseGraphicsResources(vtkWindow *w)
 	assert("pre: w_exists" && w != 0);
 
 	this->Superclass::ReleaseGraphicsResources(w);
+
+	// Texture units go with the textures (both recreated on next render)
+	vector<vtkMyTextureObject *> all;
+	for (auto &t : textures)
+		all.push_back(&t);
+	all.push_back(&DepthInput);
+
+	for (auto &stage : stages)
+	{
+		all.push_back(&stage.output);
+		all.push_back(&stage.history);
+	}
+	this->FreeTextures(w, all);
+
+	for (auto t : all)
+		t->texture = nullptr;
+
+	for (auto &stage : stages)
+	{
+		stage.program = nullptr;
+		stage.historyValid = false;
+	}
+
+	DepthTexture = nullptr;
+	FrameBufferObject = nullptr;
+	StageFrameBufferObject = nullptr;
+
+	resolution.releaseQueries();
+
+	if (this->DelegatePass != nullptr)
+		this->DelegatePass->ReleaseGraphicsResources(w);
 }
\ No newline at end of file
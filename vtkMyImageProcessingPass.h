@@ -14,6 +14,10 @@ PURPOSE.  See the above copyright notice for more information.
 =========================================================================*/
 // .NAME vtkMyImageProcessingPass - Implement a basic
 // post-processing pass consisting of a fragment and vertex shader
+// .SECTION Description
+// The delegate is rendered once into the G-buffer (colour, normal, depth, cap mask).
+// Optional stages (addStage) then run in order over it, each into its own texture
+// (possibly at a lower resolution), and the pass's own shader draws the result to screen.
 //
 // .SECTION See Also
 // vtkRenderPass
@@ -22,6 +26,7 @@ PURPOSE.  See the above copyright notice for more information.
 #define __vtkMyImageProcessingPass_h
 
 #include "vtkMyBasePass.h"
+#include "DynamicResolution.h"
 
 class vtkOpenGLRenderWindow;
 class vtkDepthPeelingPassLayerList; // Pimpl
@@ -29,6 +34,8 @@ class vtkShaderProgram2;
 class vtkShader2;
 class vtkFrameBufferObject;
 class vtkTextureObject;
+class vtkUniformVariables;
+class vtkRenderer;
 
 class VTK_EXPORT vtkMyImageProcessingPass : public vtkMyBasePass
 {
@@ -48,7 +55,7 @@ public:
 	// Release graphics resources and ask components to release their own
 	// resources.
 	// \pre w_exists: w!=0
-	void ReleaseGraphicsResources(vtkWindow *w);
+	virtual void ReleaseGraphicsResources(vtkWindow *w) override;
 
 	// Set/Get Delegate pass (called when rendering to FBO, then the texture sent to new shader for processing)
 	//vtkGetObjectMacro(DelegatePass, vtkRenderPass);
@@ -57,6 +64,27 @@ public:
 	///<summary>My Custom delegate method that enables alpha blending in render to target </summary>
 	void MyRenderDelegate(const vtkRenderState *s, int width, int height, int newWidth, int newHeight);
 
+	///<summary> Adds a stage rendered (in order) into its own texture before the final shader. Later stages
+	/// sample its output by name, which replaces a G-buffer input of the same name (e.g. "source")</summary>
+	///<param name="downsample"> Resolution divisor of the stage's texture (1 full, 2 half, etc) </param>
+	///<param name="type"> Output texture type (VTK_FLOAT for unclamped/precise values) </param>
+	void addStage(string name, string vertFile, string fragFile, int downsample = 1, int type = VTK_UNSIGNED_CHAR);
+
+	///<summary> Changes a stage's resolution divisor at runtime (its history restarts) </summary>
+	void setStageDownsample(string name, int downsample);
+
+	///<summary> Temporal stage: also samples its own previous frame output ("<name>History"), with
+	/// reprojection uniforms (reprojView: current to previous eye space, prevProjMat) </summary>
+	void setStageTemporal(string name, bool temporal);
+
+	///<summary> Renders the G-buffer and stages at a scale of the window size that holds targetFrameRate
+	/// (measured GPU time), within [minScale, maxScale]. The final shader upscales to the window.
+	/// Needs GL 3.3 timer queries </summary>
+	void setDynamicResolution(bool enabled, double targetFrameRate = 30, double minScale = 0.5, double maxScale = 1.0);
+
+	///<summary> Render target scale of the last frame (1 = window size) </summary>
+	double getResolutionScale() const { return resolution.getScale(); }
+
 protected:
 	// Description:
 	// Default constructor. DelegatePass is set to NULL.
@@ -66,13 +94,53 @@ protected:
 	// Destructor.
 	virtual ~vtkMyImageProcessingPass();
 
+	// --- Post-processing stage (full screen quad into output texture)
+	struct Stage
+	{
+		vtkMyTextureObject output;		// Output texture (name is the sampler name in later stages)
+		int downsample;
+		string vertSource, fragSource;
+		vtkSmartPointer<vtkShaderProgram2> program;
+
+		bool temporal = false;
+		bool historyValid = false;		// History holds the previous frame (same size)
+		vtkMyTextureObject history;		// Previous output (swapped with output after each frame)
+	};
+
 	vector<vtkMyTextureObject> textures;
+	vector<Stage> stages;
+
+	///<summary> Draws the w x h G-buffer without its border over the whole width x height window (final shader bound) </summary>
+	void DrawUpscaled(int border, int w, int h, int width, int height);
+
+	DynamicResolution resolution;
+
+	///<summary> Renders stage into its output texture (w, h is the G-buffer size) </summary>
+	void RenderStage(vtkRenderer *r, int index, int w, int h);
+
+	///<summary> Binds G-buffer and outputs of stages before 'stage' to their texture units, sets their samplers </summary>
+	void BindInputs(vtkRenderer *r, vtkUniformVariables *var, int stage);
+	vector<vtkMyTextureObject *> inputs;	// Last BindInputs (reused)
+
+	Stage *GetStage(const string &name);
+
+	///<summary> Computes this frame's projection and view matrices (previous frame's are kept) </summary>
+	void UpdateCameraMatrices(vtkRenderer *r);
+
+	///<summary> Sets clipping range, projection matrix and reprojection uniforms </summary>
+	void SetCameraUniforms(vtkRenderer *r, vtkUniformVariables *var);
+
+	double projMatrix[16], viewMatrix[16];			// This frame
+	double prevProjMatrix[16], prevViewMatrix[16];	// Previous frame
+	int frameIndex = 0;
 
 	// Description:
 	// Graphics resources.
 	vtkSmartPointer<vtkFrameBufferObject> FrameBufferObject;
+	vtkSmartPointer<vtkFrameBufferObject> StageFrameBufferObject;	// Switches colour buffer per stage
 
 	vtkSmartPointer<vtkTextureObject> DepthTexture;
+	vtkMyTextureObject DepthInput;		// DepthTexture as an input ("sourceDepth")
 
 	vtkSmartPointer<vtkRenderPass> DelegatePass;	// Delegate pass
 
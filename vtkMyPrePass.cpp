@@ -42,52 +42,32 @@ void vtkMyPrePass::PrintSelf(ostream& os, vtkIndent indent)
 	this->Superclass::PrintSelf(os, indent);
 }
 // --------------------------------------------------------------------------------
+bool vtkMyPrePass::IsDrawn(const DrawList::Item *item)
+{
+	// Only selected meshes, elems and the tool tip (no program or uniforms for anything else)
+	return item != nullptr && item->prepass;
+}
+// --------------------------------------------------------------------------------
 int vtkMyPrePass::RenderProp(vtkProp *p, const vtkRenderState *s, bool translucent)
 {
 	int rendered = 0;
-	bool isElem = false;
-	bool isSelectedMesh = false;
-
-	auto toolTip = a->toolTip.lock();
 
-	// tool tip element?
-	if (a->toolTipOn && toolTip && toolTip->toolType != KNIFE && toolTip->actor.GetPointer() == vtkActor::SafeDownCast(p))
+	// Depth is written for translucent props too (selected meshes' depth, whatever their opacity)
+	if (translucent)
 	{
-		isElem = true;
+		static_cast<vtkMyOpenGLProperty *>(vtkOpenGLProperty::SafeDownCast(vtkActor::SafeDownCast(p)->GetProperty()))->show_back();
+		rendered = p->RenderFilteredTranslucentPolygonalGeometry(s->GetRenderer(), s->GetRequiredKeys());
+
+		static_cast<vtkMyOpenGLProperty *>(vtkOpenGLProperty::SafeDownCast(vtkActor::SafeDownCast(p)->GetProperty()))->show_front();
+		rendered = p->RenderFilteredTranslucentPolygonalGeometry(s->GetRenderer(), s->GetRequiredKeys());
 	}
 	else
 	{
-		auto elem = a->getElemByActorRaw(vtkActor::SafeDownCast(p)).lock();
-		if (elem != nullptr)
-		{
-			isElem = true;
-		}
-		else
-		{
-			auto mesh = a->getMeshByActorRaw(vtkActor::SafeDownCast(p)).lock();
-			if (mesh != nullptr && mesh->selected)
-				isSelectedMesh = true;
-		}
-	}
-	
-	if	( isSelectedMesh || isElem )
-	{
-		if (translucent)
-		{
-			static_cast<vtkMyOpenGLProperty *>(vtkOpenGLProperty::SafeDownCast(vtkActor::SafeDownCast(p)->GetProperty()))->show_back();
-			rendered = p->RenderFilteredTranslucentPolygonalGeometry(s->GetRenderer(), s->GetRequiredKeys());
-
-			static_cast<vtkMyOpenGLProperty *>(vtkOpenGLProperty::SafeDownCast(vtkActor::SafeDownCast(p)->GetProperty()))->show_front();
-			rendered = p->RenderFilteredTranslucentPolygonalGeometry(s->GetRenderer(), s->GetRequiredKeys());
-		}
-		else
-		{
-			static_cast<vtkMyOpenGLProperty *>(vtkOpenGLProperty::SafeDownCast(vtkActor::SafeDownCast(p)->GetProperty()))->show_back();
-			rendered = p->RenderFilteredOpaqueGeometry(s->GetRenderer(), s->GetRequiredKeys());
+		static_cast<vtkMyOpenGLProperty *>(vtkOpenGLProperty::SafeDownCast(vtkActor::SafeDownCast(p)->GetProperty()))->show_back();
+		rendered = p->RenderFilteredOpaqueGeometry(s->GetRenderer(), s->GetRequiredKeys());
 
-			static_cast<vtkMyOpenGLProperty *>(vtkOpenGLProperty::SafeDownCast(vtkActor::SafeDownCast(p)->GetProperty()))->show_front();
-			rendered = p->RenderFilteredOpaqueGeometry(s->GetRenderer(), s->GetRequiredKeys());
-		}
+		static_cast<vtkMyOpenGLProperty *>(vtkOpenGLProperty::SafeDownCast(vtkActor::SafeDownCast(p)->GetProperty()))->show_front();
+		rendered = p->RenderFilteredOpaqueGeometry(s->GetRenderer(), s->GetRequiredKeys());
 	}
 	return rendered;
 }
\ No newline at end of file
@@ -39,6 +39,8 @@ public:
 	virtual int RenderProp(vtkProp *p, const vtkRenderState *s, bool translucent) override;
 
 protected:
+	virtual bool IsDrawn(const DrawList::Item *item) override;
+
 	// Description:
 	// Default constructor.
 	vtkMyPrePass();
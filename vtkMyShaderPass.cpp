@@ -55,6 +55,13 @@ vtkMyShaderPass::vtkMyShaderPass()
 	vtkMyTextureObject depthSQ;
 	depthSQ.name = "depthSQ";
 
+	// Depths are stored unpacked (single channel float)
+	for (auto t : { &depthSelectedF, &depthSelected, &depthSQ })
+	{
+		t->components = 1;
+		t->type = VTK_FLOAT;
+	}
+
 	vtkMyTextureObject selectedColours;
 	selectedColours.name = "selectedColours";
 
@@ -65,6 +72,30 @@ vtkMyShaderPass::vtkMyShaderPass()
 	textures.push_back(selectedColours);
 
 	this->DelegatePass = 0;
+
+	// Order independent transparency targets (names are their samplers)
+	OpaqueDepth.name = "opaqueDepth";
+	OpaqueDepth.components = 1;
+	OpaqueDepth.type = VTK_VOID;
+
+	Accum.name = "oitAccum";
+	Accum.type = VTK_FLOAT;		// Weighted sums go well past 1
+	Reveal.name = "oitReveal";
+
+	for (auto &t : PeelDepth)
+	{
+		t.name = "peelDepth";
+		t.type = VTK_FLOAT;		// (-nearest, farthest), max blended
+	}
+	for (auto &t : PeelFront)
+		t.name = "peelFront";
+
+	PeelBackTemp.name = "peelBackTemp";
+	PeelBack.name = "peelBack";
+
+	// Pre-pass outputs (sampled by the main pass)
+	for (auto &t : textures)
+		prepassInputs.push_back(&t);
 }
 // ----------------------------------------------------------------------------
 vtkMyShaderPass::~vtkMyShaderPass()
@@ -89,36 +120,24 @@ void vtkMyShaderPass::Render(const vtkRenderState *s)
 
 	this->NumberOfRenderedProps = 0;
 
-	if (this->DelegatePass != nullptr)
-	{
-		vtkRenderer *r = s->GetRenderer();
+	// Visibility of meshes for this frame (used by the pre-pass and both geometry passes)
+	int targetSize[2];
+	s->GetWindowSize(targetSize);
+	a->culler.update(a, s->GetRenderer(), targetSize[1] > 0 ? targetSize[0] / (double)targetSize[1] : 1.0);
 
-		// Test for Hardware support. If not supported, just render the delegate.
-		bool supported = vtkFrameBufferObject::IsSupported(r->GetRenderWindow());
+	// Props looked up by actor (pre-pass and both geometry passes)
+	a->drawList.update(a);
 
-		if (!supported)
-		{
-			vtkErrorMacro("FBOs are not supported by the context. Cannot post-process.");
-		}
-		if (supported)
-		{
-			supported = vtkTextureObject::IsSupported(r->GetRenderWindow());
-			if (!supported)
-			{
-				vtkErrorMacro("Texture Objects are not supported by the context. Cannot post-process.");
-			}
-		}
+	// Frame state and tools of the uniform blocks (read by the pre-pass and both geometry passes)
+	if (a->glew_available)
+		a->uniformBlocks.update(a);
 
-		if (supported)
-		{
-			supported = vtkShaderProgram2::IsSupported(static_cast<vtkOpenGLRenderWindow *>(r->GetRenderWindow()));
-			if (!supported)
-			{
-				vtkErrorMacro("GLSL is not supported by the context. Cannot post-process.");
-			}
-		}
+	if (this->DelegatePass != nullptr)
+	{
+		vtkRenderer *r = s->GetRenderer();
 
-		if (!supported)
+		// Test for Hardware support (once per context). If not supported, just render the delegate.
+		if (!this->IsSupported(r))
 		{
 			this->DelegatePass->Render(s);
 			this->NumberOfRenderedProps +=
@@ -126,9 +145,6 @@ void vtkMyShaderPass::Render(const vtkRenderState *s)
 			return;
 		}
 
-		GLint savedDrawBuffer;
-		glGetIntegerv(GL_DRAW_BUFFER, &savedDrawBuffer);
-
 		// 1. Create a new render state with an FBO.
 
 		int width = 0;
@@ -169,55 +185,25 @@ void vtkMyShaderPass::Render(const vtkRenderState *s)
 		// Unbind the framebuffer so we can draw to screen
 		this->FrameBufferObject->UnBind();
 
-		//glDrawBuffer(savedDrawBuffer);	// Not needed in Shader Pass (No FBO attachment changes yet)
-
-		vtkTextureUnitManager *tu = static_cast<vtkOpenGLRenderWindow *>(r->GetRenderWindow())->GetTextureUnitManager();
-
-		auto texEnvParams = []()
+		// Matcap's unit comes from the same manager (so no pass's texture is bound over it)
+		if (a->glew_available && matcapUnit < 0)
 		{
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-		};
-
-		// Bind textures
-		for (auto &t : textures)
-		{
-			t.id = tu->Allocate();
-			
-			vtkgl::ActiveTexture(vtkgl::TEXTURE0 + t.id);
-			t.texture->Bind();
-			texEnvParams();
-
-			/*if (a->glew_available && t.name == "selectedColours")
-			{
-				GLint width, height;
-				glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
-				glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
-
-				//char pixels[width*height * 4];
-				char *pixels = new char[width * height * 4];
+			vtkTextureUnitManager *tu = static_cast<vtkOpenGLRenderWindow *>(r->GetRenderWindow())->GetTextureUnitManager();
+			matcapUnit = tu->Allocate();
 
-				std::cout << width << "," << height << "\n";
-				glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
-
-				std::cout << (int)pixels[(width / 2) * (height / 2) * 4] << "," << 
-					(int)pixels[(width / 2) * (height / 2) * 4 + 1] << "," <<
-					(int)pixels[(width / 2) * (height / 2) * 4 + 2] << "," <<
-					(int)pixels[(width / 2) * (height / 2) * 4 + 3] << "\n";
-
-				delete[] pixels;
-			}*/
+			if (matcapUnit >= 0)
+				a->matcap.unit = matcapUnit;
 		}
 
+		// Bind textures (units allocated on first bind, samplers set by name)
+		this->BindTextures(r, prepassInputs, uniforms);
+
 		if (a->glew_available)
 		{
 			CustomTexture &matcap = a->matcap;
 
 			glActiveTexture(GL_TEXTURE0 + matcap.unit);
 			glBindTexture(GL_TEXTURE_2D, matcap.name);
-			//texEnvParams();
 		}
 
 		vtkgl::ActiveTexture(vtkgl::TEXTURE0);	// No active texture (no funny colour artifacts)
@@ -226,24 +212,37 @@ void vtkMyShaderPass::Render(const vtkRenderState *s)
 		float fsize[2] = { w, h };
 		uniforms->SetUniformf("frameBufSize", 2, fsize);
 
-		for (auto &t : textures)
-			uniforms->SetUniformi(t.name.c_str(), 1, &t.id);
+		// To linearize the depths read from the pre-pass
+		float clipping[2];
+		clipping[0] = r->GetActiveCamera()->GetClippingRange()[0];
+		clipping[1] = r->GetActiveCamera()->GetClippingRange()[1];
+		uniforms->SetUniformf("clipping", 2, clipping);
 
 		this->RenderGeometry(s, false);	// Render opaque geometry first
-		this->RenderGeometry(s, true);	// Render translucent geometry
+		a->culler.issueOcclusionQueries();	// Against the opaque depth (results used next frame)
+
+		// Translucent geometry, order independent when rendering into an FBO (e.g. the post-processing G-buffer)
+		if (translucencyMode != TRANSLUCENCY_BLEND && s->GetFrameBuffer() != nullptr && a->glew_available)
+		{
+			this->CopyOpaqueDepth(r, w, h);
+
+			if (translucencyMode == TRANSLUCENCY_WEIGHTED)
+				this->RenderTranslucentWeighted(s, w, h);
+			else
+				this->RenderTranslucentDualPeel(s, w, h);
+		}
+		else
+			this->RenderGeometry(s, true);	// Render translucent geometry
 
-		// Cleanup
+		// Cleanup (units stay allocated, textures are bound to them again next frame)
 		textures[0].texture->UnBind();
 		vtkgl::ActiveTexture(vtkgl::TEXTURE0);
-
-		// Free textures
-		for (auto &t : textures)
-			tu->Free(t.id);
 	}
 	else
 	{
 		//vtkWarningMacro(<< " no delegate.");
 		this->RenderGeometry(s, false);	// Render opaque geometry first
+		a->culler.issueOcclusionQueries();
 		this->RenderGeometry(s, true);	// Render translucent geometry
 	}
 }
@@ -274,51 +273,21 @@ void vtkMyShaderPass::MyRenderDelegate(const vtkRenderState *s,
 	s2.SetPropArrayAndCount(s->GetPropArray(), s->GetPropArrayCount());
 
 	// Adapt camera to new window size
-	vtkCamera *savedCamera = r->GetActiveCamera();
-	savedCamera->Register(this);
-	vtkCamera *newCamera = vtkCamera::New();
-	newCamera->DeepCopy(savedCamera);
-
-	r->SetActiveCamera(newCamera);
-
-	if (newCamera->GetParallelProjection())
-	{
-		newCamera->SetParallelScale(
-			newCamera->GetParallelScale()*newHeight / static_cast<double>(height));
-	}
-	else
-	{
-		double large;
-		double small;
-		if (newCamera->GetUseHorizontalViewAngle())
-		{
-			large = newWidth;
-			small = width;
-		}
-		else
-		{
-			large = newHeight;
-			small = height;
-		}
-		double angle = vtkMath::RadiansFromDegrees(newCamera->GetViewAngle());
-
-		//angle = atan(tan(angle)*large / static_cast<double>(small));
-		angle = 2.0*atan(tan(angle/2.0)*large / static_cast<double>(small));
-
-		newCamera->SetViewAngle(vtkMath::DegreesFromRadians(angle));
-	}
+	this->BeginDelegateCamera(r, width, height, newWidth, newHeight);
 
 	s2.SetFrameBuffer(FrameBufferObject);
 
-	// Create 2D textures
+	// Create 2D textures (no mipmaps, the main pass samples them 1:1)
+	bool resized = false;
+
 	for (auto &t : textures)
 	{
 		if (t.texture->GetWidth() != static_cast<unsigned int>(newWidth) ||
 			t.texture->GetHeight() != static_cast<unsigned int>(newHeight))
 		{
-			t.texture->SetGenerateMipmap(true);
-			t.texture->Create2D(newWidth, newHeight, 4, VTK_UNSIGNED_CHAR, false);
-
+			t.texture->SetGenerateMipmap(false);
+			t.texture->Create2D(newWidth, newHeight, t.components, t.type, false);
+			resized = true;
 		}
 	}
 
@@ -328,32 +297,15 @@ void vtkMyShaderPass::MyRenderDelegate(const vtkRenderState *s,
 		DepthTexture->SetRequireDepthBufferFloat(true);
 		DepthTexture->SetRequireTextureFloat(true);
 
-		DepthTexture->SetGenerateMipmap(true);
+		DepthTexture->SetGenerateMipmap(false);
 		DepthTexture->Create2D(newWidth, newHeight, 1, VTK_VOID, false);
+		resized = true;
 	}
 
-	// Set color attachments
-	FrameBufferObject->SetNumberOfRenderTargets(textures.size());
-	FrameBufferObject->SetDepthBuffer(DepthTexture);
-
-	int num_textures = textures.size();
-	for (int i = 0; i < num_textures; i++)
-		FrameBufferObject->SetColorBuffer(i, textures[i].texture);
-
-	// Render into n attachments (indices)
-	unsigned int *indices = new unsigned int[num_textures];	// Make {0, 1, 2, etc }
-	for (int i = 0; i < num_textures; i++)
-		indices[i] = i;
-
-	FrameBufferObject->SetActiveBuffers(textures.size(), indices);
-	delete[] indices;
-
-	// because the same FBO can be used in another pass but with several color
-	// buffers, force this pass to use 1, to avoid side effects from the
-	// render of the previous frame.
-	//fbo->SetActiveBuffer(0);
+	// Set color attachments (render into all of them), kept by the FBO until targets are resized/recreated
+	if (resized)
+		AttachTargets(FrameBufferObject, textures, DepthTexture);
 
-	FrameBufferObject->SetDepthBufferNeeded(true);
 	FrameBufferObject->StartNonOrtho(newWidth, newHeight, false);
 	glViewport(0, 0, newWidth, newHeight);
 	glScissor(0, 0, newWidth, newHeight);
@@ -362,7 +314,324 @@ void vtkMyShaderPass::MyRenderDelegate(const vtkRenderState *s,
 	this->DelegatePass->Render(&s2);
 	this->NumberOfRenderedProps += this->DelegatePass->GetNumberOfRenderedProps();
 
-	newCamera->Delete();
-	r->SetActiveCamera(savedCamera);
-	savedCamera->UnRegister(this);
+	this->EndDelegateCamera(r);
+}
+// ----------------------------------------------------------------------------
+// Description:
+// Release graphics resources and ask components to release their own
+// resources.
+// \pre w_exists: w!=0
+void vtkMyShaderPass::ReleaseGraphicsResources(vtkWindow *w)
+{
+	assert("pre: w_exists" && w != 0);
+
+	this->Superclass::ReleaseGraphicsResources(w);
+
+	// Texture units go with the textures (both recreated on next render)
+	vector<vtkMyTextureObject *> all = prepassInputs;
+	for (auto t : { &OpaqueDepth, &Accum, &Reveal, &PeelDepth[0], &PeelDepth[1], &PeelFront[0], &PeelFront[1], &PeelBackTemp, &PeelBack })
+		all.push_back(t);
+
+	this->FreeTextures(w, all);
+
+	for (auto t : all)
+		t->texture = nullptr;
+
+	vtkOpenGLRenderWindow *window = vtkOpenGLRenderWindow::SafeDownCast(w);
+	if (window && matcapUnit >= 0 && window->GetTextureUnitManager()->IsAllocated(matcapUnit))
+		window->GetTextureUnitManager()->Free(matcapUnit);
+	matcapUnit = -1;
+
+	DepthTexture = nullptr;
+	FrameBufferObject = nullptr;
+	OITFrameBufferObject = nullptr;
+	PeelFrameBufferObject = nullptr;
+	ResolveProgram = nullptr;
+
+	if (this->DelegatePass != nullptr)
+		this->DelegatePass->ReleaseGraphicsResources(w);
+}
+//------------------------------------------------------------------------------------------------
+void vtkMyShaderPass::setResolveShaderFiles(string vert, string frag)
+{
+	ifstream fileV(vert), fileF(frag);
+
+	stringstream bufV, bufF;
+	bufV << fileV.rdbuf();
+	bufF << fileF.rdbuf();
+
+	resolveV = bufV.str();
+	resolveF = bufF.str();
+	ResolveProgram = nullptr;
+}
+//------------------------------------------------------------------------------------------------
+void vtkMyShaderPass::SetBlendState(bool translucent)
+{
+	if (!translucent || oitStage == OIT_NONE)
+	{
+		Superclass::SetBlendState(translucent);
+		return;
+	}
+
+	glEnable(GL_BLEND);
+
+	if (oitStage == OIT_WEIGHTED)
+	{
+		glBlendFunci(0, GL_ONE, GL_ONE);						// Accumulation: sum of weighted colours
+		glBlendFunci(1, GL_ZERO, GL_ONE_MINUS_SRC_COLOR);		// Revealage: product of (1 - alpha)
+		glEnable(GL_DEPTH_TEST);								// Against the opaque depth
+	}
+	else	// Dual depth peeling: depth range and layers kept with MAX, depth test done by the shader
+	{
+		glBlendEquation(GL_MAX);
+		glDisable(GL_DEPTH_TEST);
+	}
+}
+//------------------------------------------------------------------------------------------------
+int vtkMyShaderPass::RenderProp(vtkProp *p, const vtkRenderState *s, bool translucent)
+{
+	if (!translucent || oitStage == OIT_NONE)
+		return Superclass::RenderProp(p, s, translucent);
+
+	// Order independent: front and back faces in a single draw, no depth writes
+	glDepthMask(GL_FALSE);
+
+	static_cast<vtkMyOpenGLProperty *>(vtkOpenGLProperty::SafeDownCast(vtkActor::SafeDownCast(p)->GetProperty()))->show_all();
+	int rendered = p->RenderFilteredTranslucentPolygonalGeometry(s->GetRenderer(), s->GetRequiredKeys());
+
+	glDepthMask(GL_TRUE);
+	return rendered;
+}
+//------------------------------------------------------------------------------------------------
+void vtkMyShaderPass::CreateTarget(vtkRenderer *r, vtkMyTextureObject &t, int w, int h)
+{
+	if (t.texture == nullptr)
+	{
+		t.texture = vtkSmartPointer<vtkTextureObject>::New();
+		t.texture->SetContext(r->GetRenderWindow());
+	}
+
+	if (t.texture->GetWidth() != static_cast<unsigned int>(w) ||
+		t.texture->GetHeight() != static_cast<unsigned int>(h))
+	{
+		if (t.type == VTK_VOID)		// Same format as the G-buffer depth (copied from it)
+		{
+			t.texture->SetRequireDepthBufferFloat(true);
+			t.texture->SetRequireTextureFloat(true);
+		}
+
+		t.texture->SetGenerateMipmap(false);
+		t.texture->Create2D(w, h, t.components, t.type, false);
+	}
+}
+//------------------------------------------------------------------------------------------------
+void vtkMyShaderPass::StartTargets(vtkFrameBufferObject *fbo, const vector<vtkMyTextureObject *> &targets, int w, int h)
+{
+	assert("pre: max_targets" && targets.size() <= MAX_TARGETS);
+
+	unsigned int indices[MAX_TARGETS];	// { 0, 1, 2, etc }
+	int count = targets.size();
+
+	fbo->SetNumberOfRenderTargets(count);
+	for (int i = 0; i < count; i++)
+	{
+		fbo->SetColorBuffer(i, targets[i]->texture);
+		indices[i] = i;
+	}
+
+	fbo->SetActiveBuffers(count, indices);
+	fbo->StartNonOrtho(w, h, false);
+}
+//------------------------------------------------------------------------------------------------
+void vtkMyShaderPass::CopyOpaqueDepth(vtkRenderer *r, int w, int h)
+{
+	CreateTarget(r, OpaqueDepth, w, h);
+
+	vtkgl::ActiveTexture(vtkgl::TEXTURE0);
+	OpaqueDepth.texture->Bind();
+	glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, w, h);
+	OpaqueDepth.texture->UnBind();
+}
+//------------------------------------------------------------------------------------------------
+void vtkMyShaderPass::RenderTranslucentWeighted(const vtkRenderState *s, int w, int h)
+{
+	vtkRenderer *r = s->GetRenderer();
+
+	CreateTarget(r, Accum, w, h);
+	CreateTarget(r, Reveal, w, h);
+
+	if (OITFrameBufferObject == nullptr)
+	{
+		OITFrameBufferObject = vtkSmartPointer<vtkFrameBufferObject>::New();
+		OITFrameBufferObject->SetContext(r->GetRenderWindow());
+	}
+
+	OITFrameBufferObject->SetDepthBuffer(OpaqueDepth.texture);
+	OITFrameBufferObject->SetDepthBufferNeeded(true);
+	StartTargets(OITFrameBufferObject, { &Accum, &Reveal }, w, h);
+
+	const float zero[4] = { 0, 0, 0, 0 };
+	const float one[4] = { 1, 1, 1, 1 };
+	glClearBufferfv(GL_COLOR, 0, zero);
+	glClearBufferfv(GL_COLOR, 1, one);
+
+	// One pass, any order
+	oitStage = OIT_WEIGHTED;
+	uniforms->SetUniformi("oitMode", 1, &oitStage);
+
+	this->RenderGeometry(s, true);
+
+	oitStage = OIT_NONE;
+	uniforms->SetUniformi("oitMode", 1, &oitStage);
+
+	OITFrameBufferObject->UnBind();
+
+	ResolveTranslucent(r, OIT_WEIGHTED, { &Accum, &Reveal });
+}
+//------------------------------------------------------------------------------------------------
+void vtkMyShaderPass::RenderTranslucentDualPeel(const vtkRenderState *s, int w, int h)
+{
+	vtkRenderer *r = s->GetRenderer();
+
+	for (auto t : { &PeelDepth[0], &PeelDepth[1], &PeelFront[0], &PeelFront[1], &PeelBackTemp, &PeelBack })
+		CreateTarget(r, *t, w, h);
+
+	if (PeelFrameBufferObject == nullptr)
+	{
+		PeelFrameBufferObject = vtkSmartPointer<vtkFrameBufferObject>::New();
+		PeelFrameBufferObject->SetContext(r->GetRenderWindow());
+		PeelFrameBufferObject->SetDepthBufferNeeded(false);
+	}
+	vtkFrameBufferObject *fbo = PeelFrameBufferObject;
+
+	const float emptyRange[4] = { -1, -1, 0, 0 };
+	const float zero[4] = { 0, 0, 0, 0 };
+
+	vector<vtkMyTextureObject *> opaque = { &OpaqueDepth };
+	BindTextures(r, opaque, uniforms, false);
+
+	oitStage = OIT_DUAL_PEEL;
+	uniforms->SetUniformi("oitMode", 1, &oitStage);
+
+	// 1. Depth range of all translucent fragments (in front of the opaque geometry)
+	int pass = 0;
+	uniforms->SetUniformi("peelPass", 1, &pass);
+
+	StartTargets(fbo, { &PeelDepth[0], &PeelFront[0] }, w, h);
+	glClearBufferfv(GL_COLOR, 0, emptyRange);
+	glClearBufferfv(GL_COLOR, 1, zero);
+
+	this->RenderGeometry(s, true);
+	glBlendEquation(GL_FUNC_ADD);
+	fbo->UnBind();
+
+	StartTargets(fbo, { &PeelBack }, w, h);
+	glClearBufferfv(GL_COLOR, 0, zero);
+	fbo->UnBind();
+
+	// 2. Peel nearest and farthest layers until no back layer is left (query) or MAX_PEELS
+	GLuint query;
+	glGenQueries(1, &query);
+
+	int current = 0;
+	for (pass = 1; pass <= MAX_PEELS; pass++)
+	{
+		int previous = current;
+		current = 1 - current;
+
+		StartTargets(fbo, { &PeelDepth[current], &PeelFront[current], &PeelBackTemp }, w, h);
+		glClearBufferfv(GL_COLOR, 0, emptyRange);
+		glClearBufferfv(GL_COLOR, 1, zero);
+		glClearBufferfv(GL_COLOR, 2, zero);
+
+		vector<vtkMyTextureObject *> inputs = { &PeelDepth[previous], &PeelFront[previous] };
+		BindTextures(r, inputs, uniforms, false);
+		uniforms->SetUniformi("peelPass", 1, &pass);
+
+		this->RenderGeometry(s, true);
+		glBlendEquation(GL_FUNC_ADD);
+
+		fbo->UnBind();
+
+		// Back layer goes under the back layers peeled so far (back to front)
+		StartTargets(fbo, { &PeelBack }, w, h);
+		glEnable(GL_BLEND);
+		glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+		glBeginQuery(GL_SAMPLES_PASSED, query);
+		DrawComposite(r, OIT_BACK_BLEND, { &PeelBackTemp });
+		glEndQuery(GL_SAMPLES_PASSED);
+
+		glDisable(GL_BLEND);
+		fbo->UnBind();
+
+		GLuint samples = 0;
+		glGetQueryObjectuiv(query, GL_QUERY_RESULT, &samples);
+		if (samples == 0)
+			break;
+	}
+	glDeleteQueries(1, &query);
+
+	oitStage = OIT_NONE;
+	uniforms->SetUniformi("oitMode", 1, &oitStage);
+
+	// 3. Front layers over back layers, over the opaque colour
+	ResolveTranslucent(r, OIT_DUAL_PEEL, { &PeelFront[current], &PeelBack });
+}
+//------------------------------------------------------------------------------------------------
+void vtkMyShaderPass::DrawComposite(vtkRenderer *r, int mode, const vector<vtkMyTextureObject *> &inputs)
+{
+	if (!BuildProgram(ResolveProgram, r, resolveV, resolveF))
+		return;
+
+	vtkUniformVariables *var = ResolveProgram->GetUniformVariables();
+
+	BindTextures(r, inputs, var, false);
+	var->SetUniformi("mode", 1, &mode);
+
+	ResolveProgram->Use();
+
+	// Fullscreen quad
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+
+	glBegin(GL_QUADS);
+	glTexCoord2f(0, 0); glVertex2f(-1, -1);
+	glTexCoord2f(1, 0); glVertex2f(1, -1);
+	glTexCoord2f(1, 1); glVertex2f(1, 1);
+	glTexCoord2f(0, 1); glVertex2f(-1, 1);
+	glEnd();
+
+	glPopMatrix();
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+
+	ResolveProgram->Restore();
+}
+//------------------------------------------------------------------------------------------------
+void vtkMyShaderPass::ResolveTranslucent(vtkRenderer *r, int mode, const vector<vtkMyTextureObject *> &inputs)
+{
+	// Colour only (normals and cap mask stay those of the opaque surfaces)
+	GLint maxBuffers = 1;
+	glGetIntegerv(GL_MAX_DRAW_BUFFERS, &maxBuffers);
+
+	for (int i = 1; i < maxBuffers; i++)
+		glColorMaski(i, GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+	// Shader gives (premultiplied translucent colour, transmittance): colour + transmittance * opaque
+	glDisable(GL_DEPTH_TEST);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_SRC_ALPHA);
+
+	DrawComposite(r, mode, inputs);
+
+	glDisable(GL_BLEND);
+
+	for (int i = 1; i < maxBuffers; i++)
+		glColorMaski(i, GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
 }
\ No newline at end of file
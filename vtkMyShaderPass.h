@@ -36,6 +36,14 @@ PURPOSE.  See the above copyright notice for more information.
 class vtkTextureObject;			// pimpl
 class vtkFrameBufferObject;
 
+// --- How translucent geometry is composited
+enum TranslucencyMode
+{
+	TRANSLUCENCY_BLEND,		// Alpha blending in draw order (back faces, then front faces)
+	TRANSLUCENCY_WEIGHTED,	// Weighted blended order independent transparency (one geometry pass)
+	TRANSLUCENCY_DUAL_PEEL	// Dual depth peeling (exact, two layers per geometry pass)
+};
+
 class VTK_EXPORT vtkMyShaderPass : public vtkMyBasePass
 {
 public:
@@ -49,12 +57,29 @@ public:
 	// \pre s_exists: s!=0
 	virtual void Render(const vtkRenderState *s);
 
+	// Description:
+	// Release graphics resources and ask components to release their own
+	// resources.
+	// \pre w_exists: w!=0
+	virtual void ReleaseGraphicsResources(vtkWindow *w) override;
+
 	// Set/Get Delegate pass (called while rendering to FBO, then texture sent to new shader for processing)
 	//vtkGetObjectMacro(DelegatePass, vtkRenderPass);
 	virtual void SetDelegatePass(vtkRenderPass *delegatePass);
 
 	///<summary>My Custom delegate method that renders to FBO/Texture </summary>
 	void MyRenderDelegate(const vtkRenderState *s, int width, int height, int newWidth, int newHeight);
+
+	///<summary> Order independent modes need to be rendered into an FBO (e.g. post-processing G-buffer), else blended </summary>
+	void setTranslucencyMode(TranslucencyMode mode) { translucencyMode = mode; }
+	TranslucencyMode getTranslucencyMode() const { return translucencyMode; }
+
+	///<summary> Vertex/fragment shaders compositing the translucent layers (fullscreen quad) </summary>
+	void setResolveShaderFiles(string vert, string frag);
+
+	static const int MAX_PEELS = 4;		// Dual depth peeling passes (up to 8 layers)
+
+	virtual int RenderProp(vtkProp *p, const vtkRenderState *s, bool translucent) override;
 	
 protected:
 	// Description:
@@ -68,11 +93,51 @@ protected:
 	// Description:
 	// Graphics resources.
 	vector<vtkMyTextureObject> textures;
+	vector<vtkMyTextureObject *> prepassInputs;		// textures, as bound for the main pass
+
+	int matcapUnit = -1;		// Allocated once (aperio's matcap.unit)
 
 	vtkSmartPointer<vtkFrameBufferObject> FrameBufferObject;
 	vtkSmartPointer<vtkTextureObject> DepthTexture; // Dummy Depth Texture
 
 	vtkSmartPointer<vtkRenderPass> DelegatePass;	// Delegate pass
+
+	// --- Order independent transparency (stage values are shared with shader.frag's oitMode and shader_oit.frag's mode)
+	enum OITStage { OIT_NONE, OIT_WEIGHTED, OIT_DUAL_PEEL, OIT_BACK_BLEND };
+
+	virtual void SetBlendState(bool translucent) override;
+
+	void RenderTranslucentWeighted(const vtkRenderState *s, int w, int h);
+	void RenderTranslucentDualPeel(const vtkRenderState *s, int w, int h);
+
+	///<summary> Copies depth of the opaque geometry from the bound framebuffer </summary>
+	void CopyOpaqueDepth(vtkRenderer *r, int w, int h);
+
+	///<summary> Creates/resizes a render target (or depth texture if type is VTK_VOID) </summary>
+	void CreateTarget(vtkRenderer *r, vtkMyTextureObject &t, int w, int h);
+
+	///<summary> Binds fbo with targets as colour attachments 0..n </summary>
+	void StartTargets(vtkFrameBufferObject *fbo, const vector<vtkMyTextureObject *> &targets, int w, int h);
+
+	///<summary> Draws a fullscreen quad with the resolve shader (mode is an OITStage) </summary>
+	void DrawComposite(vtkRenderer *r, int mode, const vector<vtkMyTextureObject *> &inputs);
+
+	///<summary> Composites translucent layers over the opaque colour (attachment 0 of the bound framebuffer) </summary>
+	void ResolveTranslucent(vtkRenderer *r, int mode, const vector<vtkMyTextureObject *> &inputs);
+
+	TranslucencyMode translucencyMode = TRANSLUCENCY_WEIGHTED;
+	int oitStage = OIT_NONE;			// Stage of the translucent geometry pass being rendered
+
+	vtkSmartPointer<vtkFrameBufferObject> OITFrameBufferObject;		// Weighted: accumulation + revealage, opaque depth
+	vtkSmartPointer<vtkFrameBufferObject> PeelFrameBufferObject;	// Dual peeling: depth range + front + back (no depth buffer)
+
+	vtkMyTextureObject OpaqueDepth;
+	vtkMyTextureObject Accum, Reveal;
+	vtkMyTextureObject PeelDepth[2], PeelFront[2];	// Ping-pong between passes
+	vtkMyTextureObject PeelBackTemp, PeelBack;
+
+	vtkSmartPointer<vtkShaderProgram2> ResolveProgram;
+	string resolveV, resolveF;
 private:
 	vtkMyShaderPass(const vtkMyShaderPass&);  // Not implemented.
 	void operator=(const vtkMyShaderPass&);  // Not implemented.